@@ -1,13 +1,75 @@
 
 #include "fs.h"
 
+// The block cache holds at most bc_budget blocks.  bc_slots lists the
+// resident ones in CLOCK order: once the cache is full, bc_evict sweeps
+// the hand over it, giving blocks whose PTE_A is set a second chance
+// (and writing them back if they are dirty, which clears PTE_A as well)
+// and unmapping the first one that was not accessed since the previous
+// sweep.  The superblock and bitmap blocks are never evicted.
+//
+// Every block has at most one slot, bc_slotted marks the blocks that
+// have one.  The kernel may drop clean block cache pages itself under
+// memory pressure: their slots stay, a fault on such a block maps it
+// again under its old slot, and the hand frees the slot if it finds
+// the block still unmapped.  Blocks unmapped by the file system itself
+// go through bc_unmap, which frees their slot at once.
+//
+// Faults read ahead: a fault on the block just after the previous run
+// read doubles the length of the run, up to bc_ra_max blocks, and the
+// run is read with a single disk request.  Any other fault starts over
+// with a single block.
+//
+// Clean blocks are mapped read-only, so the first write to a block
+// faults and bc_pgfault adds it to the dirty set before mapping it
+// writable.  The set is a bitmap over all blocks with a summary bitmap
+// above it, one bit per nonzero word, so that walking it costs about
+// the number of dirty blocks rather than the size of the disk.
+//
+// Writes are delayed: the file system only dirties blocks, and
+// bc_writeback queues them for the disk in block order, each contiguous
+// run as a single disk request, every BC_WB_INTERVAL milliseconds and on
+// FSREQ_SYNC.  An interval timer sets bc_wb_due, the serve loop calls
+// bc_writeback_poll between requests; the timer also ends the
+// ipc_recv of an idle server.
+
+#define BC_MINBUDGET	32
+#define BC_MAXPAGES	4096
+
+static uint32_t bc_slots[BC_MAXPAGES];
+static uint32_t bc_nslots;
+static uint32_t bc_hand;
+
+static uint32_t bc_ra_next;		// Block just after the last run read
+static uint32_t bc_ra_len;		// Length of that run
+
+static volatile bool bc_wb_due;
+
+#define BC_NBLOCKS	(DISKSIZE / BLKSIZE)
+static uint32_t bc_dirty[BC_NBLOCKS / 32];
+static uint32_t bc_dirty_sum[BC_NBLOCKS / 32 / 32];
+static uint32_t bc_slotted[BC_NBLOCKS / 32];
+
+static struct BcStat bc_stats = {
+	.bc_budget = BC_BUDGET,
+	.bc_ra_max = BC_RA_MAX,
+};
+
+static void *
+bc_va(uint32_t blockno)
+{
+	return (char *) (DISKMAP + blockno * BLKSIZE);
+}
+
 // Return the virtual address of this disk block.
 void*
 diskaddr(uint32_t blockno)
 {
 	if (blockno == 0 || (super && blockno >= super->s_nblocks))
 		panic("bad block number %08x in diskaddr", blockno);
-	return (char*) (DISKMAP + blockno * BLKSIZE);
+	if (va_is_mapped(bc_va(blockno)))
+		bc_stats.bc_hits++;
+	return bc_va(blockno);
 }
 
 // Is this virtual address mapped?
@@ -24,6 +86,149 @@ va_is_dirty(void *va)
 	return (uvpt[PGNUM(va)] & PTE_D) != 0;
 }
 
+static void
+bc_set_dirty(uint32_t blockno)
+{
+	uint32_t w = blockno / 32;
+
+	if (!(bc_dirty[w] & (1 << (blockno % 32))))
+		bc_stats.bc_dirty++;
+	bc_dirty[w] |= 1 << (blockno % 32);
+	bc_dirty_sum[w / 32] |= 1 << (w % 32);
+}
+
+static void
+bc_clear_dirty(uint32_t blockno)
+{
+	uint32_t w = blockno / 32;
+
+	if (bc_dirty[w] & (1 << (blockno % 32)))
+		bc_stats.bc_dirty--;
+	bc_dirty[w] &= ~(1 << (blockno % 32));
+	if (!bc_dirty[w])
+		bc_dirty_sum[w / 32] &= ~(1 << (w % 32));
+}
+
+// Return the first dirty block at or after 'blockno', or 0 if none.
+static uint32_t
+bc_next_dirty(uint32_t blockno)
+{
+	uint32_t w = blockno / 32, bits;
+
+	if (blockno >= BC_NBLOCKS)
+		return 0;
+	// The rest of the first word, then the next nonzero word found
+	// through the summary.
+	if ((bits = bc_dirty[w] & ~((1U << (blockno % 32)) - 1)))
+		return w * 32 + __builtin_ctz(bits);
+	for (w++; w < BC_NBLOCKS / 32; w = ROUNDUP(w + 1, 32)) {
+		if ((bits = bc_dirty_sum[w / 32] & ~((1U << (w % 32)) - 1))) {
+			w = ROUNDDOWN(w, 32) + __builtin_ctz(bits);
+			return w * 32 + __builtin_ctz(bc_dirty[w]);
+		}
+	}
+	return 0;
+}
+
+// Is block 'blockno' in the dirty set?
+bool
+bc_is_dirty(uint32_t blockno)
+{
+	return (bc_dirty[blockno / 32] & (1 << (blockno % 32))) != 0;
+}
+
+static bool
+bc_pinned(uint32_t blockno)
+{
+	return blockno == 1 ||
+	       (super && blockno >= 2 &&
+		blockno < 2 + ROUNDUP(super->s_nblocks, BLKBITSIZE) / BLKBITSIZE);
+}
+
+static bool
+bc_has_slot(uint32_t blockno)
+{
+	return (bc_slotted[blockno / 32] & (1 << (blockno % 32))) != 0;
+}
+
+static void
+bc_slot_add(uint32_t blockno)
+{
+	if (bc_has_slot(blockno))
+		return;
+	bc_slotted[blockno / 32] |= 1 << (blockno % 32);
+	bc_slots[bc_nslots++] = blockno;
+}
+
+static void
+bc_slot_remove(uint32_t slot)
+{
+	uint32_t blockno = bc_slots[slot];
+
+	bc_slotted[blockno / 32] &= ~(1 << (blockno % 32));
+	bc_slots[slot] = bc_slots[--bc_nslots];
+}
+
+// Drop block 'blockno' from the cache without writing it back.
+static void
+bc_unmap(uint32_t blockno)
+{
+	if (sys_page_unmap(0, bc_va(blockno)) < 0)
+		panic("bc_unmap: page unmap error");
+	bc_clear_dirty(blockno);
+	if (!bc_has_slot(blockno))
+		return;
+	for (uint32_t slot = 0; slot < bc_nslots; slot++)
+		if (bc_slots[slot] == blockno) {
+			bc_slot_remove(slot);
+			return;
+		}
+}
+
+// Free one slot of the cache, see the comment at the top.
+static void
+bc_evict(void)
+{
+	// Every unpinned block is unmapped within two turns of the hand.
+	for (uint32_t n = 0; n < 2 * bc_nslots + 1; n++, bc_hand++) {
+		uint32_t blockno;
+		void *va;
+
+		if (bc_hand >= bc_nslots)
+			bc_hand = 0;
+		blockno = bc_slots[bc_hand];
+		va = bc_va(blockno);
+
+		if (!va_is_mapped(va)) {
+			bc_clear_dirty(blockno);
+			bc_slot_remove(bc_hand);
+			return;
+		}
+		if (bc_pinned(blockno))
+			continue;
+		if (uvpt[PGNUM(va)] & PTE_A) {
+			if (bc_is_dirty(blockno)) {
+				flush_block(va);
+				bc_stats.bc_writebacks++;
+			} else if (sys_page_map(0, va, 0, va,
+						uvpt[PGNUM(va)] & PTE_SYSCALL) < 0)
+				panic("bc_evict: page map error");
+			continue;
+		}
+
+		if (bc_is_dirty(blockno)) {
+			flush_block(va);
+			bc_stats.bc_writebacks++;
+		}
+		if (sys_page_unmap(0, va) < 0)
+			panic("bc_evict: page unmap error");
+		bc_slot_remove(bc_hand);
+		bc_stats.bc_evictions++;
+		return;
+	}
+	panic("bc_evict: all %d blocks pinned", bc_nslots);
+}
+
 // Fault any disk block that is read in to memory by
 // loading it from disk.
 static void
@@ -31,6 +236,7 @@ bc_pgfault(struct UTrapframe *utf)
 {
 	void *addr = (void *) utf->utf_fault_va;
 	uint32_t blockno = ((uint32_t)addr - DISKMAP) / BLKSIZE;
+	uint32_t n, want, nnew;
 	int r;
 
 	// Check that the fault was within the block cache region
@@ -42,6 +248,15 @@ bc_pgfault(struct UTrapframe *utf)
 	if (super && blockno >= super->s_nblocks)
 		panic("reading non-existent block %08x\n", blockno);
 
+	// The first write to a clean block: it joins the dirty set.
+	if ((utf->utf_err & FEC_WR) && va_is_mapped(addr)) {
+		addr = ROUNDDOWN(addr, BLKSIZE);
+		bc_set_dirty(blockno);
+		if ((r = sys_page_map(0, addr, 0, addr, PTE_P | PTE_U | PTE_W)) < 0)
+			panic("in bc_pgfault, sys_page_map: %i", r);
+		return;
+	}
+
 	// Allocate a page in the disk map region, read the contents
 	// of the block from the disk into that page.
 	// Hint: first round addr to page boundary. fs/ide.c has code to read
@@ -62,18 +277,58 @@ bc_pgfault(struct UTrapframe *utf)
 	// }
 	addr = ROUNDDOWN(addr, BLKSIZE);
 
-	if (sys_page_alloc(0, addr, PTE_P | PTE_U | PTE_W)) {
-		panic("bc_pgfault: OOM");
+	// Extend the run over allocated blocks that are not cached yet.
+	// Without the bitmap, free blocks cannot be told apart.
+	want = blockno == bc_ra_next ? bc_ra_len * 2 : 1;
+	want = MIN(want, MIN(bc_stats.bc_ra_max, bc_stats.bc_budget / 4));
+	for (n = 1; n < want && super && bitmap; n++)
+		if (blockno + n >= super->s_nblocks ||
+		    va_is_mapped(bc_va(blockno + n)) ||
+		    block_is_free(blockno + n))
+			break;
+
+	// Blocks the kernel dropped come back under their old slot, unless
+	// the hand frees it first.
+	for (;;) {
+		nnew = 0;
+		for (uint32_t i = 0; i < n; i++)
+			nnew += !bc_has_slot(blockno + i);
+		if (bc_nslots + nnew <= bc_stats.bc_budget)
+			break;
+		bc_evict();
 	}
 
-	if (ide_read(blockno * BLKSECTS, addr, BLKSECTS)) {
-		panic("bc_pgfault: ide read error");
+	// Touch the new pages: the kernel leaves dirty pages alone while
+	// disk_read sleeps.
+	for (uint32_t i = 0; i < n; i++) {
+		if (sys_page_alloc(0, bc_va(blockno + i), PTE_P | PTE_U | PTE_W)) {
+			panic("bc_pgfault: OOM");
+		}
+		*(volatile char *) bc_va(blockno + i) = 0;
 	}
 
-	// Clear the dirty bit for the disk block page since we just read the
-	// block from disk
-	if ((r = sys_page_map(0, addr, 0, addr, uvpt[PGNUM(addr)] & PTE_SYSCALL)) < 0)
-		panic("in bc_pgfault, sys_page_map: %i", r);
+	if (disk_read(blockno * BLKSECTS, addr, n * BLKSECTS)) {
+		panic("bc_pgfault: disk read error");
+	}
+
+	// Map the blocks clean, which clears the dirty bit and write
+	// protects them, except for the faulting block if this is a write.
+	for (uint32_t i = 0; i < n; i++) {
+		void *va = bc_va(blockno + i);
+		int perm = PTE_P | PTE_U;
+
+		if (i == 0 && (utf->utf_err & FEC_WR)) {
+			bc_set_dirty(blockno);
+			perm |= PTE_W;
+		}
+		if ((r = sys_page_map(0, va, 0, va, perm)) < 0)
+			panic("in bc_pgfault, sys_page_map: %i", r);
+		bc_slot_add(blockno + i);
+	}
+	bc_stats.bc_misses++;
+	bc_stats.bc_readahead += n - 1;
+	bc_ra_next = blockno + n;
+	bc_ra_len = n;
 
 	// Check that the block we read was allocated. (exercise for
 	// the reader: why do we do this *after* reading the block
@@ -114,17 +369,179 @@ flush_block(void *addr)
 
 	addr = ROUNDDOWN(addr, BLKSIZE);
 
-	if (!va_is_mapped(addr) || !va_is_dirty(addr)) {
+	// Blocks outside the dirty set are mapped read-only and clean.
+	if (!bc_is_dirty(blockno)) {
+		return;
+	}
+	if (!va_is_mapped(addr)) {
+		bc_clear_dirty(blockno);
 		return;
 	}
 
-	if (ide_write(BLKSECTS * blockno, addr, BLKSECTS)) {
-		panic("flush_block: ide write error");
+	if (va_is_dirty(addr) && disk_write(BLKSECTS * blockno, addr, BLKSECTS)) {
+		panic("flush_block: disk write error");
 	}
 
-	if (sys_page_map(0, addr, 0, addr, uvpt[PGNUM(addr)] & PTE_SYSCALL)) {
+	if (sys_page_map(0, addr, 0, addr, PTE_P | PTE_U)) {
 		panic("flush_block: page map error");
 	}
+	bc_clear_dirty(blockno);
+}
+
+// Queue the 'n' dirty blocks from 'blockno' for the disk as one request.
+static void
+bc_wb_submit(uint32_t blockno, uint32_t n)
+{
+	if (disk_submit(blockno * BLKSECTS, bc_va(blockno),
+		       n * BLKSECTS, true) < 0)
+		panic("bc_writeback: disk write error");
+	bc_stats.bc_wb_runs++;
+	bc_stats.bc_wb_blocks += n;
+}
+
+// Map a written block clean.  Only once disk_run has returned: the
+// kernel may drop clean block cache pages while we sleep on the disk.
+static void
+bc_wb_done(uint32_t blockno)
+{
+	void *va = bc_va(blockno);
+
+	if (sys_page_map(0, va, 0, va, PTE_P | PTE_U))
+		panic("bc_writeback: page map error");
+	bc_clear_dirty(blockno);
+}
+
+// Write every block of the dirty set back to disk, in block order and
+// coalescing contiguous blocks.
+void
+bc_writeback(void)
+{
+	uint32_t blockno, n;
+
+	// The set is walked in block order, so runs are queued sorted.
+	for (blockno = bc_next_dirty(0); blockno;
+	     blockno = bc_next_dirty(blockno + n)) {
+		n = 1;
+		if (!va_is_mapped(bc_va(blockno))) {
+			bc_clear_dirty(blockno);
+			continue;
+		}
+		while (n < BC_RA_MAX && bc_is_dirty(blockno + n) &&
+		       va_is_mapped(bc_va(blockno + n)))
+			n++;
+		bc_wb_submit(blockno, n);
+	}
+	if (disk_run() < 0)
+		panic("bc_writeback: disk write error");
+
+	for (blockno = bc_next_dirty(0); blockno;
+	     blockno = bc_next_dirty(blockno + 1))
+		bc_wb_done(blockno);
+}
+
+// Write the distinct blocks of 'blocks' that are in the dirty set back
+// to disk, coalescing contiguous blocks as bc_writeback does.  Reorders
+// 'blocks'.
+void
+bc_writeback_blocks(uint32_t *blocks, uint32_t nblocks)
+{
+	uint32_t i, j, n, blockno;
+
+	// Keep the dirty, mapped blocks and sort them.  Files are mostly
+	// allocated in order, so insertion sort does little work.
+	for (i = j = 0; i < nblocks; i++) {
+		blockno = blocks[i];
+		if (!blockno || !bc_is_dirty(blockno))
+			continue;
+		if (!va_is_mapped(bc_va(blockno))) {
+			bc_clear_dirty(blockno);
+			continue;
+		}
+		for (n = j++; n > 0 && blocks[n - 1] > blockno; n--)
+			blocks[n] = blocks[n - 1];
+		blocks[n] = blockno;
+	}
+	nblocks = j;
+
+	for (i = 0; i < nblocks; i += n) {
+		for (n = 1; i + n < nblocks && n < BC_RA_MAX &&
+		     blocks[i + n] == blocks[i] + n; n++)
+			;
+		bc_wb_submit(blocks[i], n);
+	}
+	if (disk_run() < 0)
+		panic("bc_writeback: disk write error");
+
+	for (i = 0; i < nblocks; i++)
+		bc_wb_done(blocks[i]);
+}
+
+static void
+bc_wb_tick(timer_t t)
+{
+	bc_wb_due = true;
+}
+
+// Write back if the write-back timer expired since the last call.
+void
+bc_writeback_poll(void)
+{
+	if (bc_wb_due) {
+		bc_wb_due = false;
+		bc_writeback();
+	}
+}
+
+// Write every dirty block back and wait until the disk has them on its
+// media: the durability barrier of FSREQ_SYNC.
+void
+bc_sync(void)
+{
+	bc_writeback();
+	if (disk_flush() < 0)
+		panic("bc_sync: disk flush error");
+}
+
+//
+// Change the most blocks the cache may hold to 'budget', evicting
+// blocks at once if it shrinks.
+//
+// Returns 0 on success, -E_INVAL if 'budget' is below BC_MINBUDGET or
+// above BC_MAXPAGES.
+//
+int
+bc_set_budget(uint32_t budget)
+{
+	if (budget < BC_MINBUDGET || budget > BC_MAXPAGES)
+		return -E_INVAL;
+	bc_stats.bc_budget = budget;
+	while (bc_nslots > budget)
+		bc_evict();
+	return 0;
+}
+
+//
+// Read ahead at most 'max' blocks per fault, 1 turns read-ahead off.
+//
+// Returns 0 on success, -E_INVAL if 'max' is 0 or above BC_RA_MAX.
+//
+int
+bc_set_readahead(uint32_t max)
+{
+	if (max < 1 || max > BC_RA_MAX)
+		return -E_INVAL;
+	bc_stats.bc_ra_max = max;
+	return 0;
+}
+
+// Copy the cache statistics to 'stat'.
+void
+bc_stat(struct BcStat *stat)
+{
+	*stat = bc_stats;
+	stat->bc_resident = bc_nslots;
+	stat->bc_dma = disk_is_virtio() || ide_dma_enabled();
+	stat->bc_virtio = disk_is_virtio();
 }
 
 // Test that the block cache works, by smashing the superblock and
@@ -144,7 +561,7 @@ check_bc(void)
 	assert(!va_is_dirty(diskaddr(1)));
 
 	// clear it out
-	sys_page_unmap(0, diskaddr(1));
+	bc_unmap(1);
 	assert(!va_is_mapped(diskaddr(1)));
 
 	// read it back in
@@ -161,9 +578,20 @@ void
 bc_init(void)
 {
 	struct Super super;
+	struct itimerspec wb = {
+		.it_interval = { 0, BC_WB_INTERVAL * 1000000LL },
+		.it_value = { 0, BC_WB_INTERVAL * 1000000LL },
+	};
+	timer_t t;
+	int r;
+
 	set_pgfault_handler(bc_pgfault);
 	check_bc();
 
+	if ((r = timer_create(CLOCK_MONOTONIC, bc_wb_tick, &t)) < 0 ||
+	    (r = timer_settime(t, 0, &wb, NULL)) < 0)
+		panic("bc_init: write-back timer: %i", r);
+
 	// cache the super block by reading it once
 	memmove(&super, diskaddr(1), sizeof super);
 }
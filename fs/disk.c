@@ -0,0 +1,69 @@
+// The disk the file system lives on: a virtio-blk device if there is
+// one, else IDE.  Both take queued requests and serve them on disk_run.
+
+#include "fs.h"
+
+static bool disk_virtio;
+
+void
+disk_init(void)
+{
+	if (virtio_init()) {
+		disk_virtio = true;
+		return;
+	}
+
+	// Find a JOS disk.  Use the second IDE disk (number 1) if available
+	if (ide_probe_disk1())
+		ide_set_disk(1);
+	else
+		ide_set_disk(0);
+	ide_dma_init();
+}
+
+bool
+disk_is_virtio(void)
+{
+	return disk_virtio;
+}
+
+int
+disk_submit(uint32_t secno, void *buf, size_t nsecs, bool write)
+{
+	if (disk_virtio)
+		return virtio_submit(secno, buf, nsecs, write);
+	return ide_submit(secno, buf, nsecs, write);
+}
+
+int
+disk_run(void)
+{
+	return disk_virtio ? virtio_run() : ide_run();
+}
+
+int
+disk_read(uint32_t secno, void *dst, size_t nsecs)
+{
+	int r;
+
+	if ((r = disk_submit(secno, dst, nsecs, false)) < 0)
+		return r;
+	return disk_run();
+}
+
+int
+disk_write(uint32_t secno, const void *src, size_t nsecs)
+{
+	int r;
+
+	if ((r = disk_submit(secno, (void *) src, nsecs, true)) < 0)
+		return r;
+	return disk_run();
+}
+
+// Wait until the disk has written all completed writes to its media.
+int
+disk_flush(void)
+{
+	return disk_virtio ? virtio_flush() : ide_flush();
+}
@@ -36,6 +36,15 @@ block_is_free(uint32_t blockno)
 	return 0;
 }
 
+// Free blocks per bitmap block, so that full stretches of the disk
+// are skipped without reading their bitmap words.
+static uint32_t bitmap_nfree[DISKSIZE / BLKSIZE / BLKBITSIZE];
+static uint32_t nbitblocks;
+
+// Where allocations without a better goal start looking.
+static uint32_t alloc_rotor;
+static uint32_t alloc_blocks_total, alloc_scanned;
+
 // Mark a block free in the bitmap
 void
 free_block(uint32_t blockno)
@@ -44,61 +53,89 @@ free_block(uint32_t blockno)
 	if (blockno == 0)
 		panic("attempt to free zero block");
 	bitmap[blockno/32] |= 1<<(blockno%32);
+	bitmap_nfree[blockno / BLKBITSIZE]++;
 }
 
-// Search the bitmap for a free block and allocate it.  When you
-// allocate a block, immediately flush the changed bitmap block
-// to disk.
-//
-// Return block number allocated on success,
-// -E_NO_DISK if we are out of blocks.
-//
-// Hint: use free_block as an example for manipulating the bitmap.
-int
-alloc_block(void)
+// Count the free blocks of each bitmap block.
+static void
+bitmap_init(void)
 {
-	// The bitmap consists of one or more blocks.  A single bitmap block
-	// contains the in-use bits for BLKBITSIZE blocks.  There are
-	// super->s_nblocks blocks in the disk altogether.
-
-	// LAB 10: Your code here.
-	// for (int blockno = 0; blockno < super->s_nblocks; blockno++) {
-
-	//     if (block_is_free(blockno)) {
-	//         bitmap[blockno /32] &= ~(1 <<(blockno % 32));
-	//         flush_block(bitmap);
-	//         return blockno;
-	//      }
-	// }
-
 	uint32_t bn;
-	for (bn = 0; bn < super->s_nblocks; bn += 32) {
-		unsigned chunk = bn / 32;
 
-		if (bitmap[chunk] == 0) {
-			continue;
-		}
+	nbitblocks = (super->s_nblocks + BLKBITSIZE - 1) / BLKBITSIZE;
+	for (bn = 0; bn < super->s_nblocks; bn++)
+		if (bitmap[bn / 32] & (1 << (bn % 32)))
+			bitmap_nfree[bn / BLKBITSIZE]++;
+}
 
-		while (!(bitmap[chunk] & 1 << (bn % 32))) {
-			++bn;
+// Find the first free block at or after 'goal', wrapping around to
+// the start of the disk.
+static int
+bitmap_find(uint32_t goal)
+{
+	uint32_t k, g, w, first, last, bits;
+
+	if (goal >= super->s_nblocks)
+		goal = 0;
+	// Visit the goal's bitmap block twice: from the goal on first, and
+	// from its start after wrapping around.
+	for (k = 0; k <= nbitblocks; k++) {
+		g = (goal / BLKBITSIZE + k) % nbitblocks;
+		if (!bitmap_nfree[g])
+			continue;
+		first = k == 0 ? goal / 32 : g * BLKBITSIZE / 32;
+		last = (MIN((g + 1) * BLKBITSIZE, super->s_nblocks) + 31) / 32;
+		for (w = first; w < last; w++) {
+			alloc_scanned++;
+			bits = bitmap[w];
+			if (k == 0 && w == goal / 32)
+				bits &= ~0u << (goal % 32);
+			if (!bits)
+				continue;
+			// Bits past the end of the disk are set but not blocks.
+			if (w * 32 + __builtin_ctz(bits) >= super->s_nblocks)
+				break;
+			return w * 32 + __builtin_ctz(bits);
 		}
+	}
+	return -E_NO_DISK;
+}
 
-		bitmap[chunk] &= ~(1 << (bn % 32));
-		flush_block(bitmap);
+// Allocate up to '*n' blocks with consecutive numbers, starting with
+// the first free block at or after 'goal', and set '*n' to the number
+// allocated.  The changed bitmap blocks reach the disk with the next
+// write-back (see bc.c).
+//
+// Returns the first block number allocated on success,
+// -E_NO_DISK if we are out of blocks.
+int
+alloc_blocks(uint32_t goal, uint32_t *n)
+{
+	uint32_t i;
+	int bn;
 
+	if ((bn = bitmap_find(goal)) < 0)
 		return bn;
+	for (i = 0; i < *n && block_is_free(bn + i); i++) {
+		bitmap[(bn + i) / 32] &= ~(1 << ((bn + i) % 32));
+		bitmap_nfree[(bn + i) / BLKBITSIZE]--;
 	}
+	*n = i;
+	alloc_rotor = bn + i;
+	alloc_blocks_total += i;
+	return bn;
+}
 
-	// int i;
-	// for (i = 2; i < super->s_nblocks; i++) {
-	// 	uint32_t bit = 1 << (i % 32);
-	// 	if (bitmap[i / 32] & bit) {
-	// 		bitmap[i / 32] ^= bit;
-	// 		flush_block(diskaddr(i));
-	// 		return i;
-	// 	}
-	// }
-	return -E_NO_DISK;
+// Allocate a block near the last one allocated.
+//
+// Return block number allocated on success,
+// -E_NO_DISK if we are out of blocks.
+int
+alloc_block(void)
+{
+	uint32_t n = 1;
+
+	return alloc_blocks(alloc_rotor, &n);
 }
 
 // Validate the file system bitmap.
@@ -133,11 +170,7 @@ fs_init(void)
 {
 	static_assert(sizeof(struct File) == 256);
 
-       // Find a JOS disk.  Use the second IDE disk (number 1) if availabl
-       if (ide_probe_disk1())
-               ide_set_disk(1);
-       else
-               ide_set_disk(0);
+	disk_init();
 	bc_init();
 
 	// Set "super" to point to the super block.
@@ -147,6 +180,7 @@ fs_init(void)
 	// Set "bitmap" to the beginning of the first bitmap block.
 	bitmap = diskaddr(2);
 	check_bitmap();
+	bitmap_init();
 	
 }
 
@@ -230,6 +264,72 @@ file_block_walk(struct File *f, uint32_t filebno, uint32_t **ppdiskbno, bool all
 	return 0;
 }
 
+// Where the 'filebno'th block of 'f' should go: right after the block
+// before it, so that files are laid out in order.
+static uint32_t
+file_block_goal(struct File *f, uint32_t filebno)
+{
+	uint32_t *ptr;
+
+	if (filebno > 0 && file_block_walk(f, filebno - 1, &ptr, 0) == 0 &&
+	    *ptr)
+		return *ptr + 1;
+	return alloc_rotor;
+}
+
+// Give disk blocks to those of the blocks 'first' to 'last' - 1 of 'f'
+// that have none, allocating each hole in as few runs as free space
+// allows.
+//
+// Returns 0 on success, < 0 on error.
+static int
+file_alloc_range(struct File *f, uint32_t first, uint32_t last)
+{
+	uint32_t *ptr, i, n;
+	int r, bn;
+
+	// Create the indirect block, if needed, before the data blocks.
+	if (first < last && (r = file_block_walk(f, last - 1, &ptr, 1)) < 0)
+		return r;
+
+	for (i = first; i < last; ) {
+		for (n = 0; i + n < last; n++) {
+			if ((r = file_block_walk(f, i + n, &ptr, 1)) < 0)
+				return r;
+			if (*ptr)
+				break;
+		}
+		if (n == 0) {
+			i++;
+			continue;
+		}
+		if ((bn = alloc_blocks(file_block_goal(f, i), &n)) < 0)
+			return bn;
+		for (; n > 0; n--, i++, bn++) {
+			file_block_walk(f, i, &ptr, 1);
+			*ptr = bn;
+		}
+	}
+	return 0;
+}
+
+// Count the runs of consecutive disk blocks that hold 'f'.
+int
+file_extents(struct File *f)
+{
+	uint32_t *ptr, i, prev = 0;
+	int n = 0;
+
+	for (i = 0; i < (f->f_size + BLKSIZE - 1) / BLKSIZE; i++) {
+		if (file_block_walk(f, i, &ptr, 0) < 0 || !*ptr)
+			continue;
+		if (*ptr != prev + 1)
+			n++;
+		prev = *ptr;
+	}
+	return n;
+}
+
 // Set *blk to the address in memory where the filebno'th
 // block of file 'f' would be mapped.
 //
@@ -268,9 +368,10 @@ file_get_block(struct File *f, uint32_t filebno, char **blk)
 	}
 
 	int bn;
+	uint32_t n = 1;
 
 	if (*pdiskbno == 0) {
-		if ((bn = alloc_block()) < 0) {
+		if ((bn = alloc_blocks(file_block_goal(f, filebno), &n)) < 0) {
 			return bn;
 		}
 
@@ -282,18 +383,202 @@ file_get_block(struct File *f, uint32_t filebno, char **blk)
 return 0;
 }
 
-// Try to find a file named "name" in dir.  If so, set *file to it.
-//
-// Returns 0 and sets *file on success, < 0 on error.  Errors are:
-//	-E_NOT_FOUND if the file is not found
+// --------------------------------------------------------------
+// Directory hash index
+// --------------------------------------------------------------
+
+// Directories are arrays of struct File and are searched linearly
+// while small.  Once a directory reaches DIRINDEX_MIN blocks,
+// dir_alloc_file gives it an open-addressing hash table kept in the
+// DIRINDEX_NBLOCKS blocks listed in f_dirindex (outside the file's
+// data, so readers of the directory file see no change).  A slot holds
+// the high half of the name's hash and the entry number + 1, or 0 when
+// empty; collisions probe the following slots.  Directories written by
+// fsformat or grown before this existed have f_dirindex[0] == 0 and
+// keep the linear format until they grow.  Files are never removed
+// from a directory, so there are no deleted slots to skip; truncating a
+// directory drops its index, and so does growing it beyond
+// DIRINDEX_MAXFILES entries, where probing would get long.
+
+#define DIRINDEX_MIN		4
+#define DIRINDEX_SLOTSPERBLK	(BLKSIZE / 4)
+#define DIRINDEX_NSLOTS		(DIRINDEX_NBLOCKS * DIRINDEX_SLOTSPERBLK)
+#define DIRINDEX_MAXFILES	(DIRINDEX_NSLOTS * 3 / 4)
+
+// FNV-1a.
+static uint32_t
+dir_hash(const char *name)
+{
+	uint32_t h = 2166136261u;
+
+	while (*name)
+		h = (h ^ (uint8_t) *name++) * 16777619;
+	return h;
+}
+
+static uint32_t *
+dir_index_slot(struct File *dir, uint32_t slot)
+{
+	uint32_t *blk = diskaddr(dir->f_dirindex[slot / DIRINDEX_SLOTSPERBLK]);
+
+	return &blk[slot % DIRINDEX_SLOTSPERBLK];
+}
+
+// Point the index of 'dir' at entry number 'e', named 'name'.
+static void
+dir_index_add(struct File *dir, const char *name, uint32_t e)
+{
+	uint32_t h = dir_hash(name), slot = h % DIRINDEX_NSLOTS;
+	uint32_t *p;
+
+	while (*(p = dir_index_slot(dir, slot)))
+		slot = (slot + 1) % DIRINDEX_NSLOTS;
+	*p = (h & 0xFFFF0000) | (e + 1);
+}
+
+// Release the index of 'dir', which goes back to linear search.
+static void
+dir_index_free(struct File *dir)
+{
+	for (int i = 0; i < DIRINDEX_NBLOCKS; i++)
+		if (dir->f_dirindex[i]) {
+			free_block(dir->f_dirindex[i]);
+			dir->f_dirindex[i] = 0;
+		}
+}
+
+// Give 'dir' an index of all its entries.  If the disk is too full,
+// 'dir' simply stays linear.
+static void
+dir_index_build(struct File *dir)
+{
+	uint32_t nblock, i, j;
+	struct File *f;
+	char *blk;
+	int bn;
+
+	for (i = 0; i < DIRINDEX_NBLOCKS; i++) {
+		if ((bn = alloc_block()) < 0) {
+			dir_index_free(dir);
+			return;
+		}
+		memset(diskaddr(bn), 0, BLKSIZE);
+		dir->f_dirindex[i] = bn;
+	}
+
+	nblock = dir->f_size / BLKSIZE;
+	for (i = 0; i < nblock; i++) {
+		if (file_get_block(dir, i, &blk) < 0) {
+			dir_index_free(dir);
+			return;
+		}
+		f = (struct File*) blk;
+		for (j = 0; j < BLKFILES; j++)
+			if (f[j].f_name[0] != '\0')
+				dir_index_add(dir, f[j].f_name, i * BLKFILES + j);
+	}
+}
+
 static int
-dir_lookup(struct File *dir, const char *name, struct File **file)
+dir_index_lookup(struct File *dir, const char *name, struct File **file)
+{
+	uint32_t h = dir_hash(name), slot = h % DIRINDEX_NSLOTS, v, e;
+	char *blk;
+	int r;
+
+	while ((v = *dir_index_slot(dir, slot))) {
+		if ((v & 0xFFFF0000) == (h & 0xFFFF0000)) {
+			e = (v & 0xFFFF) - 1;
+			if ((r = file_get_block(dir, e / BLKFILES, &blk)) < 0)
+				return r;
+			*file = (struct File*) blk + e % BLKFILES;
+			if (strcmp((*file)->f_name, name) == 0)
+				return 0;
+		}
+		slot = (slot + 1) % DIRINDEX_NSLOTS;
+	}
+	return -E_NOT_FOUND;
+}
+
+// --------------------------------------------------------------
+// Name cache
+// --------------------------------------------------------------
+
+// Recent results of dir_lookup, keyed by directory and name, so that
+// hot paths resolve without touching directory blocks.  An entry with
+// no file records that the name does not exist.  File structures stay
+// at the same address in the block cache for as long as their
+// directory block is allocated, so entries only go stale when a name
+// is created (file_create replaces the entry) or directory blocks are
+// freed (file_set_size empties the whole cache).
+
+#define DCACHE_SIZE	256
+
+struct Dentry {
+	struct File *d_dir;		// Directory searched, 0 if unused
+	struct File *d_file;		// What the name refers to, 0 if nothing
+	char d_name[MAXNAMELEN];
+};
+
+static struct Dentry dcache[DCACHE_SIZE];
+static uint32_t dcache_hits, dcache_misses;
+
+static struct Dentry *
+dcache_slot(struct File *dir, const char *name)
+{
+	uint32_t h = dir_hash(name) ^ ((uintptr_t) dir / sizeof(struct File));
+
+	return &dcache[h % DCACHE_SIZE];
+}
+
+// Look "name" up in the cache.  Returns true and sets *file, to 0 for
+// a name known not to exist, if it is there.
+static bool
+dcache_lookup(struct File *dir, const char *name, struct File **file)
+{
+	struct Dentry *d = dcache_slot(dir, name);
+
+	if (d->d_dir != dir || strcmp(d->d_name, name) != 0) {
+		dcache_misses++;
+		return false;
+	}
+	dcache_hits++;
+	*file = d->d_file;
+	return true;
+}
+
+static void
+dcache_enter(struct File *dir, const char *name, struct File *file)
+{
+	struct Dentry *d = dcache_slot(dir, name);
+
+	d->d_dir = dir;
+	d->d_file = file;
+	strcpy(d->d_name, name);
+}
+
+static void
+dcache_flush(void)
+{
+	memset(dcache, 0, sizeof(dcache));
+}
+
+// --------------------------------------------------------------
+// Directories
+// --------------------------------------------------------------
+
+// Try to find a file named "name" in dir, bypassing the name cache.
+static int
+dir_search(struct File *dir, const char *name, struct File **file)
 {
 	int r;
 	uint32_t i, j, nblock;
 	char *blk;
 	struct File *f;
 
+	if (dir->f_dirindex[0])
+		return dir_index_lookup(dir, name, file);
+
 	// Search dir for name.
 	// We maintain the invariant that the size of a directory-file
 	// is always a multiple of the file system's block size.
@@ -312,33 +597,63 @@ dir_lookup(struct File *dir, const char *name, struct File **file)
 	return -E_NOT_FOUND;
 }
 
-// Set *file to point at a free File structure in dir.  The caller is
-// responsible for filling in the File fields.
+// Try to find a file named "name" in dir.  If so, set *file to it.
+//
+// Returns 0 and sets *file on success, < 0 on error.  Errors are:
+//	-E_NOT_FOUND if the file is not found
 static int
-dir_alloc_file(struct File *dir, struct File **file)
+dir_lookup(struct File *dir, const char *name, struct File **file)
 {
 	int r;
-	uint32_t nblock, i, j;
+
+	if (dcache_lookup(dir, name, file))
+		return *file ? 0 : -E_NOT_FOUND;
+
+	if ((r = dir_search(dir, name, file)) == 0)
+		dcache_enter(dir, name, *file);
+	else if (r == -E_NOT_FOUND)
+		dcache_enter(dir, name, 0);
+	return r;
+}
+
+// Set *file to point at a free File structure in dir, named "name"
+// and otherwise zero.  The caller is responsible for filling in the
+// other File fields.
+static int
+dir_alloc_file(struct File *dir, const char *name, struct File **file)
+{
+	int r;
+	uint32_t nblock, e;
 	char *blk;
 	struct File *f;
 
 	assert((dir->f_size % BLKSIZE) == 0);
 	nblock = dir->f_size / BLKSIZE;
-	for (i = 0; i < nblock; i++) {
-		if ((r = file_get_block(dir, i, &blk)) < 0)
+	for (e = dir->f_dirfree; e < nblock * BLKFILES; e++) {
+		if ((r = file_get_block(dir, e / BLKFILES, &blk)) < 0)
 			return r;
-		f = (struct File*) blk;
-		for (j = 0; j < BLKFILES; j++)
-			if (f[j].f_name[0] == '\0') {
-				*file = &f[j];
-				return 0;
-			}
+		f = (struct File*) blk + e % BLKFILES;
+		if (f->f_name[0] == '\0')
+			goto found;
 	}
-	dir->f_size += BLKSIZE;
-	if ((r = file_get_block(dir, i, &blk)) < 0)
+	if ((r = file_get_block(dir, nblock, &blk)) < 0)
 		return r;
+	memset(blk, 0, BLKSIZE);
+	dir->f_size += BLKSIZE;
 	f = (struct File*) blk;
-	*file = &f[0];
+
+found:
+	memset(f, 0, sizeof(*f));
+	strcpy(f->f_name, name);
+	dir->f_dirfree = e + 1;
+	if (dir->f_dirindex[0] && e >= DIRINDEX_MAXFILES)
+		dir_index_free(dir);
+	else if (dir->f_dirindex[0])
+		dir_index_add(dir, name, e);
+	else if (dir->f_size / BLKSIZE >= DIRINDEX_MIN &&
+		 e < DIRINDEX_MAXFILES)
+		dir_index_build(dir);
+	*file = f;
 	return 0;
 }
 
@@ -424,12 +739,11 @@ file_create(const char *path, struct File **pf)
 		return -E_FILE_EXISTS;
 	if (r != -E_NOT_FOUND || dir == 0)
 		return r;
-	if ((r = dir_alloc_file(dir, &f)) < 0)
+	if ((r = dir_alloc_file(dir, name, &f)) < 0)
 		return r;
+	dcache_enter(dir, name, f);
 
-	strcpy(f->f_name, name);
 	*pf = f;
-	file_flush(dir);
 	return 0;
 }
 
@@ -484,6 +798,9 @@ file_write(struct File *f, const void *buf, size_t count, off_t offset)
 	if (offset + count > f->f_size)
 		if ((r = file_set_size(f, offset + count)) < 0)
 			return r;
+	if ((r = file_alloc_range(f, offset / BLKSIZE,
+				  (offset + count + BLKSIZE - 1) / BLKSIZE)) < 0)
+		return r;
 
 	for (pos = offset; pos < offset + count; ) {
 		if ((r = file_get_block(f, pos / BLKSIZE, &blk)) < 0)
@@ -547,30 +864,40 @@ file_set_size(struct File *f, off_t newsize)
 {
 	if (f->f_size > newsize)
 		file_truncate_blocks(f, newsize);
+	if (f->f_type == FTYPE_DIR && newsize < f->f_size) {
+		dir_index_free(f);
+		f->f_dirfree = 0;
+		dcache_flush();
+	}
 	f->f_size = newsize;
-	flush_block(f);
 	return 0;
 }
 
 // Flush the contents and metadata of file f out to disk.
-// Loop over all the blocks in file.
-// Translate the file block number into a disk block number
-// and then check whether that disk block is dirty.  If so, write it out.
+// Only blocks of the file in the dirty set are written, coalesced into
+// runs by bc_writeback_blocks.
 void
 file_flush(struct File *f)
 {
-	int i;
-	uint32_t *pdiskbno;
-
-	for (i = 0; i < (f->f_size + BLKSIZE - 1) / BLKSIZE; i++) {
-		if (file_block_walk(f, i, &pdiskbno, 0) < 0 ||
-		    pdiskbno == NULL || *pdiskbno == 0)
-			continue;
-		flush_block(diskaddr(*pdiskbno));
+	static uint32_t blocks[NDIRECT + NINDIRECT + 2];
+	uint32_t i, n = 0, nblocks = (f->f_size + BLKSIZE - 1) / BLKSIZE;
+	uint32_t *indirect;
+
+	// Test the dirty bits straight off the block pointers rather than
+	// walking each file block.
+	for (i = 0; i < MIN(nblocks, NDIRECT); i++)
+		if (f->f_direct[i] && bc_is_dirty(f->f_direct[i]))
+			blocks[n++] = f->f_direct[i];
+	if (f->f_indirect) {
+		indirect = diskaddr(f->f_indirect);
+		for (i = NDIRECT; i < nblocks; i++)
+			if (indirect[i - NDIRECT] &&
+			    bc_is_dirty(indirect[i - NDIRECT]))
+				blocks[n++] = indirect[i - NDIRECT];
+		blocks[n++] = f->f_indirect;
 	}
-	flush_block(f);
-	if (f->f_indirect)
-		flush_block(diskaddr(f->f_indirect));
+	blocks[n++] = ((uint32_t) f - DISKMAP) / BLKSIZE;
+	bc_writeback_blocks(blocks, n);
 }
 
 
@@ -578,8 +905,15 @@ file_flush(struct File *f)
 void
 fs_sync(void)
 {
-	int i;
-	for (i = 1; i < super->s_nblocks; i++)
-		flush_block(diskaddr(i));
+	bc_sync();
 }
 
+// Add the statistics of the block allocator and the name cache.
+void
+fs_stat(struct BcStat *stat)
+{
+	stat->bc_alloc_blocks = alloc_blocks_total;
+	stat->bc_alloc_scanned = alloc_scanned;
+	stat->bc_dc_hits = dcache_hits;
+	stat->bc_dc_misses = dcache_misses;
+}
@@ -4,12 +4,36 @@
 #define SECTSIZE	512			// bytes per disk sector
 #define BLKSECTS	(BLKSIZE / SECTSIZE)	// sectors per block
 
-/* Disk block n, when in memory, is mapped into the file system
- * server's address space at DISKMAP + (n*BLKSIZE). */
-#define DISKMAP		0x10000000
+// Default number of blocks the block cache may hold (see bc.c).
+#define BC_BUDGET	1024
 
-/* Maximum disk size we can handle (3GB) */
-#define DISKSIZE	0xC0000000
+// Longest run of blocks read by one fault: one IDE command reads at
+// most 256 sectors.
+#define BC_RA_MAX	(256 / BLKSECTS)
+
+// Dirty blocks are written back at least this often, in milliseconds.
+#define BC_WB_INTERVAL	500
+
+// A PCI function and the registers of its configuration space used.
+struct PciFunc {
+	uint8_t pf_bus, pf_dev, pf_func;
+	uint32_t pf_id;			// Device id << 16 | vendor id
+	uint32_t pf_class;		// Class, subclass, prog IF, revision
+};
+
+#define PCI_ID_REG		0x00
+#define PCI_COMMAND_REG		0x04
+#define PCI_CLASS_REG		0x08
+#define PCI_BHLC_REG		0x0C
+#define PCI_BAR0_REG		0x10
+#define PCI_BAR4_REG		0x20
+#define PCI_INTR_REG		0x3C
+
+#define PCI_COMMAND_IO		0x0001
+#define PCI_COMMAND_MASTER	0x0004
+
+#define PCI_CLASS_STORAGE	0x01
+#define PCI_SUBCLASS_IDE	0x01
 
 struct Super *super;		// superblock
 uint32_t *bitmap;		// bitmap blocks mapped in memory
@@ -20,12 +44,47 @@ void	ide_set_disk(int diskno);
 void	ide_set_partition(uint32_t first_sect, uint32_t nsect);
 int	ide_read(uint32_t secno, void *dst, size_t nsecs);
 int	ide_write(uint32_t secno, const void *src, size_t nsecs);
+int	ide_submit(uint32_t secno, void *buf, size_t nsecs, bool write);
+int	ide_run(void);
+int	ide_flush(void);
+void	ide_dma_init(void);
+int	ide_set_dma(bool dma);
+bool	ide_dma_enabled(void);
+
+/* virtio.c */
+bool	virtio_init(void);
+int	virtio_submit(uint32_t secno, void *buf, size_t nsecs, bool write);
+int	virtio_run(void);
+int	virtio_flush(void);
+
+/* disk.c */
+void	disk_init(void);
+bool	disk_is_virtio(void);
+int	disk_read(uint32_t secno, void *dst, size_t nsecs);
+int	disk_write(uint32_t secno, const void *src, size_t nsecs);
+int	disk_submit(uint32_t secno, void *buf, size_t nsecs, bool write);
+int	disk_run(void);
+int	disk_flush(void);
+
+/* pci.c */
+uint32_t pci_conf_read(struct PciFunc *f, uint32_t off);
+void	pci_conf_write(struct PciFunc *f, uint32_t off, uint32_t v);
+bool	pci_find_class(uint8_t class, uint8_t subclass, struct PciFunc *f);
+bool	pci_find_device(uint16_t vendor, uint16_t device, struct PciFunc *f);
 
 /* bc.c */
 void*	diskaddr(uint32_t blockno);
 bool	va_is_mapped(void *va);
 bool	va_is_dirty(void *va);
+bool	bc_is_dirty(uint32_t blockno);
 void	flush_block(void *addr);
+void	bc_writeback(void);
+void	bc_writeback_blocks(uint32_t *blocks, uint32_t nblocks);
+void	bc_writeback_poll(void);
+void	bc_sync(void);
+int	bc_set_budget(uint32_t budget);
+int	bc_set_readahead(uint32_t max);
+void	bc_stat(struct BcStat *stat);
 void	bc_init(void);
 
 /* fs.c */
@@ -38,11 +97,14 @@ int	file_write(struct File *f, const void *buf, size_t count, off_t offset);
 int	file_set_size(struct File *f, off_t newsize);
 void	file_flush(struct File *f);
 int	file_remove(const char *path);
+int	file_extents(struct File *f);
+void	fs_stat(struct BcStat *stat);
 void	fs_sync(void);
 
 /* int	map_block(uint32_t); */
 bool	block_is_free(uint32_t blockno);
 int	alloc_block(void);
+int	alloc_blocks(uint32_t goal, uint32_t *n);
 
 /* test.c */
 void	fs_test(void);
@@ -161,6 +161,7 @@ diradd(struct Dir *d, uint32_t type, const char *name)
 	struct File *out = &d->ents[d->n++];
 	if (d->n > MAX_DIR_ENTS)
 		panic("too many directory entries");
+	memset(out, 0, sizeof(*out));
 	strcpy(out->f_name, name);
 	out->f_type = type;
 	return out;
@@ -228,7 +229,7 @@ main(int argc, char **argv)
 		usage();
 
 	nblocks = strtol(argv[2], &s, 0);
-	if (*s || s == argv[2] || nblocks < 2 || nblocks > 1024)
+	if (*s || s == argv[2] || nblocks < 2 || nblocks > BLKBITSIZE)
 		usage();
 
 	opendisk(argv[1]);
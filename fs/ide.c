@@ -1,7 +1,19 @@
 /*
- * Minimal PIO-based (non-interrupt-driven) IDE driver code.
+ * Interrupt-driven IDE driver code, with bus-master DMA or PIO.
  * For information about what all this IDE/ATA magic means,
  * see the materials available on the class references page.
+ *
+ * Requests are queued with ide_submit and served by ide_run in C-LOOK
+ * order: ascending sectors from the current head position, then back
+ * to the lowest queued sector.  Requests that continue each other on
+ * disk and in memory are merged into one command.  While the disk
+ * works, the file server sleeps in sys_irq_wait until IRQ_IDE, so
+ * other environments get the CPU.
+ *
+ * With a bus-master controller (PIIX and the like, found on PCI) the
+ * disk moves the data itself, following a table of physical regions
+ * (PRD) built from the pages of the request.  The block cache passes
+ * its own pages, so blocks go straight between disk and cache.
  */
 
 #include "fs.h"
@@ -12,8 +24,48 @@
 #define IDE_DF		0x20
 #define IDE_ERR		0x01
 
+// Most requests the queue holds, and most sectors of one command.
+#define IDE_NREQ	64
+#define IDE_MAXSECS	256
+
+// Bus-master registers of the primary channel, from BAR4.
+#define BM_CMD		0
+#define BM_CMD_START	0x01
+#define BM_CMD_READ	0x08	// Device to memory
+#define BM_STATUS	2
+#define BM_STATUS_ERR	0x02
+#define BM_STATUS_INTR	0x04
+#define BM_PRDT		4
+
+// A physical region descriptor: 'prd_len' bytes at 'prd_addr', not
+// crossing a 64KB boundary (a length of 0 would mean 64KB).
+struct IdePrd {
+	uint32_t prd_addr;
+	uint16_t prd_len;
+	uint16_t prd_flags;
+};
+
+#define PRD_EOT		0x8000	// Last entry of the table
+
+struct IdeReq {
+	uint32_t ir_secno;
+	uint32_t ir_nsecs;
+	void *ir_buf;
+	bool ir_write;
+};
+
 static int diskno = 1;
 
+static struct IdeReq ide_queue[IDE_NREQ];	// Sorted by ir_secno
+static int ide_nqueued;
+static uint32_t ide_head;		// Sector just after the last command
+
+static bool ide_dma;			// Transfer by DMA rather than PIO
+static uint16_t ide_bmbase;		// Bus-master I/O ports, 0 if none
+static physaddr_t ide_prd_pa;
+static struct IdePrd ide_prd[PGSIZE / sizeof(struct IdePrd)]
+	__attribute__((aligned(PGSIZE)));
+
 static int
 ide_wait_ready(bool check_error)
 {
@@ -27,6 +79,23 @@ ide_wait_ready(bool check_error)
 	return 0;
 }
 
+// Sleep until the disk is done with the current sector or command.
+// Reading the status register acknowledges the interrupt; one that
+// was raised before we got to sleep makes sys_irq_wait return at once.
+static int
+ide_wait_intr(void)
+{
+	int r;
+
+	while ((r = inb(0x1F7)) & IDE_BSY)
+		if (sys_irq_wait(IRQ_IDE) < 0)
+			sys_yield();
+
+	if ((r & (IDE_DF|IDE_ERR)) != 0)
+		return -1;
+	return 0;
+}
+
 bool
 ide_probe_disk1(void)
 {
@@ -59,54 +128,267 @@ ide_set_disk(int d)
 	diskno = d;
 }
 
+//
+// Find a bus-master IDE controller, enable its DMA and set up the PRD
+// table.  Without one, transfers stay PIO.
+//
+void
+ide_dma_init(void)
+{
+	struct PciFunc f;
+	uint32_t cmd;
+	int r;
+
+	// Prog IF bit 7: the controller can be a bus master.
+	if (!pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &f) ||
+	    !(f.pf_class & 0x8000)) {
+		cprintf("ide: no bus-master controller, using PIO\n");
+		return;
+	}
+
+	// The kernel keeps pages mapped PTE_SHARE resident, the disk
+	// reads the table by physical address at any time.  Touch it
+	// first, it is in .bss.
+	ide_prd[0].prd_addr = 0;
+	if ((r = sys_page_map(0, ide_prd, 0, ide_prd,
+			      PTE_P | PTE_U | PTE_W | PTE_SHARE)) < 0 ||
+	    (r = sys_page_paddr(ide_prd, &ide_prd_pa)) < 0)
+		panic("ide_dma_init: %i", r);
+	// The controller takes 32-bit physical addresses.
+	if ((uint64_t) ide_prd_pa >> 32) {
+		cprintf("ide: PRD table above 4G, using PIO\n");
+		return;
+	}
+
+	cmd = pci_conf_read(&f, PCI_COMMAND_REG) & 0xFFFF;
+	pci_conf_write(&f, PCI_COMMAND_REG,
+		       cmd | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+	ide_bmbase = pci_conf_read(&f, PCI_BAR4_REG) & 0xFFFC;
+	ide_dma = true;
+	cprintf("ide: %04x:%04x at %02x:%02x.%d, bus-master DMA at port 0x%x\n",
+		f.pf_id & 0xFFFF, f.pf_id >> 16, f.pf_bus, f.pf_dev,
+		f.pf_func, ide_bmbase);
+}
 
+//
+// Switch transfers to DMA or to PIO.  Returns 0 on success, -E_INVAL
+// if there is no bus-master controller to DMA with.
+//
 int
-ide_read(uint32_t secno, void *dst, size_t nsecs)
+ide_set_dma(bool dma)
 {
-	int r;
+	if (dma && !ide_bmbase)
+		return -E_INVAL;
+	ide_dma = dma;
+	return 0;
+}
 
-	assert(nsecs <= 256);
+bool
+ide_dma_enabled(void)
+{
+	return ide_dma;
+}
 
+static void
+ide_command(uint32_t secno, size_t nsecs, uint8_t cmd)
+{
 	ide_wait_ready(0);
 
+	outb(0x3F6, 0);		// nIEN clear: interrupt on completion
 	outb(0x1F2, nsecs);
 	outb(0x1F3, secno & 0xFF);
 	outb(0x1F4, (secno >> 8) & 0xFF);
 	outb(0x1F5, (secno >> 16) & 0xFF);
 	outb(0x1F6, 0xE0 | ((diskno&1)<<4) | ((secno>>24)&0x0F));
-	outb(0x1F7, 0x20);	// CMD 0x20 means read sector
+	outb(0x1F7, cmd);
+}
+
+// Transfer 'nsecs' sectors from 'secno' on with one PIO command.  The
+// disk interrupts once per sector: a read after the sector is ready,
+// a write after the sector was taken.
+static int
+ide_pio_xfer(uint32_t secno, void *buf, size_t nsecs, bool write)
+{
+	int r;
+
+	ide_command(secno, nsecs, write ? 0x30 : 0x20);	// write, read
+
+	for (; nsecs > 0; nsecs--, buf += SECTSIZE) {
+		if (write) {
+			if ((r = ide_wait_ready(1)) < 0)
+				return r;
+			outsl(0x1F0, buf, SECTSIZE/4);
+		}
+		if ((r = ide_wait_intr()) < 0)
+			return r;
+		if (!write)
+			insl(0x1F0, buf, SECTSIZE/4);
+	}
+
+	return 0;
+}
+
+// Transfer 'nsecs' sectors from 'secno' on to or from the page-aligned
+// 'buf' with one DMA command.  The disk interrupts once, at the end.
+static int
+ide_dma_xfer(uint32_t secno, void *buf, size_t nsecs, bool write)
+{
+	uint32_t len = nsecs * SECTSIZE, sz;
+	uint8_t dir = write ? 0 : BM_CMD_READ;
+	physaddr_t pa;
+	int n = 0, r, st;
 
-	for (; nsecs > 0; nsecs--, dst += SECTSIZE) {
-		if ((r = ide_wait_ready(1)) < 0)
+	// One entry per physically contiguous piece of 'buf'.
+	for (uint32_t off = 0; off < len; off += sz) {
+		sz = MIN(PGSIZE, len - off);
+		if ((r = sys_page_paddr(buf + off, &pa)) < 0)
 			return r;
-		insl(0x1F0, dst, SECTSIZE/4);
+		// Bus-master DMA only reaches the first 4GB.
+		if ((uint64_t) pa >> 32)
+			return ide_pio_xfer(secno, buf, nsecs, write);
+		if (n && ide_prd[n - 1].prd_addr + ide_prd[n - 1].prd_len == pa &&
+		    ide_prd[n - 1].prd_len + sz < 0x10000 && (pa & 0xFFFF))
+			ide_prd[n - 1].prd_len += sz;
+		else
+			ide_prd[n++] = (struct IdePrd) { pa, sz, 0 };
 	}
+	ide_prd[n - 1].prd_flags = PRD_EOT;
+
+	outb(ide_bmbase + BM_CMD, 0);
+	outl(ide_bmbase + BM_PRDT, ide_prd_pa);
+	outb(ide_bmbase + BM_CMD, dir);
+	// Writing 1 clears the interrupt and error bits.
+	outb(ide_bmbase + BM_STATUS,
+	     inb(ide_bmbase + BM_STATUS) | BM_STATUS_ERR | BM_STATUS_INTR);
 
+	ide_command(secno, nsecs, write ? 0xCA : 0xC8);	// write, read DMA
+	outb(ide_bmbase + BM_CMD, dir | BM_CMD_START);
+
+	// The disk may not be busy yet when we first look, so wait for
+	// the controller's interrupt bit rather than for BSY to clear.
+	while (!((st = inb(ide_bmbase + BM_STATUS)) &
+		 (BM_STATUS_INTR | BM_STATUS_ERR)))
+		if (sys_irq_wait(IRQ_IDE) < 0)
+			sys_yield();
+	r = inb(0x1F7);		// Acknowledges the disk's interrupt
+
+	outb(ide_bmbase + BM_CMD, 0);
+	outb(ide_bmbase + BM_STATUS, st | BM_STATUS_ERR | BM_STATUS_INTR);
+	if ((st & BM_STATUS_ERR) || (r & (IDE_DF|IDE_ERR)))
+		return -1;
 	return 0;
 }
 
+static int
+ide_xfer(uint32_t secno, void *buf, size_t nsecs, bool write)
+{
+	assert(nsecs <= IDE_MAXSECS);
+
+	if (ide_dma && (uintptr_t) buf % PGSIZE == 0)
+		return ide_dma_xfer(secno, buf, nsecs, write);
+	return ide_pio_xfer(secno, buf, nsecs, write);
+}
+
+//
+// Queue a transfer of 'nsecs' sectors from 'secno' on to or from 'buf'
+// for the next ide_run.  'buf' must stay mapped until then.  A full
+// queue is run first.
+//
+// Returns 0 on success, < 0 on a disk error running a full queue.
+//
 int
-ide_write(uint32_t secno, const void *src, size_t nsecs)
+ide_submit(uint32_t secno, void *buf, size_t nsecs, bool write)
 {
-	int r;
+	int i, r;
 
-	assert(nsecs <= 256);
+	assert(nsecs > 0 && nsecs <= IDE_MAXSECS);
+	if (ide_nqueued == IDE_NREQ && (r = ide_run()) < 0)
+		return r;
 
-	ide_wait_ready(0);
+	for (i = ide_nqueued; i > 0 && ide_queue[i - 1].ir_secno > secno; i--)
+		ide_queue[i] = ide_queue[i - 1];
+	ide_queue[i] = (struct IdeReq) { secno, nsecs, buf, write };
+	ide_nqueued++;
+	return 0;
+}
 
-	outb(0x1F2, nsecs);
-	outb(0x1F3, secno & 0xFF);
-	outb(0x1F4, (secno >> 8) & 0xFF);
-	outb(0x1F5, (secno >> 16) & 0xFF);
-	outb(0x1F6, 0xE0 | ((diskno&1)<<4) | ((secno>>24)&0x0F));
-	outb(0x1F7, 0x30);	// CMD 0x30 means write sector
+//
+// Serve every queued request.
+//
+// Returns 0 on success, < 0 on the first disk error; the requests
+// still queued then are dropped.
+//
+int
+ide_run(void)
+{
+	struct IdeReq cmd;
+	int i, n, r;
 
-	for (; nsecs > 0; nsecs--, src += SECTSIZE) {
-		if ((r = ide_wait_ready(1)) < 0)
+	while (ide_nqueued > 0) {
+		// C-LOOK: the first request at or after the head, or the
+		// lowest one if the head is past them all.
+		for (i = 0; i < ide_nqueued; i++)
+			if (ide_queue[i].ir_secno >= ide_head)
+				break;
+		if (i == ide_nqueued)
+			i = 0;
+
+		cmd = ide_queue[i];
+		for (n = 1; i + n < ide_nqueued; n++) {
+			struct IdeReq *next = &ide_queue[i + n];
+
+			if (next->ir_write != cmd.ir_write ||
+			    next->ir_secno != cmd.ir_secno + cmd.ir_nsecs ||
+			    next->ir_buf != cmd.ir_buf + cmd.ir_nsecs * SECTSIZE ||
+			    cmd.ir_nsecs + next->ir_nsecs > IDE_MAXSECS)
+				break;
+			cmd.ir_nsecs += next->ir_nsecs;
+		}
+		memmove(&ide_queue[i], &ide_queue[i + n],
+			(ide_nqueued - i - n) * sizeof(ide_queue[0]));
+		ide_nqueued -= n;
+
+		ide_head = cmd.ir_secno + cmd.ir_nsecs;
+		if ((r = ide_xfer(cmd.ir_secno, cmd.ir_buf, cmd.ir_nsecs,
+				  cmd.ir_write)) < 0) {
+			ide_nqueued = 0;
 			return r;
-		outsl(0x1F0, src, SECTSIZE/4);
+		}
 	}
 
 	return 0;
 }
 
+int
+ide_read(uint32_t secno, void *dst, size_t nsecs)
+{
+	int r;
+
+	if ((r = ide_submit(secno, dst, nsecs, false)) < 0)
+		return r;
+	return ide_run();
+}
+
+int
+ide_write(uint32_t secno, const void *src, size_t nsecs)
+{
+	int r;
+
+	if ((r = ide_submit(secno, (void *) src, nsecs, true)) < 0)
+		return r;
+	return ide_run();
+}
+
+// Wait until the disk has written the blocks of all completed
+// ide_writes to its media (ATA FLUSH CACHE).
+int
+ide_flush(void)
+{
+	ide_wait_ready(0);
+
+	outb(0x3F6, 0);
+	outb(0x1F6, 0xE0 | ((diskno&1)<<4));
+	outb(0x1F7, 0xE7);	// CMD 0xE7 means flush cache
+
+	return ide_wait_intr();
+}
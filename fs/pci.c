@@ -0,0 +1,77 @@
+// PCI configuration space access through configuration mechanism #1,
+// enough for the file server to find its disk controller.
+
+#include "fs.h"
+#include <inc/x86.h>
+
+#define PCI_CONF_ADDR	0xCF8
+#define PCI_CONF_DATA	0xCFC
+
+static void
+pci_conf_select(struct PciFunc *f, uint32_t off)
+{
+	outl(PCI_CONF_ADDR, 0x80000000 | (f->pf_bus << 16) |
+	     (f->pf_dev << 11) | (f->pf_func << 8) | (off & 0xFC));
+}
+
+uint32_t
+pci_conf_read(struct PciFunc *f, uint32_t off)
+{
+	pci_conf_select(f, off);
+	return inl(PCI_CONF_DATA);
+}
+
+void
+pci_conf_write(struct PciFunc *f, uint32_t off, uint32_t v)
+{
+	pci_conf_select(f, off);
+	outl(PCI_CONF_DATA, v);
+}
+
+// Find the first function on bus 0 whose configuration register 'reg'
+// masked with 'mask' is 'value'.  Devices behind bridges are not
+// looked for.
+static bool
+pci_find(uint32_t reg, uint32_t mask, uint32_t value, struct PciFunc *f)
+{
+	f->pf_bus = 0;
+	for (f->pf_dev = 0; f->pf_dev < 32; f->pf_dev++)
+		for (f->pf_func = 0; f->pf_func < 8; f->pf_func++) {
+			f->pf_id = pci_conf_read(f, PCI_ID_REG);
+			if ((f->pf_id & 0xFFFF) == 0xFFFF) {
+				if (f->pf_func == 0)
+					break;
+				continue;
+			}
+			f->pf_class = pci_conf_read(f, PCI_CLASS_REG);
+			if ((pci_conf_read(f, reg) & mask) == value)
+				return true;
+			// Only multi-function devices have functions 1-7.
+			if (f->pf_func == 0 &&
+			    !(pci_conf_read(f, PCI_BHLC_REG) & 0x800000))
+				break;
+		}
+	return false;
+}
+
+//
+// Find the first function of class 'class' and subclass 'subclass'
+// and fill in 'f'.  Returns true if there is one.
+//
+bool
+pci_find_class(uint8_t class, uint8_t subclass, struct PciFunc *f)
+{
+	return pci_find(PCI_CLASS_REG, 0xFFFF0000,
+			((uint32_t) class << 24) | (subclass << 16), f);
+}
+
+//
+// Find the first function with vendor id 'vendor' and device id
+// 'device' and fill in 'f'.  Returns true if there is one.
+//
+bool
+pci_find_device(uint16_t vendor, uint16_t device, struct PciFunc *f)
+{
+	return pci_find(PCI_ID_REG, 0xFFFFFFFF,
+			((uint32_t) device << 16) | vendor, f);
+}
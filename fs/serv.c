@@ -133,6 +133,8 @@ serve_open(envid_t envid, struct Fsreq_open *req,
 				cprintf("file_create failed: %i", r);
 			return r;
 		}
+		if (req->req_omode & O_MKDIR)
+			f->f_type = FTYPE_DIR;
 	} else {
 try_open:
 		if ((r = file_open(path, &f)) < 0) {
@@ -275,10 +277,13 @@ serve_stat(envid_t envid, union Fsipc *ipc)
 	strcpy(ret->ret_name, o->o_file->f_name);
 	ret->ret_size = o->o_file->f_size;
 	ret->ret_isdir = (o->o_file->f_type == FTYPE_DIR);
+	ret->ret_extents = file_extents(o->o_file);
 	return 0;
 }
 
-// Flush all data and metadata of req->req_fileid to disk.
+// Called when a file is closed.  Its dirty blocks are left to the
+// periodic write-back rather than written one by one here; FSREQ_SYNC
+// is what makes them durable.
 int
 serve_flush(envid_t envid, struct Fsreq_flush *req)
 {
@@ -290,11 +295,10 @@ serve_flush(envid_t envid, struct Fsreq_flush *req)
 
 	if ((r = openfile_lookup(envid, req->req_fileid, &o)) < 0)
 		return r;
-	file_flush(o->o_file);
 	return 0;
 }
 
-
+// Write all dirty blocks back and make them durable before replying.
 int
 serve_sync(envid_t envid, union Fsipc *req)
 {
@@ -302,6 +306,35 @@ serve_sync(envid_t envid, union Fsipc *req)
 	return 0;
 }
 
+// Change the block cache budget to req->req_budget and the read-ahead
+// limit to req->req_ra_max, each unless it is 0, then return the cache
+// statistics in ipc->bcstatRet.
+int
+serve_bcstat(envid_t envid, union Fsipc *ipc)
+{
+	int r;
+
+	if (debug)
+		cprintf("serve_bcstat %08x %08x\n", envid, ipc->bcstat.req_budget);
+
+	if (ipc->bcstat.req_budget &&
+	    (r = bc_set_budget(ipc->bcstat.req_budget)) < 0)
+		return r;
+	if (ipc->bcstat.req_ra_max &&
+	    (r = bc_set_readahead(ipc->bcstat.req_ra_max)) < 0)
+		return r;
+	if (ipc->bcstat.req_dma >= 0) {
+		// A virtio-blk disk always transfers by DMA.
+		if (disk_is_virtio())
+			return -E_INVAL;
+		if ((r = ide_set_dma(ipc->bcstat.req_dma)) < 0)
+			return r;
+	}
+	bc_stat(&ipc->bcstatRet.ret_stat);
+	fs_stat(&ipc->bcstatRet.ret_stat);
+	return 0;
+}
+
 typedef int (*fshandler)(envid_t envid, union Fsipc *req);
 
 fshandler handlers[] = {
@@ -312,7 +345,8 @@ fshandler handlers[] = {
 	[FSREQ_FLUSH] =		(fshandler)serve_flush,
 	[FSREQ_WRITE] =		(fshandler)serve_write,
 	[FSREQ_SET_SIZE] =	(fshandler)serve_set_size,
-	[FSREQ_SYNC] =		serve_sync
+	[FSREQ_SYNC] =		serve_sync,
+	[FSREQ_BCSTAT] =	serve_bcstat
 };
 #define NHANDLERS (sizeof(handlers)/sizeof(handlers[0]))
 
@@ -326,9 +360,14 @@ serve(void)
 	while (1) {
 		perm = 0;
 		req = ipc_recv((int32_t *) &whom, fsreq, &perm);
+		bc_writeback_poll();
+		// The write-back timer woke us up while idle.
+		if ((int32_t) req == -E_INTR)
+			continue;
 		if (debug)
-			cprintf("fs req %d from %08x [page %08x: %s]\n",
-				req, whom, uvpt[PGNUM(fsreq)], (char *) fsreq);
+			cprintf("fs req %d from %08x [page %08llx: %s]\n",
+				req, whom, (uint64_t) uvpt[PGNUM(fsreq)],
+				(char *) fsreq);
 
 		// All requests must contain an argument page
 		if (!(perm & PTE_P)) {
@@ -12,6 +12,8 @@ fs_test(void)
 	int r;
 	char *blk;
 	uint32_t *bits;
+	struct BcStat st;
+	uint32_t budget;
 
 	// back up bitmap
 	if ((r = sys_page_alloc(0, (void*) PGSIZE, PTE_P|PTE_U|PTE_W)) < 0)
@@ -47,15 +49,15 @@ fs_test(void)
 	assert(!(uvpt[PGNUM(blk)] & PTE_D));
 	cprintf("file_flush is good\n");
 
+	// Resizing leaves the File dirty for the write-back.
 	if ((r = file_set_size(f, 0)) < 0)
 		panic("file_set_size: %i", r);
 	assert(f->f_direct[0] == 0);
-	assert(!(uvpt[PGNUM(f)] & PTE_D));
+	assert(uvpt[PGNUM(f)] & PTE_D);
 	cprintf("file_truncate is good\n");
 
 	if ((r = file_set_size(f, strlen(msg))) < 0)
 		panic("file_set_size 2: %i", r);
-	assert(!(uvpt[PGNUM(f)] & PTE_D));
 	if ((r = file_get_block(f, 0, &blk)) < 0)
 		panic("file_get_block 2: %i", r);
 	strcpy(blk, msg);
@@ -64,4 +66,22 @@ fs_test(void)
 	assert(!(uvpt[PGNUM(blk)] & PTE_D));
 	assert(!(uvpt[PGNUM(f)] & PTE_D));
 	cprintf("file rewrite is good\n");
+
+	// Touch every allocated block with a small budget, then check
+	// that evicted blocks come back intact.
+	bc_stat(&st);
+	budget = st.bc_budget;
+	if ((r = bc_set_budget(32)) < 0)
+		panic("bc_set_budget: %i", r);
+	for (r = 2; r < super->s_nblocks; r++)
+		if (!block_is_free(r))
+			(void) *(volatile char *) diskaddr(r);
+	bc_stat(&st);
+	assert(st.bc_resident <= 32 && st.bc_evictions > 0);
+	if ((r = file_get_block(f, 0, &blk)) < 0)
+		panic("file_get_block 3: %i", r);
+	assert(strcmp(blk, msg) == 0);
+	if ((r = bc_set_budget(budget)) < 0)
+		panic("bc_set_budget 2: %i", r);
+	cprintf("block cache eviction is good\n");
 }
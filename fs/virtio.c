@@ -0,0 +1,335 @@
+/*
+ * Legacy virtio-blk driver (virtio 0.9.5 over PCI I/O ports).
+ *
+ * Requests go to the device through one virtqueue.  Each is a chain of
+ * descriptors: a header with the request type and sector, the data
+ * (one descriptor per physically contiguous piece of the caller's
+ * buffer, so block cache pages are read and written in place) and a
+ * status byte the device writes.  virtio_submit only adds the chain to
+ * the available ring, so many requests can be in flight at once;
+ * virtio_run notifies the device and sleeps in sys_irq_wait until they
+ * all show up in the used ring.
+ *
+ * The rings must be physically contiguous, so they and the request
+ * headers live in the kernel's DMA region (sys_dma_map).
+ */
+
+#include "fs.h"
+#include <inc/x86.h>
+
+#define VIRTIO_VENDOR		0x1AF4
+#define VIRTIO_BLK_DEVICE	0x1001	// Transitional (legacy) block device
+
+// Legacy I/O registers, from BAR0.
+#define VIRTIO_HOST_FEATURES	0x00
+#define VIRTIO_GUEST_FEATURES	0x04
+#define VIRTIO_QUEUE_PFN	0x08
+#define VIRTIO_QUEUE_NUM	0x0C
+#define VIRTIO_QUEUE_SEL	0x0E
+#define VIRTIO_QUEUE_NOTIFY	0x10
+#define VIRTIO_STATUS		0x12
+#define VIRTIO_ISR		0x13
+#define VIRTIO_BLK_CAPACITY	0x14	// 64 bits, in sectors
+
+#define VIRTIO_STATUS_ACK	0x01
+#define VIRTIO_STATUS_DRIVER	0x02
+#define VIRTIO_STATUS_DRIVER_OK	0x04
+#define VIRTIO_STATUS_FAILED	0x80
+
+#define VIRTIO_BLK_F_FLUSH	(1 << 9)
+
+#define VIRTIO_BLK_T_IN		0
+#define VIRTIO_BLK_T_OUT	1
+#define VIRTIO_BLK_T_FLUSH	4
+
+struct VirtqDesc {
+	uint64_t vd_addr;
+	uint32_t vd_len;
+	uint16_t vd_flags;
+	uint16_t vd_next;
+};
+
+#define VIRTQ_DESC_F_NEXT	1
+#define VIRTQ_DESC_F_WRITE	2	// Device writes the buffer
+
+struct VirtqAvail {
+	uint16_t va_flags;
+	uint16_t va_idx;
+	uint16_t va_ring[];
+};
+
+struct VirtqUsed {
+	uint16_t vu_flags;
+	uint16_t vu_idx;
+	struct {
+		uint32_t id;
+		uint32_t len;
+	} vu_ring[];
+};
+
+struct VirtioBlkHdr {
+	uint32_t vh_type;
+	uint32_t vh_reserved;
+	uint64_t vh_sector;
+};
+
+// Most requests in flight, and most descriptors the queue may have.
+#define VIRTIO_NREQ		32
+#define VIRTIO_MAXQ		1024
+
+// Where the DMA region is mapped, below the block cache.
+#define VIRTIO_DMAVA		((char *) (DISKMAP - 0x100000))
+
+static uint16_t virtio_iobase;
+static int virtio_irq;
+static bool virtio_flush_ok;
+
+static uint16_t vq_size;
+static struct VirtqDesc *vq_desc;
+static volatile struct VirtqAvail *vq_avail;
+static volatile struct VirtqUsed *vq_used;
+static uint16_t vq_free;		// Free descriptors, chained by vd_next
+static uint16_t vq_nfree;
+static uint16_t vq_used_seen;		// vu_idx up to which we looked
+static uint16_t vq_kicked;		// va_idx the device was told about
+
+// Request slots: header and status byte in the DMA region.
+static struct VirtioBlkHdr *vr_hdr;
+static volatile uint8_t *vr_status;
+static uint32_t vr_busy;		// Bit set = slot in flight
+static uint8_t vr_slot[VIRTIO_MAXQ];	// Slot of a chain, by its head
+static int vr_error;
+static physaddr_t dma_pa;
+
+static physaddr_t
+dma_paddr(const volatile void *va)
+{
+	return dma_pa + ((const char *) va - VIRTIO_DMAVA);
+}
+
+//
+// Find a virtio-blk device and set up its queue.  Returns false if
+// there is none, or it cannot be used.
+//
+bool
+virtio_init(void)
+{
+	struct PciFunc f;
+	uint32_t cmd, used_off, size;
+	uint64_t nsecs;
+	int npages;
+
+	if (!pci_find_device(VIRTIO_VENDOR, VIRTIO_BLK_DEVICE, &f))
+		return false;
+
+	cmd = pci_conf_read(&f, PCI_COMMAND_REG) & 0xFFFF;
+	pci_conf_write(&f, PCI_COMMAND_REG,
+		       cmd | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+	virtio_iobase = pci_conf_read(&f, PCI_BAR0_REG) & 0xFFFC;
+	virtio_irq = pci_conf_read(&f, PCI_INTR_REG) & 0xFF;
+
+	outb(virtio_iobase + VIRTIO_STATUS, 0);		// Reset
+	outb(virtio_iobase + VIRTIO_STATUS, VIRTIO_STATUS_ACK);
+	outb(virtio_iobase + VIRTIO_STATUS,
+	     VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+	virtio_flush_ok = inl(virtio_iobase + VIRTIO_HOST_FEATURES) &
+		VIRTIO_BLK_F_FLUSH;
+	outl(virtio_iobase + VIRTIO_GUEST_FEATURES,
+	     virtio_flush_ok ? VIRTIO_BLK_F_FLUSH : 0);
+
+	// Legacy layout: descriptors, the available ring, then the used
+	// ring on the next page.
+	outw(virtio_iobase + VIRTIO_QUEUE_SEL, 0);
+	vq_size = inw(virtio_iobase + VIRTIO_QUEUE_NUM);
+	used_off = ROUNDUP(vq_size * sizeof(struct VirtqDesc) +
+			   sizeof(struct VirtqAvail) + (vq_size + 1) * 2, PGSIZE);
+	size = used_off + ROUNDUP(sizeof(struct VirtqUsed) +
+				  vq_size * 8 + 2, PGSIZE);
+	if ((npages = sys_dma_map(VIRTIO_DMAVA, &dma_pa)) < 0 ||
+	    vq_size == 0 || vq_size > VIRTIO_MAXQ ||
+	    size + PGSIZE > npages * PGSIZE) {
+		cprintf("virtio-blk: cannot set up queue of %d\n", vq_size);
+		outb(virtio_iobase + VIRTIO_STATUS, VIRTIO_STATUS_FAILED);
+		return false;
+	}
+	memset(VIRTIO_DMAVA, 0, size + PGSIZE);
+
+	vq_desc = (struct VirtqDesc *) VIRTIO_DMAVA;
+	vq_avail = (struct VirtqAvail *) (vq_desc + vq_size);
+	vq_used = (struct VirtqUsed *) (VIRTIO_DMAVA + used_off);
+	for (int i = 0; i < vq_size; i++)
+		vq_desc[i].vd_next = i + 1;
+	vq_free = 0;
+	vq_nfree = vq_size;
+	vr_hdr = (struct VirtioBlkHdr *) (VIRTIO_DMAVA + size);
+	vr_status = (uint8_t *) (vr_hdr + VIRTIO_NREQ);
+
+	outl(virtio_iobase + VIRTIO_QUEUE_PFN, dma_pa / PGSIZE);
+	outb(virtio_iobase + VIRTIO_STATUS, VIRTIO_STATUS_ACK |
+	     VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+
+	nsecs = inl(virtio_iobase + VIRTIO_BLK_CAPACITY) |
+		(uint64_t) inl(virtio_iobase + VIRTIO_BLK_CAPACITY + 4) << 32;
+	cprintf("virtio-blk: %u sectors at %02x:%02x.%d, port 0x%x, irq %d, queue %d\n",
+		(uint32_t) nsecs, f.pf_bus, f.pf_dev, f.pf_func,
+		virtio_iobase, virtio_irq, vq_size);
+	return true;
+}
+
+static uint16_t
+vq_alloc_desc(void)
+{
+	uint16_t d = vq_free;
+
+	vq_free = vq_desc[d].vd_next;
+	vq_nfree--;
+	return d;
+}
+
+// Tell the device about the chains added since the last time.
+static void
+virtio_kick(void)
+{
+	if (vq_kicked != vq_avail->va_idx) {
+		vq_kicked = vq_avail->va_idx;
+		outw(virtio_iobase + VIRTIO_QUEUE_NOTIFY, 0);
+	}
+}
+
+// Retire the requests the device has completed.  Returns how many.
+static int
+virtio_reap(void)
+{
+	int n = 0;
+
+	for (; vq_used_seen != vq_used->vu_idx; vq_used_seen++, n++) {
+		uint16_t d = vq_used->vu_ring[vq_used_seen % vq_size].id;
+		int slot = vr_slot[d];
+
+		if (vr_status[slot] != 0)
+			vr_error = -1;
+		vr_busy &= ~(1 << slot);
+		// Give the chain back to the free list.
+		for (;;) {
+			uint16_t next = vq_desc[d].vd_next;
+			bool more = vq_desc[d].vd_flags & VIRTQ_DESC_F_NEXT;
+
+			vq_desc[d].vd_next = vq_free;
+			vq_free = d;
+			vq_nfree++;
+			if (!more)
+				break;
+			d = next;
+		}
+	}
+	return n;
+}
+
+// Sleep until the device completes at least one request.
+static void
+virtio_wait(void)
+{
+	virtio_kick();
+	while (!virtio_reap()) {
+		if (sys_irq_wait(virtio_irq) < 0)
+			sys_yield();
+		// Reading the ISR acknowledges the interrupt and lowers the
+		// level-triggered line before the kernel unmasks it again.
+		inb(virtio_iobase + VIRTIO_ISR);
+	}
+}
+
+static int
+virtio_queue(uint32_t type, uint32_t secno, void *buf, size_t nsecs)
+{
+	uint32_t len = nsecs * SECTSIZE, sz;
+	uint16_t head, d;
+	physaddr_t pa;
+	int slot, r;
+
+	// Room for the header, one descriptor per page and the status.
+	while (vr_busy == (uint32_t) ((1ULL << VIRTIO_NREQ) - 1) ||
+	       vq_nfree < len / PGSIZE + 3)
+		virtio_wait();
+	slot = __builtin_ctz(~vr_busy);
+	vr_busy |= 1 << slot;
+
+	vr_hdr[slot] = (struct VirtioBlkHdr) { type, 0, secno };
+	vr_status[slot] = 0xFF;
+	head = d = vq_alloc_desc();
+	vq_desc[d] = (struct VirtqDesc) { dma_paddr(&vr_hdr[slot]),
+					  sizeof(vr_hdr[slot]),
+					  VIRTQ_DESC_F_NEXT, 0 };
+
+	for (uint32_t off = 0; off < len; off += sz) {
+		sz = MIN(PGSIZE - ((uintptr_t) (buf + off) % PGSIZE), len - off);
+		if ((r = sys_page_paddr(ROUNDDOWN(buf + off, PGSIZE), &pa)) < 0)
+			panic("virtio_queue: %i", r);
+		pa += (uintptr_t) (buf + off) % PGSIZE;
+		// Extend the previous piece if this one continues it.
+		if (d != head && vq_desc[d].vd_addr + vq_desc[d].vd_len == pa) {
+			vq_desc[d].vd_len += sz;
+			continue;
+		}
+		vq_desc[d].vd_next = vq_alloc_desc();
+		d = vq_desc[d].vd_next;
+		vq_desc[d].vd_addr = pa;
+		vq_desc[d].vd_len = sz;
+		vq_desc[d].vd_flags = VIRTQ_DESC_F_NEXT |
+			(type == VIRTIO_BLK_T_IN ? VIRTQ_DESC_F_WRITE : 0);
+	}
+
+	vq_desc[d].vd_next = vq_alloc_desc();
+	d = vq_desc[d].vd_next;
+	vq_desc[d].vd_addr = dma_paddr(&vr_status[slot]);
+	vq_desc[d].vd_len = 1;
+	vq_desc[d].vd_flags = VIRTQ_DESC_F_WRITE;
+
+	vr_slot[head] = slot;
+	vq_avail->va_ring[vq_avail->va_idx % vq_size] = head;
+	// The device must see the chain before the new index.
+	__sync_synchronize();
+	vq_avail->va_idx++;
+	return 0;
+}
+
+//
+// Queue a transfer of 'nsecs' sectors from 'secno' on to or from 'buf'.
+// The device may start on it at any time; 'buf' must stay mapped until
+// virtio_run returns.
+//
+int
+virtio_submit(uint32_t secno, void *buf, size_t nsecs, bool write)
+{
+	return virtio_queue(write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN,
+			    secno, buf, nsecs);
+}
+
+//
+// Wait for every queued request.  Returns 0 on success, < 0 if one of
+// them failed.
+//
+int
+virtio_run(void)
+{
+	int r;
+
+	while (vr_busy)
+		virtio_wait();
+	r = vr_error;
+	vr_error = 0;
+	return r;
+}
+
+// Have the device write its cache to the media.
+int
+virtio_flush(void)
+{
+	int r;
+
+	if (!virtio_flush_ok)
+		return virtio_run();
+	if ((r = virtio_queue(VIRTIO_BLK_T_FLUSH, 0, NULL, 0)) < 0)
+		return r;
+	return virtio_run();
+}
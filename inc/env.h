@@ -47,6 +47,50 @@ enum EnvType {
 	ENV_TYPE_FS,		// File system server
 };
 
+// Maximum number of lazily-backed regions per environment
+// (see sys_vm_reserve).
+#define NVMRESERVE		8
+
+// Maximum number of interval timers per environment (see
+// sys_timer_create).  Timer ids are bit numbers in env_timer_pending.
+#define NITIMER			8
+
+// A range [vr_start, vr_end) of an environment's address space whose pages
+// are allocated and zeroed by the kernel on first touch.
+struct VmReserve {
+	uintptr_t vr_start;
+	uintptr_t vr_end;
+	int vr_perm;			// PTE_* bits used for faulted-in pages
+};
+
+// Kinds of page faults counted in EnvMemStat
+enum {
+	FAULT_ZERO = 0,		// Demand-zero page filled in by the kernel
+	FAULT_SWAP,		// Page read back from swap
+	FAULT_UPCALL,		// Passed to the user page fault upcall
+	FAULT_COW,		// Copy-on-write page copied by the kernel
+	NFAULTTYPES
+};
+
+// Memory used by an environment, maintained incrementally by the kernel.
+// Page counts are numbers of mappings below UTOP.
+struct EnvMemStat {
+	uint32_t ms_rss;		// Resident pages mapped
+	uint32_t ms_shared;		// ... of which also mapped elsewhere
+	uint32_t ms_cow;		// ... of which mapped PTE_COW
+	uint32_t ms_swapped;		// Pages swapped out
+	uint32_t ms_pgtables;		// Page directory and page tables
+	uint32_t ms_faults[NFAULTTYPES];	// Page faults by kind
+};
+
+// Same-page merging statistics, see sys_page_merge_stat.
+struct MergeStat {
+	uint32_t mg_scanned;		// Pages hashed by the scanner
+	uint32_t mg_merged;		// Pages replaced by an identical one
+	uint32_t mg_saved;		// Pages currently saved by merging
+	uint64_t mg_cycles;		// TSC cycles spent scanning
+};
+
 struct Env {
 	struct Trapframe env_tf;	// Saved registers
 	struct Env *env_link;		// Next free Env
@@ -59,6 +103,8 @@ struct Env {
 
 	// Exception handling
 	void *env_pgfault_upcall;	// Page fault upcall entry point
+	void *env_timer_upcall;		// Interval timer upcall entry point
+	uint32_t env_timer_pending;	// Timers expired since the last upcall
 
 	// Lab 9 IPC
 	bool env_ipc_recving;		// Env is blocked receiving
@@ -72,6 +118,17 @@ struct Env {
 	long long env_time_start; // moment environment start running again
 	long long env_sleep_until; // monemnt of time to wake up
 	int env_sleep_clock_type; //clock type for env_sleep_until field
+	int env_irq_wait;		// 1 + IRQ blocked on in sys_irq_wait, or 0
+
+	// Demand-zero regions, empty slots have vr_start == vr_end
+	struct VmReserve env_vm_reserve[NVMRESERVE];
+
+	// Memory accounting, readable by everyone through 'envs'
+	struct EnvMemStat env_memstat;
+
+	// Identical pages may be merged into copy-on-write pages shared
+	// with other mergeable environments (sys_env_set_mergeable).
+	bool env_mergeable;
 };
 
 #endif // !JOS_INC_ENV_H
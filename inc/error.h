@@ -26,6 +26,8 @@ enum {
 	E_NOT_EXEC	= 14,	// File not a valid executable
 	E_NOT_SUPP	= 15,	// Operation not supported
 
+	E_INTR		= 16,	// Blocking call interrupted by a timer
+
 	MAXERROR
 };
 
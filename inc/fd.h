@@ -41,6 +41,7 @@ struct Stat {
 	char st_name[MAXNAMELEN];
 	off_t st_size;
 	int st_isdir;
+	int st_extents;		// Runs of consecutive disk blocks
 	struct Dev *st_dev;
 };
 
@@ -12,6 +12,14 @@
 #define BLKSIZE		PGSIZE
 #define BLKBITSIZE	(BLKSIZE * 8)
 
+// Disk block n, when in memory, is mapped into the file system
+// server's address space at DISKMAP + (n*BLKSIZE).  The kernel uses
+// this to recognize block cache pages it may drop under memory pressure.
+#define DISKMAP		0x10000000
+
+// Maximum disk size we can handle (3GB)
+#define DISKSIZE	0xC0000000
+
 // Maximum size of a filename (a single path component), including null
 // Must be a multiple of 4
 #define MAXNAMELEN	128
@@ -26,6 +34,9 @@
 
 #define MAXFILESIZE	((NDIRECT + NINDIRECT) * BLKSIZE)
 
+// Number of blocks of a directory's hash index (see fs/fs.c)
+#define DIRINDEX_NBLOCKS	16
+
 struct File {
 	char f_name[MAXNAMELEN];	// filename
 	off_t f_size;			// file size in bytes
@@ -36,9 +47,14 @@ struct File {
 	uint32_t f_direct[NDIRECT];	// direct blocks
 	uint32_t f_indirect;		// indirect block
 
+	// Directories only, zero in entries written by fsformat.
+	uint32_t f_dirindex[DIRINDEX_NBLOCKS];	// hash index blocks
+	uint32_t f_dirfree;		// no free entry below this one
+
 	// Pad out to 256 bytes; must do arithmetic in case we're compiling
 	// fsformat on a 64-bit machine.
-	uint8_t f_pad[256 - MAXNAMELEN - 8 - 4*NDIRECT - 4];
+	uint8_t f_pad[256 - MAXNAMELEN - 8 - 4*NDIRECT - 4 -
+		      4*DIRINDEX_NBLOCKS - 4];
 } __attribute__((packed));	// required only on some 64-bit machines
 
 // An inode block contains exactly BLKFILES 'struct File's
@@ -70,7 +86,30 @@ enum {
 	FSREQ_STAT,
 	FSREQ_FLUSH,
 	FSREQ_REMOVE,
-	FSREQ_SYNC
+	FSREQ_SYNC,
+	// Bcstat returns a Fsret_bcstat on the request page
+	FSREQ_BCSTAT
+};
+
+// Block cache statistics of the file server, see FSREQ_BCSTAT.
+struct BcStat {
+	uint32_t bc_budget;		// Most blocks the cache may hold
+	uint32_t bc_resident;		// Blocks it holds now
+	uint32_t bc_dirty;		// ... of which dirty
+	uint32_t bc_hits;		// Lookups that found the block resident
+	uint32_t bc_misses;		// Blocks read in from disk
+	uint32_t bc_evictions;		// Blocks unmapped to stay within budget
+	uint32_t bc_writebacks;		// Dirty blocks written back by eviction
+	uint32_t bc_ra_max;		// Longest run read by one fault
+	uint32_t bc_readahead;		// Blocks read ahead of a fault
+	uint32_t bc_wb_runs;		// Disk writes issued by write-back
+	uint32_t bc_wb_blocks;		// Blocks they wrote
+	uint32_t bc_dc_hits;		// Path components found in the name cache
+	uint32_t bc_dc_misses;		// ... and looked up in their directory
+	uint32_t bc_alloc_blocks;	// Blocks allocated
+	uint32_t bc_alloc_scanned;	// Bitmap words examined to find them
+	bool bc_dma;			// The disk transfers by DMA, not PIO
+	bool bc_virtio;			// The disk is virtio-blk, not IDE
 };
 
 union Fsipc {
@@ -101,6 +140,7 @@ union Fsipc {
 		char ret_name[MAXNAMELEN];
 		off_t ret_size;
 		int ret_isdir;
+		int ret_extents;
 	} statRet;
 	struct Fsreq_flush {
 		int req_fileid;
@@ -108,6 +148,14 @@ union Fsipc {
 	struct Fsreq_remove {
 		char req_path[MAXPATHLEN];
 	} remove;
+	struct Fsreq_bcstat {
+		uint32_t req_budget;	// New budget, 0 to keep it
+		uint32_t req_ra_max;	// New read-ahead limit, 0 to keep it
+		int req_dma;		// 1 for DMA, 0 for PIO, -1 to keep
+	} bcstat;
+	struct Fsret_bcstat {
+		struct BcStat ret_stat;
+	} bcstatRet;
 
 	// Ensure Fsipc is one page
 	char _pad[PGSIZE];
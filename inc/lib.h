@@ -22,6 +22,7 @@
 #include <inc/fd.h>
 #include <inc/args.h>
 #include <inc/time.h>
+#include <inc/prof.h>
 
 #define USED(x)		(void)(x)
 
@@ -54,16 +55,28 @@ static envid_t sys_exofork(void);
 int	sys_env_set_status(envid_t env, int status);
 int	sys_env_set_trapframe(envid_t env, struct Trapframe *tf);
 int	sys_env_set_pgfault_upcall(envid_t env, void *upcall);
+int	sys_env_set_timer_upcall(envid_t env, void *upcall);
 int	sys_page_alloc(envid_t env, void *pg, int perm);
 int	sys_page_map(envid_t src_env, void *src_pg,
 		     envid_t dst_env, void *dst_pg, int perm);
 int	sys_page_unmap(envid_t env, void *pg);
+int	sys_vm_reserve(void *va, size_t len, int perm);
+int	sys_env_memstat(envid_t env, struct EnvMemStat *ms);
+int	sys_env_set_mergeable(envid_t env, bool mergeable);
+int	sys_page_merge_stat(struct MergeStat *stat);
+int	sys_prof_start(unsigned hz);
+int	sys_prof_read(struct ProfSample *samples, size_t n);
+int	sys_prof_symbol(envid_t env, uintptr_t pc, struct ProfSymbol *sym);
+int	sys_irq_wait(int irq);
+int	sys_page_paddr(void *va, physaddr_t *pa);
+int	sys_dma_map(void *va, physaddr_t *pa);
 int	sys_ipc_try_send(envid_t to_env, uint32_t value, void *pg, int perm);
 int	sys_ipc_recv(void *rcv_pg);
 int sys_gettime(void);
 
 int vsys_gettime(void);
 struct timespec* vsys_clock_getres(clockid_t);
+int vsys_clock_gettime(clockid_t clock_id, struct timespec *tp);
 
 int sys_clock_gettime(clockid_t clock_id, struct timespec* tp);
 int sys_clock_getres(clockid_t clock_id, struct timespec* res);
@@ -77,6 +90,12 @@ int sys_clock_nanosleep(
 	struct timespec* rmtp
 );
 
+int sys_timer_create(clockid_t clock_id);
+int sys_timer_settime(timer_t id, int flags, const struct itimerspec *value,
+		      struct itimerspec *ovalue);
+int sys_timer_delete(timer_t id);
+int sys_timer_getoverrun(timer_t id);
+
 // This must be inlined.  Exercise for reader: why?
 static __inline envid_t __attribute__((always_inline))
 sys_exofork(void)
@@ -96,7 +115,6 @@ int32_t ipc_recv(envid_t *from_env_store, void *pg, int *perm_store);
 envid_t	ipc_find_env(enum EnvType type);
 
 // fork.c
-#define	PTE_SHARE	0x400
 envid_t	fork(void);
 envid_t	sfork(void);	// Challenge!
 
@@ -116,6 +134,8 @@ int	open(const char *path, int mode);
 int	ftruncate(int fd, off_t size);
 int	remove(const char *path);
 int	sync(void);
+int	bcstat(uint32_t budget, uint32_t ra_max, struct BcStat *stat);
+int	bcdma(bool dma);
 
 // pageref.c
 int	pageref(void *addr);
@@ -147,6 +167,7 @@ int timestamp(const struct tm *time);
 void mktime(int time, struct tm *tm);
 void print_datetime(struct tm *tm);
 void snprint_datetime(char *buf, int size, struct tm *tm);
+long long now(void);
 
 
 /* File open modes */
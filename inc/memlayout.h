@@ -42,8 +42,9 @@
  *                     |      Invalid Memory (*)      | --/--  KSTKGAP    |
  *                     +------------------------------+                   |
  *                     :              .               :                   |
- *                     :              .               :                   |
- *    MMIOLIM ------>  +------------------------------+ 0xefc00000      --+
+ *                     |~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~|                   |
+ *                     |   Temporary High Mappings    | RW/--  NKMAP*PGSIZE
+ *    MMIOLIM, KMAPBASE +-----------------------------+ 0xefc00000      --+
  *                     |       Memory-mapped I/O      | RW/--  PTSIZE
  * ULIM, MMIOBASE -->  +------------------------------+ 0xef800000
  *                     |  Cur. Page Table (User R-)   | R-/R-  PTSIZE
@@ -81,6 +82,11 @@
  *     mapped.  "Empty Memory" is normally unmapped, but user programs may
  *     map pages there if desired.  JOS user programs map pages temporarily
  *     at UTEMP.
+ *
+ * With CONFIG_PAE, PTSIZE is 2MB and the regions sized PTSIZE above
+ * shrink accordingly, except that the page tables take UVPTSIZE and the
+ * page structures UPAGESSIZE.  The regions below UTEXT keep the
+ * addresses shown, since user/user.ld links programs at them.
  */
 
 
@@ -102,6 +108,11 @@
 #define MMIOLIM		(KSTACKTOP - PTSIZE)
 #define MMIOBASE	(MMIOLIM - PTSIZE)
 
+// Temporary mappings of physical pages outside the KERNBASE direct map
+// (see kmap), at the bottom of the kernel stack area.
+#define KMAPBASE	MMIOLIM
+#define NKMAP		16
+
 #define ULIM		(MMIOBASE)
 
 /*
@@ -109,10 +120,23 @@
  * They are global pages mapped in at env allocation time.
  */
 
+#ifdef CONFIG_PAE
+// The page tables of all four pages of the page directory
+#define UVPTSIZE	(4*PTSIZE)
+// Room for the Page structures of 12GB of physical addresses
+#define UPAGESSIZE	(32*PTSIZE)
+// Size of the temporary mapping region below UTEXT
+#define UTEMPSIZE	(2*PTSIZE)
+#else
+#define UVPTSIZE	PTSIZE
+#define UPAGESSIZE	PTSIZE
+#define UTEMPSIZE	PTSIZE
+#endif
+
 // User read-only virtual page table (see 'uvpt' below)
-#define UVPT		(ULIM - PTSIZE)
+#define UVPT		(ULIM - UVPTSIZE)
 // Read-only copies of the Page structures
-#define UPAGES		(UVPT - PTSIZE)
+#define UPAGES		(UVPT - UPAGESSIZE)
 // Read-only copies of the global env structures
 #define UENVS		(UPAGES - PTSIZE)
 
@@ -131,26 +155,34 @@
 #define USTACKTOP	(UTOP - 2*PGSIZE)
 
 // Where user programs generally begin
-#define UTEXT		(2*PTSIZE)
+#define UTEXT		(2*UTEMPSIZE)
 
 // Used for temporary page mappings.  Typed 'void*' for convenience
-#define UTEMP		((void*) PTSIZE)
+#define UTEMP		((void*) UTEMPSIZE)
 // Used for temporary page mappings for the user page-fault handler
 // (should not conflict with other temporary page mappings)
-#define PFTEMP		(UTEMP + PTSIZE - PGSIZE)
+#define PFTEMP		(UTEMP + UTEMPSIZE - PGSIZE)
 // The location of the user-level STABS data structure
-#define USTABDATA	(PTSIZE / 2)
+#define USTABDATA	(UTEMPSIZE / 2)
 
 #ifndef __ASSEMBLER__
 
+#ifdef CONFIG_PAE
+typedef uint64_t pte_t;
+typedef uint64_t pde_t;
+typedef uint64_t pdpte_t;
+#else
 typedef uint32_t pte_t;
 typedef uint32_t pde_t;
+#endif
 
 #if JOS_USER
 /*
  * The page directory entry corresponding to the virtual address range
  * [UVPT, UVPT + PTSIZE) points to the page directory itself.  Thus, the page
  * directory is treated as a page table as well as a page directory.
+ * (With CONFIG_PAE, the UVPTSIZE / PTSIZE entries from there on point to
+ * the pages of the page directory in turn, which has the same effect.)
  *
  * One result of treating the page directory as a page table is that all PTEs
  * can be accessed through a "virtual page table" at virtual address UVPT (to
@@ -158,8 +190,8 @@ typedef uint32_t pde_t;
  * uvpt[N].  (It's worth drawing a diagram of this!)
  *
  * A second consequence is that the contents of the current page directory
- * will always be available at virtual address (UVPT + (UVPT >> PGSHIFT)), to
- * which uvpd is set in entry.S.
+ * will always be available at virtual address (UVPT + (PDX(UVPT) << PGSHIFT)),
+ * to which uvpd is set in entry.S.
  */
 extern volatile pte_t uvpt[];     // VA of "virtual page table"
 extern volatile pde_t uvpd[];     // VA of current page directory
@@ -185,6 +217,17 @@ struct PageInfo {
 	// boot_alloc do not have valid reference count fields.
 
 	uint16_t pp_ref;
+
+	// Kernel-only: list of the page table entries mapping this page,
+	// maintained by page_insert and page_remove (see kern/pmap.h).
+	struct Rmap *pp_rmap;
+
+	// For a page directory, the environment it belongs to.
+	struct Env *pp_env;
+
+	// Set when the page merger made this page the shared copy of
+	// several identical pages; cleared when the page is reallocated.
+	bool pp_merged;
 };
 
 #endif /* !__ASSEMBLER__ */
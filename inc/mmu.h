@@ -25,15 +25,29 @@
 // The PDX, PTX, PGOFF, and PGNUM macros decompose linear addresses as shown.
 // To construct a linear address la from PDX(la), PTX(la), and PGOFF(la),
 // use PGADDR(PDX(la), PTX(la), PGOFF(la)).
+//
+// With CONFIG_PAE, entries are 64 bits wide and hold 36-bit physical
+// addresses.  A page table then has 512 entries and maps 2MB, and the
+// top two bits of the page directory index select one of the four
+// pages of the page directory through the page directory pointer
+// table that %cr3 points to:
+//
+// +--2--+----9----+-------9--------+---------12----------+
+// | PDPT| Page Dir|   Page Table   | Offset within Page  |
+// +-----+---------+----------------+---------------------+
+//  \--- PDX(la) --/ \--- PTX(la) --/ \---- PGOFF(la) ----/
+//
+// The four pages of a page directory lie one after another, so the
+// kernel indexes them as a single array of NPDENTRIES entries.
 
 // page number field of address
 #define PGNUM(la)	(((uintptr_t) (la)) >> PTXSHIFT)
 
 // page directory index
-#define PDX(la)		((((uintptr_t) (la)) >> PDXSHIFT) & 0x3FF)
+#define PDX(la)		((((uintptr_t) (la)) >> PDXSHIFT) & (NPDENTRIES - 1))
 
 // page table index
-#define PTX(la)		((((uintptr_t) (la)) >> PTXSHIFT) & 0x3FF)
+#define PTX(la)		((((uintptr_t) (la)) >> PTXSHIFT) & (NPTENTRIES - 1))
 
 // offset in page
 #define PGOFF(la)	(((uintptr_t) (la)) & 0xFFF)
@@ -42,17 +56,27 @@
 #define PGADDR(d, t, o)	((void*) ((d) << PDXSHIFT | (t) << PTXSHIFT | (o)))
 
 // Page directory and page table constants.
+#ifdef CONFIG_PAE
+#define NPDPENTRIES	4		// entries per page directory pointer table
+#define NPDENTRIES	2048		// page directory entries, in all four pages
+#define NPTENTRIES	512		// page table entries per page table
+#else
 #define NPDENTRIES	1024		// page directory entries per page directory
 #define NPTENTRIES	1024		// page table entries per page table
+#endif
 
 #define PGSIZE		4096		// bytes mapped by a page
 #define PGSHIFT		12		// log2(PGSIZE)
 
 #define PTSIZE		(PGSIZE*NPTENTRIES) // bytes mapped by a page directory entry
+#ifdef CONFIG_PAE
+#define PTSHIFT		21		// log2(PTSIZE)
+#else
 #define PTSHIFT		22		// log2(PTSIZE)
+#endif
 
 #define PTXSHIFT	12		// offset of PTX in a linear address
-#define PDXSHIFT	22		// offset of PDX in a linear address
+#define PDXSHIFT	PTSHIFT		// offset of PDX in a linear address
 
 // Page table/directory entry flags.
 #define PTE_P		0x001	// Present
@@ -69,6 +93,13 @@
 // hardware, so user processes are allowed to set them arbitrarily.
 #define PTE_AVAIL	0xE00	// Available for software use
 
+// PTE_AVAIL bits given a meaning by the user library.  PTE_SHARE pages
+// are shared rather than copied by fork and spawn, PTE_COW marks
+// copy-on-write entries.  The kernel follows the same conventions when
+// it merges identical pages and when it writes to user memory.
+#define PTE_SHARE	0x400
+#define PTE_COW		0x800
+
 // Flags in PTE_SYSCALL may be used in system calls.  (Others may not.)
 #define PTE_SYSCALL	(PTE_AVAIL | PTE_P | PTE_W | PTE_U)
 
@@ -90,6 +121,7 @@
 
 #define CR4_PCE		0x00000100	// Performance counter enable
 #define CR4_MCE		0x00000040	// Machine Check Enable
+#define CR4_PAE		0x00000020	// Physical Address Extension
 #define CR4_PSE		0x00000010	// Page Size Extensions
 #define CR4_DE		0x00000008	// Debugging Extensions
 #define CR4_TSD		0x00000004	// Time Stamp Disable
@@ -223,7 +255,7 @@ struct Taskstate {
 	uintptr_t ts_esp2;
 	uint16_t ts_ss2;
 	uint16_t ts_padding3;
-	physaddr_t ts_cr3;	// Page directory base
+	uint32_t ts_cr3;	// Page directory base
 	uintptr_t ts_eip;	// Saved state from last task switch
 	uint32_t ts_eflags;
 	uint32_t ts_eax;	// More saved state (registers)
@@ -0,0 +1,26 @@
+#ifndef JOS_INC_PROF_H
+#define JOS_INC_PROF_H
+
+#include <inc/env.h>
+
+// Sampling profiler records, see sys_prof_start and sys_prof_read.
+
+// Longest call chain recorded for one sample.
+#define PROF_DEPTH		8
+
+// Highest sampling rate sys_prof_start accepts.
+#define PROF_MAXHZ		10000
+
+struct ProfSample {
+	envid_t ps_env;			// Interrupted environment, 0 if idle
+	uint32_t ps_depth;		// Valid entries of ps_pc
+	uintptr_t ps_pc[PROF_DEPTH];	// eip, then the return addresses
+};
+
+// A symbolized address, see sys_prof_symbol.
+struct ProfSymbol {
+	char psym_name[32];		// Function name, "<unknown>" if none
+	uintptr_t psym_addr;		// Start of the function
+};
+
+#endif /* !JOS_INC_PROF_H */
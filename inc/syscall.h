@@ -22,6 +22,21 @@ enum {
 	SYS_clock_gettime,
 	SYS_clock_settime,
 	SYS_clock_nanosleep,
+	SYS_vm_reserve,
+	SYS_env_memstat,
+	SYS_env_set_mergeable,
+	SYS_page_merge_stat,
+	SYS_env_set_timer_upcall,
+	SYS_timer_create,
+	SYS_timer_settime,
+	SYS_timer_delete,
+	SYS_timer_getoverrun,
+	SYS_prof_start,
+	SYS_prof_read,
+	SYS_prof_symbol,
+	SYS_irq_wait,
+	SYS_page_paddr,
+	SYS_dma_map,
 	NSYSCALLS
 };
 
@@ -28,6 +28,14 @@ struct timespec
     long long    tv_nsec; //it's just long in doc's but it leads tp overflows
 };
 
+struct itimerspec
+{
+    struct timespec it_interval;  /* Timer period, 0 for one-shot */
+    struct timespec it_value;     /* Time to expiry, 0 disarms */
+};
+
+typedef int timer_t;
+
 
 bool is_leap_year(int year);
 
@@ -49,6 +57,13 @@ int clock_settime(clockid_t clock_id, const struct timespec *tp);
 int clock_nanosleep(clockid_t clock_id, int flags, const struct timespec
 *rqtp, struct timespec *rmtp);
 
+/* There are no signals: a timer calls 'handler' with its id when it expires */
+int timer_create(clockid_t clock_id, void (*handler)(timer_t), timer_t *timerid);
+int timer_settime(timer_t timerid, int flags, const struct itimerspec *value,
+struct itimerspec *ovalue);
+int timer_delete(timer_t timerid);
+int timer_getoverrun(timer_t timerid);
+
 int timespec_from_timestamp(int time, struct timespec* ts);
 int timespecec_from_tm(const struct tm* tm, struct timespec* ts);
 int timestamp_from_timespec(const struct timespec* ts);
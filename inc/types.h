@@ -23,9 +23,14 @@ typedef unsigned long long uint64_t;
 // We use pointer types to represent virtual addresses,
 // uintptr_t to represent the numerical values of virtual addresses,
 // and physaddr_t to represent physical addresses.
+// With CONFIG_PAE, physical addresses are wider than pointers.
 typedef int32_t intptr_t;
 typedef uint32_t uintptr_t;
+#ifdef CONFIG_PAE
+typedef uint64_t physaddr_t;
+#else
 typedef uint32_t physaddr_t;
+#endif
 
 // Page numbers are 32 bits long.
 typedef uint32_t ppn_t;
@@ -3,10 +3,34 @@
 
 #include <inc/time.h>
 
-/* system call numbers */
+/* system call numbers: int offsets into vsys.  The clock resolutions
+ * are struct timespec at vsys + VSYS_CLOCK_*, each taking the ints up
+ * to the next slot. */
 #define VSYS_gettime 0
 #define VSYS_CLOCK_REALTIME (sizeof(struct timespec)/sizeof(int) + sizeof(struct timespec) % sizeof(int))
 #define VSYS_CLOCK_MONOTONIC (VSYS_CLOCK_REALTIME + sizeof(struct timespec)/sizeof(int) + sizeof(struct timespec) % sizeof(int))
-#define NVSYSCALLS (VSYS_CLOCK_MONOTONIC + 1)
+#define VSYS_sysenter (VSYS_CLOCK_MONOTONIC + sizeof(struct timespec)/sizeof(int) + sizeof(struct timespec) % sizeof(int))
+#define VSYS_clock (VSYS_sysenter + 1)
+#define NVSYSCALLS (VSYS_clock + sizeof(struct vsys_clock)/sizeof(int))
+
+/*
+ * Clock data at vsys + VSYS_clock, from which lib/vsyscall.c computes
+ * CLOCK_MONOTONIC and CLOCK_REALTIME without entering the kernel:
+ *
+ *	monotonic = vc_mono_base + ((rdtsc - vc_tsc_base) * vc_mult >> vc_shift)
+ *	realtime  = monotonic + vc_real_offset
+ *
+ * all in nanoseconds.  The kernel makes vc_seq odd while it updates the
+ * other fields; readers retry if they saw it odd or changing.
+ */
+struct vsys_clock {
+	volatile uint32_t vc_seq;
+	uint32_t vc_mult;
+	uint32_t vc_shift;
+	uint32_t vc_pad;
+	uint64_t vc_tsc_base;
+	uint64_t vc_mono_base;
+	int64_t vc_real_offset;
+};
 
 #endif /* !JOS_INC_VSYSCALL_H */
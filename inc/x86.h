@@ -34,6 +34,8 @@ static __inline uint32_t read_ebp(void) __attribute__((always_inline));
 static __inline uint32_t read_esp(void) __attribute__((always_inline));
 static __inline void cpuid(uint32_t info, uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *edxp);
 static __inline uint64_t read_tsc(void) __attribute__((always_inline));
+static __inline uint64_t rdmsr(uint32_t msr) __attribute__((always_inline));
+static __inline void wrmsr(uint32_t msr, uint64_t val) __attribute__((always_inline));
 
 static __inline void
 breakpoint(void)
@@ -280,6 +282,25 @@ read_tsc(void)
 	return tsc;
 }
 
+// Model-specific registers
+#define MSR_SYSENTER_CS		0x174
+#define MSR_SYSENTER_ESP	0x175
+#define MSR_SYSENTER_EIP	0x176
+
+static __inline uint64_t
+rdmsr(uint32_t msr)
+{
+	uint64_t val;
+	__asm __volatile("rdmsr" : "=A" (val) : "c" (msr));
+	return val;
+}
+
+static __inline void
+wrmsr(uint32_t msr, uint64_t val)
+{
+	__asm __volatile("wrmsr" : : "c" (msr), "A" (val));
+}
+
 static inline uint32_t
 xchg(volatile uint32_t *addr, uint32_t newval)
 {
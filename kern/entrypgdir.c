@@ -1,6 +1,35 @@
 #include <inc/mmu.h>
 #include <inc/memlayout.h>
 
+#ifdef CONFIG_PAE
+// With PAE, entry_pgdir makes the same mappings with 2MB pages (a page
+// directory entry with PTE_PS maps 2MB directly): VA's [0, 4MB) and
+// [KERNBASE, KERNBASE+8MB) to PA's [0, 4MB) and [0, 8MB).  cr3 points
+// to entry_pdpt, whose entries point to the four pages of entry_pgdir.
+// They are written as two 32-bit halves, because the linker can only
+// fill in 32-bit addresses.
+__attribute__((__aligned__(PGSIZE)))
+pde_t entry_pgdir[NPDENTRIES] = {
+	[0] = 0x000000 | PTE_PS | PTE_P | PTE_W,
+	[1] = 0x200000 | PTE_PS | PTE_P | PTE_W,
+	[KERNBASE>>PDXSHIFT]
+		= 0x000000 | PTE_PS | PTE_P | PTE_W,
+	[(KERNBASE>>PDXSHIFT) + 1]
+		= 0x200000 | PTE_PS | PTE_P | PTE_W,
+	[(KERNBASE>>PDXSHIFT) + 2]
+		= 0x400000 | PTE_PS | PTE_P | PTE_W,
+	[(KERNBASE>>PDXSHIFT) + 3]
+		= 0x600000 | PTE_PS | PTE_P | PTE_W,
+};
+
+__attribute__((__aligned__(32)))
+uint32_t entry_pdpt[2 * NPDPENTRIES] = {
+	((uintptr_t)entry_pgdir - KERNBASE) + PTE_P, 0,
+	((uintptr_t)entry_pgdir - KERNBASE) + PGSIZE + PTE_P, 0,
+	((uintptr_t)entry_pgdir - KERNBASE) + 2 * PGSIZE + PTE_P, 0,
+	((uintptr_t)entry_pgdir - KERNBASE) + 3 * PGSIZE + PTE_P, 0,
+};
+#else
 pte_t entry_pgtable0[NPTENTRIES];
 pte_t entry_pgtable1[NPTENTRIES];
 
@@ -2088,4 +2117,4 @@ pte_t entry_pgtable1[NPTENTRIES] = {
 	0x7fe000 | PTE_P | PTE_W,
 	0x7ff000 | PTE_P | PTE_W,
 };
-
+#endif
@@ -15,6 +15,8 @@
 #include <kern/cpu.h>
 #include <kern/time.h>
 #include <kern/tsc.h>
+#include <kern/merge.h>
+#include <kern/itimer.h>
 
 #ifdef CONFIG_KSPACE
 struct Env env_array[NENV];
@@ -26,6 +28,7 @@ struct Env *curenv = NULL;		// The current env
 #endif
 static struct Env *env_free_list;	// Free environment list
 					// (linked by Env->env_link)
+static struct Env *env_dying_list;	// Destroyed, not yet freed
 
 #define ENVGENSHIFT	12		// >= LOGNENV
 
@@ -132,7 +135,8 @@ envid2env(envid_t envid, struct Env **env_store, bool checkperm)
 	// (i.e., does not refer to a _previous_ environment
 	// that used the same slot in the envs[] array).
 	e = &envs[ENVX(envid)];
-	if (e->env_status == ENV_FREE || e->env_id != envid) {
+	if (e->env_status == ENV_FREE || e->env_status == ENV_DYING ||
+	    e->env_id != envid) {
 		*env_store = 0;
 		return -E_BAD_ENV;
 	}
@@ -217,10 +221,10 @@ env_init_percpu(void)
 static int
 env_setup_vm(struct Env *e)
 {
-	struct PageInfo *p = NULL;
+	pde_t *pgdir;
 
-	// Allocate a page for the page directory
-	if (!(p = page_alloc(ALLOC_ZERO)))
+	// Allocate the page directory
+	if (!(pgdir = pgdir_alloc(e)))
 		return -E_NO_MEM;
 
 	// Now, set e->env_pgdir and initialize the page directory.
@@ -240,18 +244,23 @@ env_setup_vm(struct Env *e)
 	//    - The functions in kern/pmap.h are handy.
 
 	// LAB 8: Your code here.
-	e->env_pgdir = page2kva(p);
+	e->env_pgdir = pgdir;
 	// uint32_t utop_border = PDX(UTOP);
 	// for (int i = 0; i != utop_border; i++) {
 	// 	e->env_pgdir[i] = 0;
 	// }
-	memcpy(e->env_pgdir+PDX(UTOP),
-		kern_pgdir+PDX(UTOP), PGSIZE - PDX(UTOP) * sizeof (pde_t));
-	p->pp_ref++;
+	memcpy(e->env_pgdir+PDX(UTOP), kern_pgdir+PDX(UTOP),
+		(NPDENTRIES - PDX(UTOP)) * sizeof (pde_t));
+
+	// Start memory accounting, counting the page directory itself.
+	memset(&e->env_memstat, 0, sizeof(e->env_memstat));
+	e->env_memstat.ms_pgtables = 1;
 
 	// UVPT maps the env's own page table read-only.
 	// Permissions: kernel R, user R
-	e->env_pgdir[PDX(UVPT)] = PADDR(e->env_pgdir) | PTE_P | PTE_U;
+	for (int i = 0; i < UVPTSIZE / PTSIZE; i++)
+		e->env_pgdir[PDX(UVPT) + i] =
+			(PADDR(e->env_pgdir) + i * PGSIZE) | PTE_P | PTE_U;
 
 	return 0;
 }
@@ -330,6 +339,8 @@ env_alloc(struct Env **newenv_store, envid_t parent_id)
 
 	// Clear the page fault handler until user installs one.
 	e->env_pgfault_upcall = 0;
+	e->env_timer_upcall = 0;
+	e->env_timer_pending = 0;
 
 	// Also clear the IPC receiving flag.
 	e->env_ipc_recving = 0;
@@ -339,6 +350,11 @@ env_alloc(struct Env **newenv_store, envid_t parent_id)
 	e->env_time_start = nanosec_from_timer();
 	e->env_sleep_until = 0;
 	e->env_sleep_clock_type = 0; // 0 is invalid value, no need toi wait
+	e->env_irq_wait = 0;
+
+	// No demand-zero regions until the env reserves some.
+	memset(e->env_vm_reserve, 0, sizeof(e->env_vm_reserve));
+	e->env_mergeable = false;
 
 
 	// commit the allocation
@@ -395,7 +411,7 @@ region_alloc(struct Env *e, void *va, size_t len)
 			return;
 		}
 		if (debug) {
-			cprintf("allocated page: %p %p\n", (void*) page2pa(pi), (void*) page2kva(pi));
+			cprintf("allocated page: %p %p\n", (void*) (uintptr_t) page2pa(pi), (void*) page2kva(pi));
 		}
 	}
 }
@@ -533,10 +549,10 @@ load_icode(struct Env *e, uint8_t *binary, size_t size)
 	cprintf(
 		"PAGE DIR addr: %p %p\n",
 		(void*) e->env_pgdir,
-		(void*) PADDR(e->env_pgdir)
+		(void*) (uintptr_t) PADDR(e->env_pgdir)
 	);
 
-	lcr3(PADDR(e->env_pgdir));
+	lcr3(pgdir_cr3(e->env_pgdir));
 
 	for (; ph < eph; ph++)
 		if (ph->p_type == ELF_PROG_LOAD) {
@@ -577,7 +593,7 @@ load_icode(struct Env *e, uint8_t *binary, size_t size)
 	// at virtual address USTACKTOP - PGSIZE.
 	// LAB 8: Your code here.
 	region_alloc(e, (void *)(USTACKTOP - PGSIZE), PGSIZE);
-	lcr3(PADDR(kern_pgdir));
+	lcr3(pgdir_cr3(kern_pgdir));
 }
 
 //
@@ -607,6 +623,29 @@ env_create(uint8_t *binary, size_t size, enum EnvType type)
 	}
 }
 
+#ifndef CONFIG_KSPACE
+// Free page table 'pdeno' of 'e' and the pages it maps.
+// Returns the number of pages freed.
+static int
+env_free_pgtable(struct Env *e, uint32_t pdeno)
+{
+	physaddr_t pa = PTE_ADDR(e->env_pgdir[pdeno]);
+	int freed;
+
+	// unmap all PTEs in this page table, releasing the swap slots of
+	// swapped-out pages as well
+	freed = page_remove_range(e->env_pgdir,
+				  (uintptr_t) PGADDR(pdeno, 0, 0),
+				  (uintptr_t) PGADDR(pdeno + 1, 0, 0));
+
+	// free the page table itself
+	e->env_pgdir[pdeno] = 0;
+	page_decref(pa2page(pa));
+	e->env_memstat.ms_pgtables--;
+	return freed + 1;
+}
+#endif
+
 //
 // Frees env e and all memory it uses.
 //
@@ -614,48 +653,27 @@ void
 env_free(struct Env *e)
 {
 #ifndef CONFIG_KSPACE
-	pte_t *pt;
-	uint32_t pdeno, pteno;
-	physaddr_t pa;
+	uint32_t pdeno;
 
 	// If freeing the current environment, switch to kern_pgdir
 	// before freeing the page directory, just in case the page
 	// gets reused.
-	if (e == curenv)
-		lcr3(PADDR(kern_pgdir));
-#endif
+	if (rcr3() == pgdir_cr3(e->env_pgdir))
+		lcr3(pgdir_cr3(kern_pgdir));
 
-	// Note the environment's demise.
-	cprintf("[%08x] free env %08x\n", curenv ? curenv->env_id : 0, e->env_id);
-
-#ifndef CONFIG_KSPACE
 	// Flush all mapped pages in the user portion of the address space
 	static_assert(UTOP % PTSIZE == 0);
 	for (pdeno = 0; pdeno < PDX(UTOP); pdeno++) {
 
 		// only look at mapped page tables
-		if (!(e->env_pgdir[pdeno] & PTE_P))
-			continue;
-
-		// find the pa and va of the page table
-		pa = PTE_ADDR(e->env_pgdir[pdeno]);
-		pt = (pte_t*) KADDR(pa);
-
-		// unmap all PTEs in this page table
-		for (pteno = 0; pteno <= PTX(~0); pteno++) {
-			if (pt[pteno] & PTE_P)
-				page_remove(e->env_pgdir, PGADDR(pdeno, pteno, 0));
-		}
-
-		// free the page table itself
-		e->env_pgdir[pdeno] = 0;
-		page_decref(pa2page(pa));
+		if (e->env_pgdir[pdeno] & PTE_P)
+			env_free_pgtable(e, pdeno);
 	}
 
 	// free the page directory
-	pa = PADDR(e->env_pgdir);
+	pgdir_free(e->env_pgdir);
 	e->env_pgdir = 0;
-	page_decref(pa2page(pa));
+	e->env_memstat.ms_pgtables--;
 #endif
 	// return the environment to the free list
 	e->env_status = ENV_FREE;
@@ -668,33 +686,73 @@ env_free(struct Env *e)
 // If e was the current env, then runs a new environment (and does not return
 // to the caller).
 //
+// The environment is only marked ENV_DYING and taken off the scheduler
+// here.  Its memory and slot are freed later by env_reap, so neither the
+// destroyer nor the next environment to run pay for the teardown.
+//
 void
 env_destroy(struct Env *e)
 {
 	//LAB 3: Your code here.
 
-	// if (e->env_status == ENV_RUNNING && curenv != e) {
-	// 	e->env_status = ENV_DYING;
-	// 	return;
-	// }
+	if (e->env_status == ENV_DYING || e->env_status == ENV_FREE) {
+		if (curenv == e)
+			sched_yield();
+		return;
+	}
 
-	// env_free(e);
+	// Note the environment's demise.
+	cprintf("[%08x] free env %08x\n", curenv ? curenv->env_id : 0, e->env_id);
 
-	// if (curenv == e) {
-	// 	curenv = NULL;
-	// 	sched_yield();
-	// }
+	e->env_status = ENV_DYING;
+	e->env_ipc_recving = 0;
+	e->env_irq_wait = 0;
+	sched_sleep_cancel(e);
+	itimer_free_all(e);
+	env_set_mergeable(e, false);
+	e->env_link = env_dying_list;
+	env_dying_list = e;
 
-	env_free(e);
-	// cprintf("=== %d\n", curenv==e);
 	if (curenv == e)	{
-		// e->env_tf.tf_eip = entry_points[find_env_num(e)];
-		//curenv = NULL;
 		sched_yield();
 	}
-	// cprintf("Destroyed the only environment - nothing more to do!\n");
-	// while (1)
-	// 	monitor(NULL);
+}
+
+//
+// Continue tearing down dying environments, freeing at most 'budget'
+// page tables with everything they map (without limit if budget < 0).
+// An environment whose address space is gone gets its page directory
+// and slot freed as well.  Called from the scheduler and the page
+// reclaimer.
+//
+// Returns the number of pages freed.
+//
+int
+env_reap(int budget)
+{
+	int freed = 0;
+
+	while (env_dying_list && budget != 0) {
+		struct Env *e = env_dying_list;
+#ifndef CONFIG_KSPACE
+		uint32_t pdeno;
+
+		if (rcr3() == pgdir_cr3(e->env_pgdir))
+			lcr3(pgdir_cr3(kern_pgdir));
+		for (pdeno = 0; pdeno < PDX(UTOP) && budget != 0; pdeno++) {
+			if (e->env_pgdir[pdeno] & PTE_P) {
+				freed += env_free_pgtable(e, pdeno);
+				budget--;
+			}
+		}
+		if (pdeno < PDX(UTOP))
+			break;
+		freed++;
+#endif
+		env_dying_list = e->env_link;
+		env_free(e);
+	}
+	return freed;
 }
 
 #ifdef CONFIG_KSPACE
@@ -808,7 +866,9 @@ env_run(struct Env *e)
 	curenv->env_time_start = nanosec_from_timer();
 	normalize_time(&curenv->env_time);
 	
-	lcr3(PADDR(e->env_pgdir));
+	lcr3(pgdir_cr3(e->env_pgdir));
+	if (e->env_timer_pending)
+		itimer_deliver(e);
 	// cprintf("Run env %d\n", ENVX(curenv->env_id));
 	env_pop_tf(&(e->env_tf));
 }
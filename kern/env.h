@@ -20,6 +20,10 @@ int	env_alloc(struct Env **e, envid_t parent_id);
 void	env_free(struct Env *e);
 void	env_create(uint8_t *binary, size_t size, enum EnvType type);
 void	env_destroy(struct Env *e);	// Does not return if e == curenv
+int	env_reap(int budget);
+
+// Page tables of destroyed environments freed per scheduler pass.
+#define REAP_BATCH	4
 
 int	envid2env(envid_t envid, struct Env **env_store, bool checkperm);
 // The following two functions do not return
@@ -0,0 +1,103 @@
+/* See COPYRIGHT for copyright information. */
+
+// High-resolution one-shot timers.  Pending timers are kept on a list
+// sorted by expiry, and the local APIC timer is armed for the earliest
+// one.  Its interrupt, and every pass of the scheduler, run the expired
+// timers.  Without a usable local APIC timer only the scheduler does,
+// which then polls rather than halt while timers are pending.
+
+#include <inc/assert.h>
+
+#include <kern/hrtimer.h>
+#include <kern/lapic.h>
+#include <kern/time.h>
+#include <kern/tsc.h>
+
+static struct hrtimer *hrtimer_queue;
+
+static void
+hrtimer_arm(void)
+{
+	if (hrtimer_queue)
+		lapic_timer_arm(tsc_from_nanosec(hrtimer_queue->ht_expires +
+						 monotonic_time_start));
+	else
+		lapic_timer_arm(0);
+}
+
+// Call t->ht_fn once CLOCK_MONOTONIC reaches 'expires'.
+void
+hrtimer_start(struct hrtimer *t, uint64_t expires)
+{
+	struct hrtimer **tp;
+
+	hrtimer_cancel(t);
+	t->ht_expires = expires;
+	for (tp = &hrtimer_queue; *tp && (*tp)->ht_expires <= expires;
+	     tp = &(*tp)->ht_next)
+		/* do nothing */;
+	t->ht_next = *tp;
+	*tp = t;
+	t->ht_queued = true;
+	if (hrtimer_queue == t)
+		hrtimer_arm();
+}
+
+void
+hrtimer_cancel(struct hrtimer *t)
+{
+	struct hrtimer **tp;
+
+	if (!t->ht_queued)
+		return;
+	for (tp = &hrtimer_queue; *tp != t; tp = &(*tp)->ht_next)
+		assert(*tp);
+	*tp = t->ht_next;
+	t->ht_queued = false;
+}
+
+// Run the expired timers.  Returns whether there were any.
+static bool
+hrtimer_expire(void)
+{
+	uint64_t now;
+	bool expired = false;
+
+	if (!hrtimer_queue)
+		return false;
+	now = clock_monotonic();
+	while (hrtimer_queue && hrtimer_queue->ht_expires <= now) {
+		struct hrtimer *t = hrtimer_queue;
+
+		hrtimer_queue = t->ht_next;
+		t->ht_queued = false;
+		t->ht_fn(t);
+		expired = true;
+	}
+	return expired;
+}
+
+// Run the expired timers, and arm the hardware for the next one if
+// that changed.
+void
+hrtimer_run(void)
+{
+	if (hrtimer_expire())
+		hrtimer_arm();
+}
+
+// The local APIC timer fired: it may have done so early (see
+// lapic_timer_arm), so arm it again in any case.
+void
+hrtimer_interrupt(void)
+{
+	lapic_eoi();
+	hrtimer_expire();
+	hrtimer_arm();
+}
+
+bool
+hrtimer_pending(void)
+{
+	return hrtimer_queue != NULL;
+}
@@ -0,0 +1,24 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_HRTIMER_H
+#define JOS_KERN_HRTIMER_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+struct hrtimer {
+	uint64_t ht_expires;		// CLOCK_MONOTONIC, in nanoseconds
+	void (*ht_fn)(struct hrtimer *);	// Called once expired
+	struct hrtimer *ht_next;	// Queue link, sorted by ht_expires
+	bool ht_queued;
+};
+
+void	hrtimer_start(struct hrtimer *t, uint64_t expires);
+void	hrtimer_cancel(struct hrtimer *t);
+void	hrtimer_run(void);
+void	hrtimer_interrupt(void);
+bool	hrtimer_pending(void);
+
+#endif	// !JOS_KERN_HRTIMER_H
@@ -14,6 +14,8 @@
 #include <kern/cpu.h>
 #include <kern/picirq.h>
 #include <kern/kclock.h>
+#include <kern/swap.h>
+#include <kern/lapic.h>
 
 void
 i386_init(void)
@@ -39,6 +41,10 @@ i386_init(void)
 	mem_init();
 #endif
 
+#ifndef CONFIG_KSPACE
+	swap_init();
+#endif
+
 	// user environment initialization functions
 	env_init();
 	trap_init();
@@ -51,6 +57,12 @@ i386_init(void)
 	// outb(IO_RTC_DATA, IRQ_CLOCK);
 	irq_setmask_8259A(0xFFFF & ~(1<<IRQ_SLAVE) & ~(1<<IRQ_CLOCK));
 
+#ifndef CONFIG_KSPACE
+	// Before any environment exists: they share the kernel's page
+	// table for the MMIO region.
+	lapic_init();
+#endif
+
 
 #ifdef CONFIG_KSPACE
 	// Touch all you want.
@@ -0,0 +1,230 @@
+/* See COPYRIGHT for copyright information. */
+
+// POSIX-style interval timers.  Each environment has NITIMER of them,
+// running on hrtimers.  An expiry sets the timer's bit in
+// env_timer_pending; the next time the environment runs, env_run calls
+// the env_timer_upcall on the user exception stack with the pending
+// bits in utf_err, the way page faults reach env_pgfault_upcall.
+// Expiries that happen while a bit is still pending are counted as
+// overruns.  An environment blocked in sys_ipc_recv is woken for the
+// upcall and the receive fails with -E_INTR.
+
+#include <inc/error.h>
+#include <inc/string.h>
+#include <inc/assert.h>
+#include <inc/memlayout.h>
+
+#include <kern/itimer.h>
+#include <kern/hrtimer.h>
+#include <kern/env.h>
+#include <kern/pmap.h>
+#include <kern/sched.h>
+#include <kern/time.h>
+
+struct itimer {
+	struct hrtimer it_timer;	// First, see itimer_expired
+	bool it_used;
+	clockid_t it_clock;
+	uint64_t it_interval;		// Period in ns, 0 for one-shot
+	uint32_t it_overrun;		// Overruns counted since delivery
+	uint32_t it_overrun_last;	// ... as of the last delivery
+};
+
+static struct itimer itimers[NENV][NITIMER];
+
+static int64_t
+timespec_ns(const struct timespec *ts)
+{
+	return (int64_t) ts->tv_sec * NANOSECONDS + ts->tv_nsec;
+}
+
+static void
+ns_timespec(int64_t ns, struct timespec *ts)
+{
+	ts->tv_sec = 0;
+	ts->tv_nsec = ns;
+	normalize_time(ts);
+}
+
+static struct itimer *
+itimer_lookup(struct Env *e, timer_t id)
+{
+	if (id < 0 || id >= NITIMER || !itimers[ENVX(e->env_id)][id].it_used)
+		return NULL;
+	return &itimers[ENVX(e->env_id)][id];
+}
+
+static void
+itimer_expired(struct hrtimer *t)
+{
+	struct itimer *it = (struct itimer *) t;
+	size_t n = it - &itimers[0][0];
+	struct Env *e = &envs[n / NITIMER];
+	uint32_t bit = 1 << (n % NITIMER);
+
+	if (e->env_timer_pending & bit)
+		it->it_overrun++;
+	e->env_timer_pending |= bit;
+
+	if (it->it_interval) {
+		uint64_t now = clock_monotonic();
+		uint64_t next = t->ht_expires + it->it_interval;
+
+		// Periods missed entirely are overruns as well.
+		if (next <= now) {
+			uint64_t missed = (now - next) / it->it_interval + 1;
+
+			it->it_overrun += missed;
+			next += missed * it->it_interval;
+		}
+		hrtimer_start(t, next);
+	}
+
+	if (e->env_status == ENV_NOT_RUNNABLE && e->env_ipc_recving) {
+		e->env_ipc_recving = 0;
+		e->env_tf.tf_regs.reg_eax = -E_INTR;
+		e->env_status = ENV_RUNNABLE;
+	}
+	if (e->env_status == ENV_RUNNABLE ||
+	    (e == curenv && e->env_status == ENV_RUNNING))
+		sched_run_next(e);
+}
+
+//
+// Allocate a timer for 'e' on 'clock_id'.  Returns its id, or
+// -E_INVAL for a bad clock or -E_NO_MEM if 'e' has NITIMER timers.
+//
+int
+itimer_create(struct Env *e, clockid_t clock_id)
+{
+	struct itimer *it = itimers[ENVX(e->env_id)];
+
+	if (clock_id != CLOCK_MONOTONIC && clock_id != CLOCK_REALTIME)
+		return -E_INVAL;
+	for (int id = 0; id < NITIMER; id++, it++) {
+		if (!it->it_used) {
+			memset(it, 0, sizeof(*it));
+			it->it_used = true;
+			it->it_clock = clock_id;
+			it->it_timer.ht_fn = itimer_expired;
+			return id;
+		}
+	}
+	return -E_NO_MEM;
+}
+
+//
+// Arm or disarm timer 'id' of 'e' as timer_settime does.  A relative
+// it_value counts from now; with TIMER_ABSTIME it is a time on the
+// timer's clock.  Absolute CLOCK_REALTIME times are converted to
+// CLOCK_MONOTONIC when the timer is set.
+//
+int
+itimer_settime(struct Env *e, timer_t id, int flags,
+	       const struct itimerspec *value, struct itimerspec *ovalue)
+{
+	struct itimer *it = itimer_lookup(e, id);
+	uint64_t now = clock_monotonic();
+	int64_t expires;
+
+	if (!it)
+		return -E_INVAL;
+	if (value->it_value.tv_nsec < 0 ||
+	    value->it_value.tv_nsec >= NANOSECONDS ||
+	    value->it_interval.tv_nsec < 0 ||
+	    value->it_interval.tv_nsec >= NANOSECONDS)
+		return -E_INVAL;
+
+	if (ovalue) {
+		memset(ovalue, 0, sizeof(*ovalue));
+		if (it->it_timer.ht_queued)
+			ns_timespec(it->it_timer.ht_expires - now,
+				    &ovalue->it_value);
+		ns_timespec(it->it_interval, &ovalue->it_interval);
+	}
+
+	hrtimer_cancel(&it->it_timer);
+	e->env_timer_pending &= ~(1 << id);
+	it->it_overrun = 0;
+	it->it_interval = timespec_ns(&value->it_interval);
+
+	expires = timespec_ns(&value->it_value);
+	if (!expires)
+		return 0;
+	if (!(flags & TIMER_ABSTIME))
+		expires += now;
+	else if (it->it_clock == CLOCK_REALTIME)
+		expires -= clock_realtime() - (int64_t) now;
+	hrtimer_start(&it->it_timer, MAX(expires, 0));
+	return 0;
+}
+
+int
+itimer_delete(struct Env *e, timer_t id)
+{
+	struct itimer *it = itimer_lookup(e, id);
+
+	if (!it)
+		return -E_INVAL;
+	hrtimer_cancel(&it->it_timer);
+	e->env_timer_pending &= ~(1 << id);
+	it->it_used = false;
+	return 0;
+}
+
+// The overrun count of the last upcall for timer 'id'.
+int
+itimer_getoverrun(struct Env *e, timer_t id)
+{
+	struct itimer *it = itimer_lookup(e, id);
+
+	if (!it)
+		return -E_INVAL;
+	return it->it_overrun_last;
+}
+
+// Delete all timers of an environment being destroyed.
+void
+itimer_free_all(struct Env *e)
+{
+	for (timer_t id = 0; id < NITIMER; id++)
+		itimer_delete(e, id);
+}
+
+//
+// Called by env_run, with e's address space loaded: enter the timer
+// upcall for the pending timers.  The upcall is postponed while 'e'
+// runs on its exception stack already, in a page fault upcall or a
+// timer upcall, so that a fast periodic timer cannot overflow it.
+//
+void
+itimer_deliver(struct Env *e)
+{
+	struct Trapframe *tf = &e->env_tf;
+	struct UTrapframe utf, *utr;
+	struct itimer *it = itimers[ENVX(e->env_id)];
+
+	if (!e->env_timer_upcall ||
+	    (tf->tf_esp >= UXSTACKTOP - PGSIZE && tf->tf_esp < UXSTACKTOP))
+		return;
+
+	utf.utf_fault_va = 0;
+	utf.utf_err = e->env_timer_pending;
+	utf.utf_regs = tf->tf_regs;
+	utf.utf_eflags = tf->tf_eflags;
+	utf.utf_esp = tf->tf_esp;
+	utf.utf_eip = tf->tf_eip;
+	utr = (struct UTrapframe *) (UXSTACKTOP - sizeof(utf));
+	if (copy_to_user(utr, &utf, sizeof(utf)) < 0)
+		user_mem_fault(e);
+
+	for (timer_t id = 0; id < NITIMER; id++, it++) {
+		if (e->env_timer_pending & (1 << id)) {
+			it->it_overrun_last = it->it_overrun;
+			it->it_overrun = 0;
+		}
+	}
+	e->env_timer_pending = 0;
+	tf->tf_eip = (uintptr_t) e->env_timer_upcall;
+	tf->tf_esp = (uintptr_t) utr;
+}
@@ -0,0 +1,20 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_ITIMER_H
+#define JOS_KERN_ITIMER_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/env.h>
+#include <inc/time.h>
+
+int	itimer_create(struct Env *e, clockid_t clock_id);
+int	itimer_settime(struct Env *e, timer_t id, int flags,
+		       const struct itimerspec *value, struct itimerspec *ovalue);
+int	itimer_delete(struct Env *e, timer_t id);
+int	itimer_getoverrun(struct Env *e, timer_t id);
+void	itimer_free_all(struct Env *e);
+void	itimer_deliver(struct Env *e);
+
+#endif	// !JOS_KERN_ITIMER_H
@@ -50,6 +50,13 @@ uint8_t rtc_check_status(void);
 #define NVRAM_PEXTLO	(MC_NVRAM_START + 34)	/* low byte; RTC off. 0x30 */
 #define NVRAM_PEXTHI	(MC_NVRAM_START + 35)	/* high byte; RTC off. 0x31 */
 
+/* NVRAM bytes 38 and 39: memory above 16MB, in 64K blocks */
+#define NVRAM_EXT16LO	(MC_NVRAM_START + 38)	/* low byte; RTC off. 0x34 */
+#define NVRAM_EXT16HI	(MC_NVRAM_START + 39)	/* high byte; RTC off. 0x35 */
+
+/* RTC offsets 0x5b-0x5d: memory above 4GB, in 64K blocks (QEMU, Bochs) */
+#define NVRAM_HIGHMEM	0x5b
+
 /* NVRAM byte 36: current century.  (please increment in Dec99!) */
 #define NVRAM_CENTURY	(MC_NVRAM_START + 36)	/* RTC offset 0x32 */
 
@@ -112,6 +112,15 @@ stab_binsearch(const struct Stab *stabs, int *region_left, int *region_right,
 //
 int
 debuginfo_eip(uintptr_t addr, struct Eipdebuginfo *info)
+{
+	return debuginfo_env_eip(curenv, addr, info);
+}
+
+// Like debuginfo_eip, for an address of environment 'env', whose
+// address space must be loaded.  User addresses are looked up in the
+// stabs that 'env' has at USTABDATA.
+int
+debuginfo_env_eip(struct Env *env, uintptr_t addr, struct Eipdebuginfo *info)
 {
 	const struct Stab *stabs, *stab_end;
 	const char *stabstr, *stabstr_end;
@@ -142,7 +151,8 @@ debuginfo_eip(uintptr_t addr, struct Eipdebuginfo *info)
 		// Make sure this memory is valid.
 		// Return -1 if it is not.  Hint: Call user_mem_check.
 		// LAB 8: Your code here.
-		if (!user_mem_check(curenv, usd, sizeof(struct UserStabData), PTE_U | PTE_U)) {
+		if (!env ||
+		    user_mem_check(env, usd, sizeof(struct UserStabData), PTE_U | PTE_P) < 0) {
 			return -1;
 		}
 
@@ -154,10 +164,13 @@ debuginfo_eip(uintptr_t addr, struct Eipdebuginfo *info)
 		// Make sure the STABS and string table memory is valid.
 		// LAB 8: Your code here.
 
-		if (!user_mem_check(curenv, stabs, stab_end - stabs, PTE_U | PTE_P)) {
+		if (stab_end <= stabs ||
+		    user_mem_check(env, stabs, (stab_end - stabs) * sizeof(*stabs),
+				   PTE_U | PTE_P) < 0) {
 			return -1;
 		}
-		if (!user_mem_check(curenv, stabstr, stabstr_end - stabstr, PTE_U | PTE_P)) {
+		if (stabstr_end <= stabstr ||
+		    user_mem_check(env, stabstr, stabstr_end - stabstr, PTE_U | PTE_P) < 0) {
 			return -1;
 		}
 	}
@@ -0,0 +1,135 @@
+/* See COPYRIGHT for copyright information. */
+
+// The local APIC, used for its timer only: the 8259A still delivers the
+// device interrupts, through LINT0 as set up by the BIOS.  The timer
+// fires IRQ_TIMER once at a TSC deadline, for kern/hrtimer.c.
+
+#include <inc/x86.h>
+#include <inc/trap.h>
+#include <inc/assert.h>
+
+#include <kern/pmap.h>
+#include <kern/lapic.h>
+#include <kern/tsc.h>
+
+#define MSR_APIC_BASE	0x1B
+#define MSR_TSC_DEADLINE 0x6E0
+
+// Local APIC registers, divided by 4 for use as uint32_t[] indices.
+#define ID	(0x0020/4)	// ID
+#define TPR	(0x0080/4)	// Task Priority
+#define EOI	(0x00B0/4)	// EOI
+#define SVR	(0x00F0/4)	// Spurious Interrupt Vector
+	#define ENABLE		0x00000100	// Unit Enable
+#define ESR	(0x0280/4)	// Error Status
+#define TIMER	(0x0320/4)	// Local Vector Table 0 (TIMER)
+	#define ONESHOT		0x00000000
+	#define DEADLINE	0x00040000	// TSC-deadline mode
+#define ERROR	(0x0370/4)	// Local Vector Table 3 (ERROR)
+	#define MASKED		0x00010000	// Interrupt masked
+#define TICR	(0x0380/4)	// Timer Initial Count
+#define TCCR	(0x0390/4)	// Timer Current Count
+#define TDCR	(0x03E0/4)	// Timer Divide Configuration
+	#define X1		0x0000000B	// divide counts by 1
+
+// Calibrate the one-shot timer against the TSC over this long.
+#define CALIBRATE_MS	10
+
+bool lapic_timer;
+
+static volatile uint32_t *lapic;
+static bool tsc_deadline;	// timer runs in TSC-deadline mode
+static uint64_t lapic_khz;	// one-shot timer count rate otherwise
+// Timer counts per TSC cycle, counts = cycles * lapic_mult >> lapic_shift
+static uint32_t lapic_mult, lapic_shift;
+
+static void
+lapicw(int index, uint32_t value)
+{
+	lapic[index] = value;
+	lapic[ID];	// wait for write to finish, by reading
+}
+
+void
+lapic_init(void)
+{
+	uint32_t ecx, edx;
+	uint64_t start;
+
+	cpuid(1, NULL, NULL, &ecx, &edx);
+	if (!(edx & (1 << 9))) {
+		cprintf("lapic: none, timers run from the clock tick\n");
+		return;
+	}
+	lapic = mmio_map_region(rdmsr(MSR_APIC_BASE) & ~(PGSIZE - 1), PGSIZE);
+
+	// Enable the local APIC; set the spurious interrupt vector.
+	lapicw(SVR, ENABLE | (IRQ_OFFSET + IRQ_SPURIOUS));
+
+	// Errors are of no interest here.
+	lapicw(ERROR, MASKED);
+	lapicw(ESR, 0);
+	lapicw(ESR, 0);
+
+	// Accept all interrupts, and ack any outstanding one.
+	lapicw(TPR, 0);
+	lapicw(EOI, 0);
+
+	tsc_deadline = ecx & (1 << 24);
+	if (tsc_deadline) {
+		lapicw(TIMER, DEADLINE | (IRQ_OFFSET + IRQ_TIMER));
+	} else {
+		// Count down from the top for a while to learn the rate.
+		lapicw(TDCR, X1);
+		lapicw(TIMER, ONESHOT | MASKED | (IRQ_OFFSET + IRQ_TIMER));
+		lapicw(TICR, 0xFFFFFFFF);
+		start = read_tsc();
+		while (read_tsc() - start < (uint64_t) cpu_freq * CALIBRATE_MS)
+			/* do nothing */;
+		lapic_khz = (0xFFFFFFFF - lapic[TCCR]) / CALIBRATE_MS;
+		lapicw(TICR, 0);
+		if (!lapic_khz) {
+			cprintf("lapic: timer does not count\n");
+			return;
+		}
+		// lapic_khz is counted against cpu_freq as it is now, so
+		// the ratio stays right when clocksource_tick refines it.
+		calc_mult_shift(&lapic_mult, &lapic_shift, cpu_freq, lapic_khz,
+				1ULL << 40);
+		lapicw(TIMER, ONESHOT | (IRQ_OFFSET + IRQ_TIMER));
+	}
+	lapic_timer = true;
+	cprintf("lapic: %s timer\n", tsc_deadline ? "TSC-deadline" : "one-shot");
+}
+
+// Acknowledge interrupt.
+void
+lapic_eoi(void)
+{
+	if (lapic)
+		lapicw(EOI, 0);
+}
+
+// Raise IRQ_TIMER once the TSC reaches 'deadline', or never if it is 0.
+// A deadline in the past fires right away.
+void
+lapic_timer_arm(uint64_t deadline)
+{
+	uint64_t now, count;
+
+	if (!lapic_timer)
+		return;
+	if (tsc_deadline) {
+		wrmsr(MSR_TSC_DEADLINE, deadline);
+		return;
+	}
+	if (!deadline) {
+		lapicw(TICR, 0);
+		return;
+	}
+	// A far deadline just fires early, and is armed again then.
+	now = read_tsc();
+	count = deadline > now ? MIN(deadline - now, 1ULL << 40) : 0;
+	count = count * lapic_mult >> lapic_shift;
+	lapicw(TICR, MIN(MAX(count, 1), 0xFFFFFFFF));
+}
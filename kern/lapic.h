@@ -0,0 +1,18 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_LAPIC_H
+#define JOS_KERN_LAPIC_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// Set when the local APIC timer can raise IRQ_TIMER at a given time.
+extern bool lapic_timer;
+
+void	lapic_init(void);
+void	lapic_eoi(void);
+void	lapic_timer_arm(uint64_t deadline);
+
+#endif	// !JOS_KERN_LAPIC_H
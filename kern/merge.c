@@ -0,0 +1,211 @@
+/* See COPYRIGHT for copyright information. */
+
+// Same-page merging.
+//
+// Environments that opt in with sys_env_set_mergeable have their pages
+// scanned in small batches from the scheduler.  Each candidate page is
+// hashed and looked up in a table of recently seen pages; when an equal
+// page is found, both mappings are pointed at one physical page marked
+// PTE_COW, following the user library's fork conventions, and the
+// duplicate is freed.  Writes to merged pages are resolved by
+// page_cow_break in the page fault handler.
+
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/string.h>
+#include <inc/assert.h>
+
+#include <kern/pmap.h>
+#include <kern/env.h>
+#include <kern/merge.h>
+
+// Slots in the table of candidate pages, a power of two.
+#define MERGE_HASHSIZE		4096
+
+// Upper bound on the page table entries examined per pass, so a pass
+// over sparse or unmergeable address spaces stays short.
+#define MERGE_MAXSTEPS		1024
+
+struct MergeSlot {
+	uint32_t ms_hash;
+	struct PageInfo *ms_page;	// may be stale, see merge_target_ok
+};
+
+struct MergeStat mergestat;
+
+static struct MergeSlot merge_table[MERGE_HASHSIZE];
+static int merge_nenvs;			// environments with env_mergeable set
+
+// Scanner position
+static int scan_envx;
+static uintptr_t scan_va;
+
+void
+env_set_mergeable(struct Env *e, bool mergeable)
+{
+	if (e->env_mergeable == mergeable)
+		return;
+	e->env_mergeable = mergeable;
+	merge_nenvs += mergeable ? 1 : -1;
+}
+
+// 32-bit FNV-1a, a word at a time.
+static uint32_t
+page_hash(const void *page)
+{
+	const uint32_t *w = page;
+	uint32_t h = 2166136261U;
+
+	for (int i = 0; i < PGSIZE / 4; i++) {
+		h ^= w[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+
+// A page can be merged into 'pp' only if every mapping of it belongs to
+// a mergeable environment and none is shared on purpose.  Table slots
+// are not cleared when pages are freed, so this also weeds out pages
+// that were freed or reused since they were recorded.
+static bool
+merge_target_ok(struct PageInfo *pp)
+{
+	int n = 0;
+
+	for (struct Rmap *rm = pp->pp_rmap; rm; rm = rm->rm_next) {
+		struct Env *e = pgdir2env(rm->rm_pgdir);
+		pte_t *pte = pgdir_walk(rm->rm_pgdir, (void *) rm->rm_va, 0);
+
+		if (rm->rm_va >= UTOP || rm->rm_va == UXSTACKTOP - PGSIZE ||
+		    !e || !e->env_mergeable || (*pte & PTE_SHARE))
+			return false;
+		n++;
+	}
+	return n > 0 && n == pp->pp_ref;
+}
+
+// Return the page mapped by 'pte' at 'va' if it may be merged now.
+// A writable page is only taken if it was not written since the
+// scanner last looked at it, which keeps busy pages out of the table.
+static struct PageInfo *
+merge_candidate(struct Env *e, uintptr_t va, pte_t *pte)
+{
+	struct PageInfo *pp;
+
+	if ((*pte & (PTE_P | PTE_U)) != (PTE_P | PTE_U) ||
+	    (*pte & PTE_SHARE) || va == UXSTACKTOP - PGSIZE)
+		return NULL;
+	pp = pa2page(PTE_ADDR(*pte));
+	if (pp->pp_ref != 1 || !pp->pp_rmap || pp->pp_rmap->rm_next)
+		return NULL;
+	if ((*pte & (PTE_W | PTE_D)) == (PTE_W | PTE_D)) {
+		*pte &= ~PTE_D;
+		tlb_invalidate(e->env_pgdir, (void *) va);
+		return NULL;
+	}
+	return pp;
+}
+
+// Make a mapping of a merged page copy-on-write.
+static void
+merge_protect(pde_t *pgdir, uintptr_t va)
+{
+	pte_t *pte = pgdir_walk(pgdir, (void *) va, 0);
+
+	if (!(*pte & PTE_W))
+		return;
+	*pte = (*pte & ~PTE_W) | PTE_COW;
+	tlb_invalidate(pgdir, (void *) va);
+	pgdir2env(pgdir)->env_memstat.ms_cow++;
+}
+
+// Merge 'pp', mapped at 'va' by 'e', with an identical page seen
+// earlier, or remember it for later candidates.
+static void
+page_merge(struct Env *e, uintptr_t va, pte_t *pte, struct PageInfo *pp)
+{
+	void *kva = kmap(pp), *tkva;
+	uint32_t hash = page_hash(kva);
+	struct MergeSlot *slot = &merge_table[hash % MERGE_HASHSIZE];
+	struct PageInfo *tp = slot->ms_page;
+	bool same = false;
+	int perm;
+
+	mergestat.mg_scanned++;
+	if (tp && tp != pp && slot->ms_hash == hash && merge_target_ok(tp)) {
+		tkva = kmap(tp);
+		same = memcmp(tkva, kva, PGSIZE) == 0;
+		kunmap(tkva);
+	}
+	kunmap(kva);
+	if (!same) {
+		slot->ms_hash = hash;
+		slot->ms_page = pp;
+		return;
+	}
+
+	for (struct Rmap *rm = tp->pp_rmap; rm; rm = rm->rm_next)
+		merge_protect(rm->rm_pgdir, rm->rm_va);
+	perm = *pte & PTE_SYSCALL;
+	if (perm & PTE_W)
+		perm = (perm & ~PTE_W) | PTE_COW;
+	// Replacing the mapping frees 'pp'.
+	if (page_insert(e->env_pgdir, tp, (void *) va, perm) < 0)
+		return;
+	tp->pp_merged = true;
+	mergestat.mg_merged++;
+}
+
+//
+// Advance the scanner over the address spaces of mergeable
+// environments, hashing at most 'budget' pages.  Called from the
+// scheduler, where no kernel code holds references to user pages.
+//
+void
+page_merge_scan(int budget)
+{
+	uint64_t start;
+
+	if (!merge_nenvs)
+		return;
+
+	start = read_tsc();
+	for (int steps = 0; steps < MERGE_MAXSTEPS && budget > 0; steps++) {
+		struct Env *e = &envs[scan_envx];
+		struct PageInfo *pp;
+		uintptr_t va;
+		pte_t *pte;
+
+		if (e->env_status == ENV_FREE || !e->env_mergeable ||
+		    !e->env_pgdir || scan_va >= UTOP) {
+			scan_envx = (scan_envx + 1) % NENV;
+			scan_va = 0;
+			continue;
+		}
+		if (!(e->env_pgdir[PDX(scan_va)] & PTE_P)) {
+			scan_va = ROUNDDOWN(scan_va, PTSIZE) + PTSIZE;
+			continue;
+		}
+
+		va = scan_va;
+		scan_va += PGSIZE;
+		pte = pgdir_walk(e->env_pgdir, (void *) va, 0);
+		if ((pp = merge_candidate(e, va, pte))) {
+			page_merge(e, va, pte, pp);
+			budget--;
+		}
+	}
+	mergestat.mg_cycles += read_tsc() - start;
+}
+
+// Number of pages the merged pages currently stand in for.
+uint32_t
+page_merge_saved(void)
+{
+	uint32_t saved = 0;
+
+	for (size_t i = 0; i < npages; i++)
+		if (pages[i].pp_merged && pages[i].pp_ref > 1)
+			saved += pages[i].pp_ref - 1;
+	return saved;
+}
@@ -0,0 +1,22 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_MERGE_H
+#define JOS_KERN_MERGE_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/env.h>
+
+// Number of pages the scheduler hashes per pass while some environment
+// is mergeable.
+#define MERGE_BATCH		64
+
+extern struct MergeStat mergestat;
+
+void	env_set_mergeable(struct Env *e, bool mergeable);
+void	page_merge_scan(int budget);
+uint32_t page_merge_saved(void);
+
+#endif	// !JOS_KERN_MERGE_H
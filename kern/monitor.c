@@ -13,6 +13,9 @@
 #include <kern/tsc.h>
 #include <kern/pmap.h>
 #include <kern/trap.h>
+#include <kern/swap.h>
+#include <kern/merge.h>
+#include <kern/env.h>
 
 #define CMDBUF_SIZE	80	// enough for one VGA text line
 
@@ -32,7 +35,10 @@ static struct Command commands[] = {
 	{ "timer_start",  "Start tcs timer", start_timer },
 	{ "timer_stop",  "Stop tcs timer", stop_timer },
 	{ "mv", "View physical memory layout", memory_view },
-	{ "pc", "Print constants", print_constants }
+	{ "pc", "Print constants", print_constants },
+	{ "swapinfo", "Display page reclaim and swap statistics", mon_swapinfo },
+	{ "ps", "Display memory use of each environment", mon_ps },
+	{ "mergeinfo", "Display same-page merging statistics", mon_mergeinfo }
 };
 #define NCOMMANDS (sizeof(commands)/sizeof(commands[0]))
 
@@ -73,6 +79,48 @@ memory_view(int argc, char **argv, struct Trapframe *tf)
 	return 0;
 }
 
+int
+mon_swapinfo(int argc, char **argv, struct Trapframe *tf)
+{
+	cprintf("free pages:    %u of %u\n", page_free_count, npages);
+	cprintf("swap slots:    %u used of %u\n",
+		swapstat.ss_used, swapstat.ss_nslots);
+	cprintf("evicted:       %u\n", swapstat.ss_evicted);
+	cprintf("swapped out:   %u\n", swapstat.ss_swapout);
+	cprintf("swapped in:    %u\n", swapstat.ss_swapin);
+	return 0;
+}
+
+int
+mon_ps(int argc, char **argv, struct Trapframe *tf)
+{
+	cprintf("   ENVID STAT   RSS SHARED    COW   SWAP PGTAB"
+		"  ZERO  SWAPIN  UPCALL    COW\n");
+	for (int i = 0; i < NENV; i++) {
+		struct EnvMemStat *ms = &envs[i].env_memstat;
+
+		if (envs[i].env_status == ENV_FREE)
+			continue;
+		cprintf("%08x %4d %5u %6u %6u %6u %5u %5u %7u %7u %6u\n",
+			envs[i].env_id, envs[i].env_status, ms->ms_rss,
+			ms->ms_shared, ms->ms_cow, ms->ms_swapped,
+			ms->ms_pgtables, ms->ms_faults[FAULT_ZERO],
+			ms->ms_faults[FAULT_SWAP], ms->ms_faults[FAULT_UPCALL],
+			ms->ms_faults[FAULT_COW]);
+	}
+	return 0;
+}
+
+int
+mon_mergeinfo(int argc, char **argv, struct Trapframe *tf)
+{
+	cprintf("pages hashed:  %u\n", mergestat.mg_scanned);
+	cprintf("pages merged:  %u\n", mergestat.mg_merged);
+	cprintf("pages saved:   %u\n", page_merge_saved());
+	cprintf("scan cycles:   %llu\n", mergestat.mg_cycles);
+	return 0;
+}
+
 int
 start_timer(int argc, char **argv, struct Trapframe *tf)
 {
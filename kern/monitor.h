@@ -20,5 +20,8 @@ int start_timer(int argc, char **argv, struct Trapframe *tf);
 int stop_timer(int argc, char **argv, struct Trapframe *tf);
 int memory_view(int argc, char **argv, struct Trapframe *tf);
 int print_constants(int argc, char **argv, struct Trapframe *tf);
+int mon_swapinfo(int argc, char **argv, struct Trapframe *tf);
+int mon_ps(int argc, char **argv, struct Trapframe *tf);
+int mon_mergeinfo(int argc, char **argv, struct Trapframe *tf);
 
 #endif	// !JOS_KERN_MONITOR_H
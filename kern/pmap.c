@@ -11,17 +11,42 @@
 #include <kern/pmap.h>
 #include <kern/kclock.h>
 #include <kern/env.h>
+#include <kern/swap.h>
 
 // These variables are set by i386_detect_memory()
 size_t npages;			// Amount of physical memory (in pages)
+size_t npages_lowmem;		// Pages mapped at KERNBASE (at most 256MB)
 static size_t npages_basemem;	// Amount of base memory (in pages)
-#define last_page_addr ((char*) KERNBASE + npages * PGSIZE)
+static size_t npages_below4g;	// Pages of memory below the PCI hole
+#define last_page_addr ((char*) KERNBASE + npages_lowmem * PGSIZE)
+
+// Every page must be described in the UPAGES window the user sees.
+#define MAXPAGES	(UPAGESSIZE / sizeof(struct PageInfo))
 
 // These variables are set in mem_init()
 int *vsys;  // Virtual syscall space
 pde_t *kern_pgdir;		// Kernel's initial page directory
 struct PageInfo *pages;		// Physical page state array
 static struct PageInfo *page_free_list;	// Free list of physical pages
+static struct PageInfo *highmem_free_list;	// ... above the direct map
+size_t page_free_count;		// Number of pages on both free lists
+static pte_t *kmap_pte;		// Page table entries of the kmap window
+
+#ifdef CONFIG_PAE
+// With PAE a page directory takes four pages, which the page allocator
+// can't hand out in one piece.  The page directories of the
+// environments are allocated at boot instead, one for each slot of
+// 'envs'.  Slot NENV of 'pdpts' is kern_pgdir's.
+static pde_t *env_pgdirs;
+static pdpte_t pdpts[NENV + 1][NPDPENTRIES] __attribute__((aligned(32)));
+#endif
+
+// Reverse mapping entries.  Two per physical page are allocated at
+// boot, which covers the usual sharing (fork COW, IPC, PTE_SHARE);
+// rmap_alloc carves more out of free pages when a workload maps pages
+// more widely, as merged pages are.  Pool pages are never given back.
+#define NRMAP_PER_PAGE	2
+static struct Rmap *rmap_free_list;
 
 
 // --------------------------------------------------------------
@@ -37,24 +62,56 @@ nvram_read(int r)
 static void
 i386_detect_memory(void)
 {
-	size_t npages_extmem;
+	size_t npages_extmem, npages_ext16mem, npages_above4g;
 
 	// Use CMOS calls to measure available base & extended memory.
 	// (CMOS calls return results in kilobytes.)
 	npages_basemem = (nvram_read(NVRAM_BASELO) * 1024) / PGSIZE;
 	npages_extmem = (nvram_read(NVRAM_EXTLO) * 1024) / PGSIZE;
+	// The extended memory count saturates at 64MB, memory above 16MB
+	// is reported separately in 64K blocks.
+	npages_ext16mem = nvram_read(NVRAM_EXT16LO) * (65536 / PGSIZE);
+	npages_above4g = (nvram_read(NVRAM_HIGHMEM) |
+			  (mc146818_read(NVRAM_HIGHMEM + 2) << 16)) *
+			 (65536 / PGSIZE);
 
 	// Calculate the number of physical pages available in both base
 	// and extended memory.
-	if (npages_extmem)
+	if (npages_ext16mem)
+		npages = (16 * 1024 * 1024) / PGSIZE + npages_ext16mem;
+	else if (npages_extmem)
 		npages = (EXTPHYSMEM / PGSIZE) + npages_extmem;
 	else
 		npages = npages_basemem;
 
 	cprintf("Physical memory: %uK available, base = %uK, extended = %uK\n",
-		npages * PGSIZE / 1024,
-		npages_basemem * PGSIZE / 1024,
-		npages_extmem * PGSIZE / 1024);
+		npages * (PGSIZE / 1024),
+		npages_basemem * (PGSIZE / 1024),
+		(npages - EXTPHYSMEM / PGSIZE) * (PGSIZE / 1024));
+	npages_below4g = npages;
+
+#ifdef CONFIG_PAE
+	// Memory above 4G starts at 4G, past the PCI hole.
+	if (npages_above4g) {
+		cprintf("Physical memory: %uM above 4G\n",
+			npages_above4g / (1024 * 1024 / PGSIZE));
+		npages = ((size_t) 1 << (32 - PGSHIFT)) + npages_above4g;
+	}
+#else
+	// Physical addresses are 32 bits wide without PAE.
+	if (npages_above4g)
+		cprintf("Physical memory: ignoring %uM above 4G\n",
+			npages_above4g / (1024 * 1024 / PGSIZE));
+#endif
+	if (npages > MAXPAGES) {
+		cprintf("Physical memory: using only the first %uM\n",
+			MAXPAGES / (1024 * 1024 / PGSIZE));
+		npages = MAXPAGES;
+		npages_below4g = MIN(npages_below4g, npages);
+	}
+
+	// Memory past the end of the KERNBASE mapping is high memory.
+	npages_lowmem = MIN(npages, (size_t) (0 - KERNBASE) / PGSIZE);
 }
 
 
@@ -62,6 +119,10 @@ i386_detect_memory(void)
 // Set up memory mappings above UTOP.
 // --------------------------------------------------------------
 
+static void boot_map_lowmem(void);
+#ifdef CONFIG_PAE
+static void pdpt_init(pdpte_t *pdpt, pde_t *pgdir);
+#endif
 static void boot_map_region(pde_t *pgdir, uintptr_t va, size_t size, physaddr_t pa, int perm);
 static void check_page_free_list(bool only_low_memory);
 static void check_page_alloc(void);
@@ -138,8 +199,11 @@ mem_init(void)
 
 	//////////////////////////////////////////////////////////////////////
 	// create initial page directory.
-	kern_pgdir = (pde_t *) boot_alloc(PGSIZE);
-	memset(kern_pgdir, 0, PGSIZE);
+	kern_pgdir = (pde_t *) boot_alloc(NPDENTRIES * sizeof(pde_t));
+	memset(kern_pgdir, 0, NPDENTRIES * sizeof(pde_t));
+#ifdef CONFIG_PAE
+	pdpt_init(pdpts[NENV], kern_pgdir);
+#endif
 
 	//////////////////////////////////////////////////////////////////////
 	// Recursively insert PD in itself as a page table, to form
@@ -148,7 +212,19 @@ mem_init(void)
 	// following line.)
 
 	// Permissions: kernel R, user R
-	kern_pgdir[PDX(UVPT)] = PADDR(kern_pgdir) | PTE_U | PTE_P;
+	for (int i = 0; i < UVPTSIZE / PTSIZE; i++)
+		kern_pgdir[PDX(UVPT) + i] =
+			(PADDR(kern_pgdir) + i * PGSIZE) | PTE_U | PTE_P;
+
+	//////////////////////////////////////////////////////////////////////
+	// Map all of physical memory at KERNBASE.
+	// Ie.  the VA range [KERNBASE, 2^32) should map to
+	//      the PA range [0, 2^32 - KERNBASE)
+	// We might not have 2^32 - KERNBASE bytes of physical memory, but
+	// we just set up the mapping anyway.  Pages above that are only
+	// reachable through kmap.
+	// Permissions: kernel RW, user NONE
+	boot_map_lowmem();
 
 	//////////////////////////////////////////////////////////////////////
 	// Allocate an array of npages 'struct PageInfo's and store it in 'pages'.
@@ -160,12 +236,33 @@ mem_init(void)
 	pages = (struct PageInfo *) boot_alloc(npages * sizeof(struct PageInfo));
 	memset(pages, 0, npages * sizeof(struct PageInfo));
 
+	//////////////////////////////////////////////////////////////////////
+	// Allocate the pool of reverse mapping entries used by page_insert.
+	{
+		size_t nrmap = NRMAP_PER_PAGE * npages;
+		struct Rmap *rmaps = boot_alloc(nrmap * sizeof(struct Rmap));
+
+		for (size_t i = 0; i < nrmap; i++) {
+			rmaps[i].rm_next = rmap_free_list;
+			rmap_free_list = &rmaps[i];
+		}
+	}
+
 	//////////////////////////////////////////////////////////////////////
 	// Make 'envs' point to an array of size 'NENV' of 'struct Env'.
 	// LAB 8: Your code here.
 	envs = (struct Env *) boot_alloc(ROUNDUP(NENV * sizeof(struct Env), PGSIZE));
 	memset(envs, 0, ROUNDUP(NENV * sizeof(struct Env), PGSIZE));
 
+#ifdef CONFIG_PAE
+	//////////////////////////////////////////////////////////////////////
+	// Allocate the page directories of the environments (see
+	// pgdir_alloc).
+	env_pgdirs = boot_alloc(NENV * NPDENTRIES * sizeof(pde_t));
+	for (int i = 0; i < NENV; i++)
+		pdpt_init(pdpts[i], &env_pgdirs[i * NPDENTRIES]);
+#endif
+
 	//////////////////////////////////////////////////////////////////////
 	// Make 'vsys' point to an array of size 'NVSYSCALLS' of int.
 	// LAB 12: Your code here.
@@ -218,7 +315,7 @@ mem_init(void)
 	boot_map_region(
 		kern_pgdir,
 		UPAGES,
-		PTSIZE,
+		ROUNDUP(npages * sizeof(struct PageInfo), PGSIZE),
 		PADDR(pages),
 		PTE_U | PTE_P
 	);
@@ -270,22 +367,11 @@ mem_init(void)
 		PADDR(bootstack),
 		PTE_W | PTE_P
 	);
-	//////////////////////////////////////////////////////////////////////
-	// Map all of physical memory at KERNBASE.
-	// Ie.  the VA range [KERNBASE, 2^32) should map to
-	//      the PA range [0, 2^32 - KERNBASE)
-	// We might not have 2^32 - KERNBASE bytes of physical memory, but
-	// we just set up the mapping anyway.
-	// Permissions: kernel RW, user NONE
-	// Your code goes here:
-	
-	boot_map_region(
-		kern_pgdir,
-		KERNBASE,
-		ROUNDUP(~0 - KERNBASE + 1, PGSIZE),
-		0,
-		PTE_W | PTE_P
-	);
+
+	// The kmap window shares its page table with the kernel stack, so
+	// every environment sees the same temporary mappings.
+	kmap_pte = pgdir_walk(kern_pgdir, (void *) KMAPBASE, 1);
+	assert(kmap_pte);
 
 	// Check that the initial page directory has been set up correctly.
 	cprintf("Boot all regions correctly\n");
@@ -300,7 +386,7 @@ mem_init(void)
 	// If the machine reboots at this point, you've probably set up your
 	// kern_pgdir wrong.
 	cprintf("kern_pgdir: 0x%p\n", (void*)kern_pgdir);
-	lcr3(PADDR(kern_pgdir));
+	lcr3(pgdir_cr3(kern_pgdir));
 
 	check_page_free_list(0);
 
@@ -354,7 +440,17 @@ page_init(void)
 	physaddr_t phys_addr;
 	char *virt_addr;
 
-	for (i = 0; i < npages; i++) {
+	for (i = npages_lowmem; i < npages; i++) {
+		// Between the memory below 4G and 4G lies the PCI hole.
+		if (i >= npages_below4g && i < (size_t) 1 << (32 - PGSHIFT)) {
+			pages[i].pp_ref = 1;
+			continue;
+		}
+		pages[i].pp_link = highmem_free_list;
+		highmem_free_list = &pages[i];
+		page_free_count++;
+	}
+	for (i = 0; i < npages_lowmem; i++) {
 		phys_addr = page2pa(&pages[i]);
 		virt_addr = page2kva(&pages[i]);
 		if (i == 0 ||
@@ -368,6 +464,7 @@ page_init(void)
 			pages[i].pp_ref = 0;
 			pages[i].pp_link = page_free_list;
 			page_free_list = &pages[i];
+			page_free_count++;
 		}
 	}
 }
@@ -384,22 +481,32 @@ page_init(void)
 // Returns NULL if out of free memory.
 //
 // Hint: use page2kva and memset
+//
+// Only with ALLOC_HIGHMEM may the page lie above the direct map; such
+// callers access the page through kmap.  High memory is used first
+// then, to keep low memory for page tables and kernel data.
 struct PageInfo *
 page_alloc(int alloc_flags)
 {
 	// Fill this function in
 
-	struct PageInfo* allocated_page_info = page_free_list;
+	struct PageInfo **free_list = &page_free_list;
+	if ((alloc_flags & ALLOC_HIGHMEM) && highmem_free_list) {
+		free_list = &highmem_free_list;
+	}
+	struct PageInfo* allocated_page_info = *free_list;
 	if (allocated_page_info == NULL) {
 		return NULL;
 	}
-	if (page_free_list) {
-		page_free_list = page_free_list->pp_link;
-		allocated_page_info->pp_link = NULL;
-	}
+	*free_list = allocated_page_info->pp_link;
+	allocated_page_info->pp_link = NULL;
+	allocated_page_info->pp_merged = false;
+	page_free_count--;
 
 	if (alloc_flags & ALLOC_ZERO) {
-		memset(page2kva(allocated_page_info), 0, PGSIZE);
+		void *kva = kmap(allocated_page_info);
+		memset(kva, 0, PGSIZE);
+		kunmap(kva);
 	}
 	return allocated_page_info;
 }
@@ -421,8 +528,14 @@ page_free(struct PageInfo *pp)
 			pp->pp_ref
 		);
 	}
-	pp->pp_link = page_free_list;
-	page_free_list = pp;
+	if (page_is_highmem(pp)) {
+		pp->pp_link = highmem_free_list;
+		highmem_free_list = pp;
+	} else {
+		pp->pp_link = page_free_list;
+		page_free_list = pp;
+	}
+	page_free_count++;
 }
 
 //
@@ -471,11 +584,10 @@ pgdir_walk(pde_t *pgdir, const void *va, int create)
 	// 	va,
 	// 	create
 	// );
-	pte_t *pte = (pte_t *)PTE_ADDR(pgdir[PDX(va)]);
-	pte_t *pte_result = &pte[PTX(va)];
+	physaddr_t pt = PTE_ADDR(pgdir[PDX(va)]);
 
 	struct PageInfo *page;
-	if (!pte || !pte_result) {
+	if (!pt) {
 
 		physaddr_t pa;
 		if (create == false) {
@@ -487,16 +599,36 @@ pgdir_walk(pde_t *pgdir, const void *va, int create)
 		pa = page2pa(page);
 		pgdir[PDX(va)] = pa | PTE_P | PTE_W | PTE_U;
 		page->pp_ref++;
+		if (pgdir2env(pgdir))
+			pgdir2env(pgdir)->env_memstat.ms_pgtables++;
 		return (pte_t *)KADDR(pa) + PTX(va);
 	}
 	// cprintf("FIRST\n");
 	// cprintf("!!!pte: addr: %p\n", pte);
 	// cprintf("SECOND!!!!\n");
 	//cprintf("pte: addr: %x value: %x \n", (uint32_t) pte, *pte);
-	return KADDR((physaddr_t)pte_result);
+	return (pte_t *)KADDR(pt) + PTX(va);
 	// return NULL;
 }
 
+//
+// Map the whole KERNBASE region to physical memory using page tables
+// from boot_alloc and switch to kern_pgdir.  entry_pgdir only maps the
+// first 8MB, which the arrays sized by npages may outgrow.
+//
+static void
+boot_map_lowmem(void)
+{
+	for (uintptr_t va = KERNBASE; va >= KERNBASE; va += PTSIZE) {
+		pte_t *pt = boot_alloc(PGSIZE);
+
+		for (int i = 0; i < NPTENTRIES; i++)
+			pt[i] = (va - KERNBASE + i * PGSIZE) | PTE_W | PTE_P;
+		kern_pgdir[PDX(va)] = PADDR(pt) | PTE_W | PTE_P;
+	}
+	lcr3(pgdir_cr3(kern_pgdir));
+}
+
 //
 // Map [va, va+size) of virtual address space to physical [pa, pa+size)
 // in the page table rooted at pgdir.  Size is a multiple of PGSIZE, and
@@ -520,6 +652,188 @@ boot_map_region(pde_t *pgdir, uintptr_t va, size_t size, physaddr_t pa, int perm
 	}
 }
 
+//
+// Return the environment whose page directory is 'pgdir', or NULL for
+// kern_pgdir.
+//
+struct Env *
+pgdir2env(pde_t *pgdir)
+{
+	return pa2page(PADDR(pgdir))->pp_env;
+}
+
+//
+// Allocate a zeroed page directory for 'e'.
+// Returns NULL if there is no free page.
+//
+pde_t *
+pgdir_alloc(struct Env *e)
+{
+#ifdef CONFIG_PAE
+	pde_t *pgdir = &env_pgdirs[(e - envs) * NPDENTRIES];
+
+	memset(pgdir, 0, NPDENTRIES * sizeof(pde_t));
+	pa2page(PADDR(pgdir))->pp_env = e;
+	return pgdir;
+#else
+	struct PageInfo *p;
+
+	if (!(p = page_alloc(ALLOC_ZERO)))
+		return NULL;
+	p->pp_ref++;
+	p->pp_env = e;
+	return page2kva(p);
+#endif
+}
+
+// Free a page directory from pgdir_alloc.  It must not be loaded.
+void
+pgdir_free(pde_t *pgdir)
+{
+	struct PageInfo *p = pa2page(PADDR(pgdir));
+
+	p->pp_env = NULL;
+#ifndef CONFIG_PAE
+	page_decref(p);
+#endif
+}
+
+#ifdef CONFIG_PAE
+// Point the page directory pointer table 'pdpt' at the pages of 'pgdir'.
+static void
+pdpt_init(pdpte_t *pdpt, pde_t *pgdir)
+{
+	for (int i = 0; i < NPDPENTRIES; i++)
+		pdpt[i] = (PADDR(pgdir) + i * PGSIZE) | PTE_P;
+}
+
+physaddr_t
+pgdir_cr3(pde_t *pgdir)
+{
+	if (pgdir == kern_pgdir)
+		return PADDR(pdpts[NENV]);
+	return PADDR(pdpts[(pgdir - env_pgdirs) / NPDENTRIES]);
+}
+
+pde_t *
+cr3_pgdir(physaddr_t cr3)
+{
+	uint32_t i = (uint32_t) (cr3 - PADDR(pdpts)) / sizeof(pdpts[0]);
+
+	return i == NENV ? kern_pgdir : &env_pgdirs[i * NPDENTRIES];
+}
+#endif
+
+//
+// Update the memory accounting of the env owning 'pgdir' when the
+// mapping of 'pp' at 'va' with entry 'pte' is added (delta = 1) or
+// removed (delta = -1).  The mapping must be on pp's reverse map.
+//
+static void
+page_account(struct PageInfo *pp, pde_t *pgdir, uintptr_t va, pte_t pte,
+	     int delta)
+{
+	struct EnvMemStat *ms;
+	struct Rmap *other;
+	struct Env *e;
+
+	if (va >= UTOP || !(e = pgdir2env(pgdir)))
+		return;
+	ms = &e->env_memstat;
+	ms->ms_rss += delta;
+	if (pte & PTE_COW)
+		ms->ms_cow += delta;
+
+	if (!pp->pp_rmap->rm_next)
+		return;
+	ms->ms_shared += delta;
+
+	// With exactly two mappings, the other one turns from private to
+	// shared or back.
+	if (pp->pp_rmap->rm_next->rm_next)
+		return;
+	other = pp->pp_rmap;
+	if (other->rm_pgdir == pgdir && other->rm_va == va)
+		other = other->rm_next;
+	if (other->rm_va < UTOP && (e = pgdir2env(other->rm_pgdir)))
+		e->env_memstat.ms_shared += delta;
+}
+
+//
+// Return a kernel address for the contents of 'pp'.  Pages in the
+// direct map are at page2kva, others get one of the NKMAP slots of the
+// window at KMAPBASE until they are released with kunmap.
+//
+void *
+kmap(struct PageInfo *pp)
+{
+	if (!page_is_highmem(pp))
+		return page2kva(pp);
+
+	for (int i = 0; i < NKMAP; i++) {
+		if (!(kmap_pte[i] & PTE_P)) {
+			void *kva = (void *) (KMAPBASE + i * PGSIZE);
+
+			kmap_pte[i] = page2pa(pp) | PTE_W | PTE_P;
+			invlpg(kva);
+			return kva;
+		}
+	}
+	panic("kmap: all %d slots in use", NKMAP);
+}
+
+// Release an address returned by kmap.
+void
+kunmap(void *kva)
+{
+	uintptr_t va = (uintptr_t) kva;
+
+	if (va < KMAPBASE || va >= KMAPBASE + NKMAP * PGSIZE)
+		return;
+	kmap_pte[(va - KMAPBASE) / PGSIZE] = 0;
+	invlpg(kva);
+}
+
+// Take a reverse mapping entry from the pool, growing it by a page if
+// it is empty.  Returns NULL if no page is free.  It must not reclaim:
+// the callers of page_insert hold pages reclaim could take away.
+static struct Rmap *
+rmap_alloc(void)
+{
+	struct PageInfo *pp;
+	struct Rmap *rm;
+
+	if (!rmap_free_list) {
+		if (!(pp = page_alloc(0)))
+			return NULL;
+		pp->pp_ref++;
+		rm = page2kva(pp);
+		for (size_t i = 0; i < PGSIZE / sizeof(struct Rmap); i++) {
+			rm[i].rm_next = rmap_free_list;
+			rmap_free_list = &rm[i];
+		}
+	}
+	rm = rmap_free_list;
+	rmap_free_list = rm->rm_next;
+	return rm;
+}
+
+// Drop the reverse mapping entry for 'pp' mapped at 'va' in 'pgdir'.
+static void
+rmap_remove(struct PageInfo *pp, pde_t *pgdir, uintptr_t va)
+{
+	struct Rmap **rmp, *rm;
+
+	for (rmp = &pp->pp_rmap; (rm = *rmp); rmp = &rm->rm_next) {
+		if (rm->rm_pgdir == pgdir && rm->rm_va == va) {
+			*rmp = rm->rm_next;
+			rm->rm_next = rmap_free_list;
+			rmap_free_list = rm;
+			return;
+		}
+	}
+}
+
 //
 // Map the physical page 'pp' at virtual address 'va'.
 // The permissions (the low 12 bits) of the page table entry
@@ -549,8 +863,9 @@ int
 page_insert(pde_t *pgdir, struct PageInfo *pp, void *va, int perm)
 {
 	// Fill this function in
+	struct Rmap *rm;
 	pte_t* pte_p = pgdir_walk(pgdir, va, 1);
-	if (!pte_p) {
+	if (!pte_p || !(rm = rmap_alloc())) {
 		return -E_NO_MEM;
 	}
 	//tlb_invalidate(pgdir, va);
@@ -559,6 +874,12 @@ page_insert(pde_t *pgdir, struct PageInfo *pp, void *va, int perm)
 		page_remove(pgdir, va);
 	}
 	*pte_p = page2pa(pp) | perm | PTE_P;
+
+	rm->rm_pgdir = pgdir;
+	rm->rm_va = ROUNDDOWN((uintptr_t) va, PGSIZE);
+	rm->rm_next = pp->pp_rmap;
+	pp->pp_rmap = rm;
+	page_account(pp, pgdir, rm->rm_va, *pte_p, 1);
 	//pgdir[PDX(va)] = PTE_ADDR(pgdir[PDX(va)]) | perm | PTE_P;
 	pgdir[PDX(va)] |= perm;
 
@@ -606,23 +927,107 @@ page_lookup(pde_t *pgdir, void *va, pte_t **pte_store)
 // Hint: The TA solution is implemented using page_lookup,
 // 	tlb_invalidate, and page_decref.
 //
+// A swapped-out page at 'va' is dropped by releasing its swap slot.
+//
 void
 page_remove(pde_t *pgdir, void *va)
 {
 	// Fill this function in
-	struct PageInfo *page = page_lookup(pgdir, va, 0);
+	pte_t *pte_p;
+	struct PageInfo *page = page_lookup(pgdir, va, &pte_p);
 	if (!page) {
+		pte_p = pgdir_walk(pgdir, va, 0);
+		if (pte_p && PTE_IS_SWAPPED(*pte_p)) {
+			swap_free(PTE_SWAPSLOT(*pte_p));
+			*pte_p = 0;
+			if (pgdir2env(pgdir))
+				pgdir2env(pgdir)->env_memstat.ms_swapped--;
+		}
 		return;
 	}
 
+	page_account(page, pgdir, ROUNDDOWN((uintptr_t) va, PGSIZE), *pte_p, -1);
+	rmap_remove(page, pgdir, ROUNDDOWN((uintptr_t) va, PGSIZE));
+
 	page_decref(page);
-	pte_t* pte_p = pgdir_walk(pgdir, va, 0);
-	if (pte_p) {
-		*pte_p = 0;
-	}
+	*pte_p = 0;
 	tlb_invalidate(pgdir, va);
 }
 
+//
+// Unmap everything in [va, end) of 'pgdir', like page_remove on every
+// page but cheaper, for tearing down whole address spaces.  Each page
+// table is walked once, pages whose last reference goes away are put
+// back on the free lists in one go, and instead of an invlpg per page
+// the TLB is flushed once, and only if 'pgdir' is loaded at all.
+// Page tables are left in place.
+//
+// Returns the number of pages freed.
+//
+int
+page_remove_range(pde_t *pgdir, uintptr_t va, uintptr_t end)
+{
+	struct PageInfo *head[2] = { NULL, NULL }, *tail[2] = { NULL, NULL };
+	struct Env *e = pgdir2env(pgdir);
+	size_t nfreed = 0;
+
+	assert(va % PGSIZE == 0 && end <= UTOP);
+	while (va < end) {
+		uintptr_t ptend = MIN(ROUNDDOWN(va, PTSIZE) + PTSIZE, end);
+		pte_t *pt;
+
+		if (!(pgdir[PDX(va)] & PTE_P)) {
+			va = ptend;
+			continue;
+		}
+		pt = KADDR(PTE_ADDR(pgdir[PDX(va)]));
+
+		for (; va < ptend; va += PGSIZE) {
+			pte_t *pte = &pt[PTX(va)];
+			struct PageInfo *pp;
+			int high;
+
+			if (!*pte)
+				continue;
+			if (PTE_IS_SWAPPED(*pte)) {
+				swap_free(PTE_SWAPSLOT(*pte));
+				*pte = 0;
+				if (e)
+					e->env_memstat.ms_swapped--;
+				continue;
+			}
+
+			pp = pa2page(PTE_ADDR(*pte));
+			page_account(pp, pgdir, va, *pte, -1);
+			rmap_remove(pp, pgdir, va);
+			*pte = 0;
+			if (--pp->pp_ref)
+				continue;
+
+			high = page_is_highmem(pp);
+			pp->pp_link = head[high];
+			head[high] = pp;
+			if (!tail[high])
+				tail[high] = pp;
+			nfreed++;
+		}
+	}
+
+	if (tail[0]) {
+		tail[0]->pp_link = page_free_list;
+		page_free_list = head[0];
+	}
+	if (tail[1]) {
+		tail[1]->pp_link = highmem_free_list;
+		highmem_free_list = head[1];
+	}
+	page_free_count += nfreed;
+
+	if (rcr3() == pgdir_cr3(pgdir))
+		lcr3(pgdir_cr3(pgdir));
+	return nfreed;
+}
+
 
 //
 // Invalidate a TLB entry, but only if the page tables being
@@ -648,7 +1053,8 @@ mmio_map_region(physaddr_t pa, size_t size)
 	// beginning of the MMIO region.  Because this is static, its
 	// value will be preserved between calls to mmio_map_region
 	// (just like nextfree in boot_alloc).
-	static uintptr_t base = MMIOBASE; base=base;
+	static uintptr_t base = MMIOBASE;
+	uintptr_t va = base;
 
 	// Reserve size bytes of virtual memory starting at base and
 	// map physical pages [pa,pa+size) to virtual addresses
@@ -668,7 +1074,133 @@ mmio_map_region(physaddr_t pa, size_t size)
 	// Hint: The staff solution uses boot_map_region.
 	//
 	// Your code here:
-	panic("mmio_map_region not implemented");
+	size = ROUNDUP(pa + size, PGSIZE) - ROUNDDOWN(pa, PGSIZE);
+	if (base + size > MMIOLIM || base + size < base)
+		panic("mmio_map_region: %u bytes at 0x%08llx overflow MMIOLIM",
+		      size, (uint64_t) pa);
+	boot_map_region(kern_pgdir, base, size, ROUNDDOWN(pa, PGSIZE),
+			PTE_PCD | PTE_PWT | PTE_W);
+	base += size;
+	return (void *) (va + PGOFF(pa));
+}
+
+// Number of pages mapped around a demand-zero fault, the faulting one
+// included.  Neighbours are only filled in when they belong to the same
+// region and the same page table, so prefaulting never allocates
+// page tables on its own.
+#define VM_PREFAULT_CLUSTER	4
+
+static struct VmReserve *
+vm_reserve_lookup(struct Env *env, uintptr_t va)
+{
+	for (int i = 0; i < NVMRESERVE; i++) {
+		struct VmReserve *vr = &env->env_vm_reserve[i];
+		if (vr->vr_start <= va && va < vr->vr_end)
+			return vr;
+	}
+	return NULL;
+}
+
+//
+// Resolve a fault on a not-present page at 'va' in a region that 'env'
+// reserved with sys_vm_reserve: map a fresh zeroed page there, and
+// also zero-fill up to VM_PREFAULT_CLUSTER - 1 following pages that
+// are still unmapped, so sequential first touches take fewer traps.
+//
+// Returns 0 if the page is now mapped, -E_FAULT if 'va' is not in a
+// reserved region or is already mapped, -E_NO_MEM on memory shortage.
+//
+int
+vm_reserve_fault(struct Env *env, uintptr_t va)
+{
+	struct VmReserve *vr;
+	struct PageInfo *pp;
+	pte_t *pte;
+
+	if (va >= UTOP || !(vr = vm_reserve_lookup(env, va)))
+		return -E_FAULT;
+
+	va = ROUNDDOWN(va, PGSIZE);
+	pte = pgdir_walk(env->env_pgdir, (void *) va, 1);
+	if (!pte)
+		return -E_NO_MEM;
+	// Present or swapped out: not a first touch.
+	if (*pte)
+		return -E_FAULT;
+	if (!(pp = page_alloc(ALLOC_ZERO | ALLOC_HIGHMEM)) &&
+	    (page_reclaim(RECLAIM_BATCH) == 0 ||
+	     !(pp = page_alloc(ALLOC_ZERO | ALLOC_HIGHMEM))))
+		return -E_NO_MEM;
+	if (page_insert(env->env_pgdir, pp, (void *) va, vr->vr_perm) < 0) {
+		page_free(pp);
+		return -E_NO_MEM;
+	}
+
+	for (int i = 1; i < VM_PREFAULT_CLUSTER; i++) {
+		uintptr_t nva = va + i * PGSIZE;
+
+		if (nva >= vr->vr_end || PDX(nva) != PDX(va))
+			break;
+		pte = pgdir_walk(env->env_pgdir, (void *) nva, 0);
+		if (*pte)
+			continue;
+		// Prefaulting is only an optimization, stop quietly
+		// when memory runs short.
+		if (!(pp = page_alloc(ALLOC_ZERO | ALLOC_HIGHMEM)))
+			break;
+		if (page_insert(env->env_pgdir, pp, (void *) nva, vr->vr_perm) < 0) {
+			page_free(pp);
+			break;
+		}
+	}
+
+	return 0;
+}
+
+//
+// Give 'pgdir' a private, writable copy of the copy-on-write page at
+// 'va'.  Used when the kernel itself writes to user memory, and for
+// environments whose pages were merged by kern/merge.c.
+//
+// Returns 0 on success, -E_FAULT if 'va' is not mapped PTE_COW,
+// -E_NO_MEM if no page can be found for the copy.
+//
+int
+page_cow_break(pde_t *pgdir, void *va)
+{
+	struct PageInfo *old, *pp;
+	uintptr_t pgva = ROUNDDOWN((uintptr_t) va, PGSIZE);
+	void *src, *dst;
+	pte_t *pte;
+	int perm, r;
+
+	if (!(old = page_lookup(pgdir, va, &pte)) || !(*pte & PTE_COW))
+		return -E_FAULT;
+	perm = (*pte & PTE_SYSCALL & ~(PTE_COW | PTE_P)) | PTE_W;
+
+	// The last mapping can simply be made writable.
+	if (old->pp_ref == 1) {
+		page_account(old, pgdir, pgva, *pte, -1);
+		*pte = page2pa(old) | perm | PTE_P;
+		page_account(old, pgdir, pgva, *pte, 1);
+		tlb_invalidate(pgdir, va);
+		return 0;
+	}
+
+	if (!(pp = page_alloc(ALLOC_HIGHMEM)) &&
+	    (page_reclaim(RECLAIM_BATCH) == 0 ||
+	     !(pp = page_alloc(ALLOC_HIGHMEM))))
+		return -E_NO_MEM;
+	src = kmap(old);
+	dst = kmap(pp);
+	memmove(dst, src, PGSIZE);
+	kunmap(dst);
+	kunmap(src);
+	if ((r = page_insert(pgdir, pp, (void *) pgva, perm)) < 0) {
+		page_free(pp);
+		return r;
+	}
+	return 0;
 }
 
 static uintptr_t user_mem_check_addr;
@@ -688,6 +1220,11 @@ static uintptr_t user_mem_check_addr;
 // If there is an error, set the 'user_mem_check_addr' variable to the first
 // erroneous virtual address.
 //
+// Swapped-out pages and pages of demand-zero regions that were never
+// touched are faulted in here, and copy-on-write pages are copied when
+// 'perm' asks for PTE_W, so the kernel may access them on the user's
+// behalf.
+//
 // Returns 0 if the user program can access this range of addresses,
 // and -E_FAULT otherwise.
 //
@@ -701,6 +1238,12 @@ user_mem_check(struct Env *env, const void *va, size_t len, int perm)
 		 i = ROUNDDOWN(i + PGSIZE, PGSIZE)
 	) {
 		pte_t* pte_p = pgdir_walk(env->env_pgdir, (void*) i, 0);
+		if ((!pte_p || !(*pte_p & PTE_P)) && i < UTOP &&
+		    (page_swapin(env->env_pgdir, (void *) i) == 0 ||
+		     vm_reserve_fault(env, i) == 0))
+			pte_p = pgdir_walk(env->env_pgdir, (void*) i, 0);
+		if (pte_p && (perm & PTE_W) && (*pte_p & PTE_COW) && i < UTOP)
+			page_cow_break(env->env_pgdir, (void *) i);
 		if (!pte_p || i > ULIM || (int)(*pte_p & perm) != perm) {
 			user_mem_check_addr = i;
 			return -E_FAULT;
@@ -720,11 +1263,96 @@ user_mem_check(struct Env *env, const void *va, size_t len, int perm)
 void
 user_mem_assert(struct Env *env, const void *va, size_t len, int perm)
 {
-	if (user_mem_check(env, va, len, perm | PTE_U) < 0) {
-		cprintf("[%08x] user_mem_check assertion failure for "
-			"va %08x\n", env->env_id, user_mem_check_addr);
-		env_destroy(env);	// may not return
+	if (user_mem_check(env, va, len, perm | PTE_U) < 0)
+		user_mem_fault(env);
+}
+
+//
+// Destroy 'env' after a failed user_mem_check, copy_from_user,
+// copy_to_user or user_mem_probe, reporting the offending address.
+// If env is the current environment, this function will not return.
+//
+void
+user_mem_fault(struct Env *env)
+{
+	cprintf("[%08x] user_mem_check assertion failure for "
+		"va %08x\n", env->env_id, user_mem_check_addr);
+	env_destroy(env);	// may not return
+}
+
+// kern/usercopy.S
+int	user_copy(void *dst, const void *src, size_t len);
+int	user_probe(const void *va, size_t len);
+
+// User addresses must stay below ULIM.  Pages between UTOP and ULIM
+// are read-only to the user, so the processor (with CR0_WP) refuses
+// kernel writes there too.
+static int
+user_range_check(const void *va, size_t len)
+{
+	uintptr_t start = (uintptr_t) va;
+
+	if (start >= ULIM || len > ULIM - start) {
+		user_mem_check_addr = MAX(start, ULIM);
+		return -E_FAULT;
 	}
+	return 0;
+}
+
+// Record where a faulting user access went wrong: like user_mem_check,
+// the start of the range or the first bad page after it.
+static int
+user_access_failed(const void *va)
+{
+	user_mem_check_addr = MAX((uintptr_t) va, ROUNDDOWN(rcr2(), PGSIZE));
+	return -E_FAULT;
+}
+
+//
+// Copy 'len' bytes from user address 'usrc' to the kernel buffer 'dst'
+// (or the other way around for copy_to_user).  The access is simply
+// performed; pages are faulted in as if the user touched them, and a
+// fault that can't be resolved makes the copy stop early.
+//
+// Returns 0 on success, -E_FAULT if part of the user range is not
+// accessible.
+//
+int
+copy_from_user(void *dst, const void *usrc, size_t len)
+{
+	if (user_range_check(usrc, len) < 0)
+		return -E_FAULT;
+	if (user_copy(dst, usrc, len) < 0)
+		return user_access_failed(usrc);
+	return 0;
+}
+
+int
+copy_to_user(void *udst, const void *src, size_t len)
+{
+	if (user_range_check(udst, len) < 0)
+		return -E_FAULT;
+	if (user_copy(udst, src, len) < 0)
+		return user_access_failed(udst);
+	return 0;
+}
+
+//
+// Check that all of [va, va+len) is readable by the user, faulting in
+// its pages, by reading a byte from each page.
+//
+// Returns 0 on success, -E_FAULT otherwise.
+//
+int
+user_mem_probe(const void *va, size_t len)
+{
+	if (!len)
+		return 0;
+	if (user_range_check(va, len) < 0)
+		return -E_FAULT;
+	if (user_probe(va, len) < 0)
+		return user_access_failed(va);
+	return 0;
 }
 
 
@@ -891,11 +1519,11 @@ check_kern_pgdir(void)
 	for (i = 0; i < n; i += PGSIZE)
 		assert(check_va2pa(pgdir, UENVS + i) == (PADDR(envs) + i));
 	// check phys mem
-	for (i = 0; i < npages * PGSIZE; i += PGSIZE)
+	for (i = 0; i < npages_lowmem * PGSIZE; i += PGSIZE)
 		assert(check_va2pa(pgdir, KERNBASE + i) == i);
 	//check kernel stack
 	for (i = 0; i < KSTKSIZE; i += PGSIZE) {
-		cprintf("%d\n", check_va2pa(pgdir, KSTACKTOP - KSTKSIZE + i));
+		cprintf("%d\n", (int) check_va2pa(pgdir, KSTACKTOP - KSTKSIZE + i));
 		assert(
 			check_va2pa(pgdir, KSTACKTOP - KSTKSIZE + i) == 
 			PADDR(bootstack) + i
@@ -903,11 +1531,17 @@ check_kern_pgdir(void)
 	}
 	assert(check_va2pa(pgdir, KSTACKTOP - PTSIZE) == ~0);
 	// check PDE permissions
+	n = ROUNDUP(npages*sizeof(struct PageInfo), PGSIZE);
 	for (i = 0; i < NPDENTRIES; i++) {
+		// UVPT and UPAGES may take more than one page table.
+		if ((i >= PDX(UVPT) && i < PDX(UVPT + UVPTSIZE)) ||
+		    (i >= PDX(UPAGES) && i <= PDX(UPAGES + n - 1)) ||
+		    i == PDX(KMAPBASE)) {
+			assert(pgdir[i] & PTE_P);
+			continue;
+		}
 		switch (i) {
-		case PDX(UVPT):
 		case PDX(KSTACKTOP-1):
-		case PDX(UPAGES):
 		case PDX(UENVS):
 		case PDX(UVSYS):
 			assert(pgdir[i] & PTE_P);
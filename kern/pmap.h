@@ -14,6 +14,8 @@ extern char bootstacktop[], bootstack[];
 
 extern struct PageInfo *pages;
 extern size_t npages;
+extern size_t npages_lowmem;
+extern size_t page_free_count;
 
 extern pde_t *kern_pgdir;
 
@@ -30,7 +32,7 @@ _paddr(const char *file, int line, void *kva)
 {
 	if ((uint32_t)kva < KERNBASE)
 		_panic(file, line, "PADDR called with invalid kva %p", kva);
-	return (physaddr_t)kva - KERNBASE;
+	return (physaddr_t) ((uintptr_t) kva - KERNBASE);
 }
 
 /* This macro takes a physical address and returns the corresponding kernel
@@ -40,24 +42,43 @@ _paddr(const char *file, int line, void *kva)
 static inline void*
 _kaddr(const char *file, int line, physaddr_t pa)
 {
-	if (PGNUM(pa) >= npages) {
+	if (pa >> PGSHIFT >= npages_lowmem) {
 		_panic(
 			file,
 			line, 
-			"KADDR called with invalid pa %p - page number"\
-			" is %d while only %d pages available\n",
-			(void *) pa,
-			PGNUM(pa),
-			npages
+			"KADDR called with invalid pa %llx - page number"\
+			" is %llu while only %d pages are mapped\n",
+			(uint64_t) pa,
+			(uint64_t) pa >> PGSHIFT,
+			npages_lowmem
 		);
 	}
-	return (void *)(pa + KERNBASE);
+	return (void *)(uintptr_t)(pa + KERNBASE);
 }
 
 
+// Reverse mapping entry: one per page table entry that maps a page
+// through page_insert.  Lets the reclaimer find and update every
+// mapping of a physical page.
+struct Rmap {
+	pde_t *rm_pgdir;
+	uintptr_t rm_va;
+	struct Rmap *rm_next;
+};
+
+// A not-present user PTE with PTE_SWAPPED set describes a page that was
+// swapped out: the address bits hold the swap slot number and the low
+// bits keep the page's PTE_U and PTE_W permissions.
+#define PTE_SWAPPED		0x200
+#define PTE_SWAPSLOT(pte)	((uint32_t) (pte) >> PGSHIFT)
+#define PTE_IS_SWAPPED(pte)	(((pte) & (PTE_P | PTE_SWAPPED)) == PTE_SWAPPED)
+
 enum {
 	// For page_alloc, zero the returned physical page.
 	ALLOC_ZERO = 1<<0,
+	// For page_alloc, the page may lie above the KERNBASE direct map,
+	// so the kernel can only reach it through kmap.
+	ALLOC_HIGHMEM = 1<<1,
 };
 
 void	mem_init(void);
@@ -67,28 +88,46 @@ struct PageInfo *page_alloc(int alloc_flags);
 void	page_free(struct PageInfo *pp);
 int	page_insert(pde_t *pgdir, struct PageInfo *pp, void *va, int perm);
 void	page_remove(pde_t *pgdir, void *va);
+int	page_remove_range(pde_t *pgdir, uintptr_t va, uintptr_t end);
 struct PageInfo *page_lookup(pde_t *pgdir, void *va, pte_t **pte_store);
 void	page_decref(struct PageInfo *pp);
 
 void	tlb_invalidate(pde_t *pgdir, void *va);
 
+void *	kmap(struct PageInfo *pp);
+void	kunmap(void *kva);
+
 void *	mmio_map_region(physaddr_t pa, size_t size);
 
+int	vm_reserve_fault(struct Env *env, uintptr_t va);
+int	page_cow_break(pde_t *pgdir, void *va);
+
 int	user_mem_check(struct Env *env, const void *va, size_t len, int perm);
 void	user_mem_assert(struct Env *env, const void *va, size_t len, int perm);
+void	user_mem_fault(struct Env *env);
+int	user_mem_probe(const void *va, size_t len);
+int	copy_from_user(void *dst, const void *usrc, size_t len);
+int	copy_to_user(void *udst, const void *src, size_t len);
 
 static inline physaddr_t
 page2pa(struct PageInfo *pp)
 {
-	return (pp - pages) << PGSHIFT;
+	return (physaddr_t) (pp - pages) << PGSHIFT;
 }
 
 static inline struct PageInfo*
 pa2page(physaddr_t pa)
 {
-	if (PGNUM(pa) >= npages)
+	if (pa >> PGSHIFT >= npages)
 		panic("pa2page called with invalid pa");
-	return &pages[PGNUM(pa)];
+	return &pages[pa >> PGSHIFT];
+}
+
+// Pages from npages_lowmem on are not in the KERNBASE direct map.
+static inline bool
+page_is_highmem(struct PageInfo *pp)
+{
+	return (size_t) (pp - pages) >= npages_lowmem;
 }
 
 static inline void*
@@ -98,5 +137,18 @@ page2kva(struct PageInfo *pp)
 }
 
 pte_t *pgdir_walk(pde_t *pgdir, const void *va, int create);
+struct Env *pgdir2env(pde_t *pgdir);
+pde_t *	pgdir_alloc(struct Env *e);
+void	pgdir_free(pde_t *pgdir);
+
+// The value of %cr3 that loads 'pgdir', and back.  With PAE, %cr3
+// points to the page directory pointer table of 'pgdir' instead.
+#ifdef CONFIG_PAE
+physaddr_t pgdir_cr3(pde_t *pgdir);
+pde_t *	cr3_pgdir(physaddr_t cr3);
+#else
+#define pgdir_cr3(pgdir)	PADDR(pgdir)
+#define cr3_pgdir(cr3)		((pde_t *) KADDR(cr3))
+#endif
 
 #endif /* !JOS_KERN_PMAP_H */
@@ -0,0 +1,179 @@
+/* See COPYRIGHT for copyright information. */
+
+// Statistical sampling profiler.  While it is on, the clock interrupts
+// record the interrupted eip and the return addresses found by walking
+// the frame pointer chain into a ring buffer, which user/prof drains
+// with sys_prof_read and symbolizes with sys_prof_symbol.
+//
+// With a local APIC timer, a periodic hrtimer raises IRQ_TIMER at the
+// sampling rate.  Otherwise only the RTC interrupt (RTC_HZ) samples.
+
+#include <inc/x86.h>
+#include <inc/error.h>
+#include <inc/string.h>
+#include <inc/memlayout.h>
+
+#include <kern/prof.h>
+#include <kern/env.h>
+#include <kern/pmap.h>
+#include <kern/kdebug.h>
+#include <kern/hrtimer.h>
+#include <kern/lapic.h>
+#include <kern/time.h>
+
+#define PROF_NSAMPLES	1024
+
+// The machine has a single CPU, so one ring serves as the per-CPU
+// buffer.  prof_head and prof_tail run freely and are reduced modulo
+// PROF_NSAMPLES on access; samples taken while it is full are dropped.
+static struct ProfSample prof_ring[PROF_NSAMPLES];
+static uint32_t prof_head, prof_tail;
+
+static uint64_t prof_period;		// ns between samples, 0 when off
+static uint64_t prof_due;		// CLOCK_MONOTONIC of the next sample
+static struct hrtimer prof_timer;
+
+static void
+prof_expired(struct hrtimer *t)
+{
+	// Only here to raise IRQ_TIMER; prof_sample does the work.
+	hrtimer_start(t, MAX(t->ht_expires, clock_monotonic()) + prof_period);
+}
+
+//
+// Start sampling 'hz' times a second, or stop if 'hz' is 0.  Samples
+// left in the ring from an earlier run are discarded.
+//
+// Returns 0 on success, -E_INVAL if 'hz' is above PROF_MAXHZ.
+//
+int
+prof_start(unsigned hz)
+{
+	if (hz > PROF_MAXHZ)
+		return -E_INVAL;
+
+	hrtimer_cancel(&prof_timer);
+	prof_period = hz ? NANOSECONDS / hz : 0;
+	if (!hz)
+		return 0;
+
+	prof_head = prof_tail = 0;
+	prof_due = clock_monotonic();
+	if (lapic_timer) {
+		prof_timer.ht_fn = prof_expired;
+		hrtimer_start(&prof_timer, prof_due + prof_period);
+	}
+	return 0;
+}
+
+// Read the word at 'va' through the loaded page table, if it is mapped.
+// Frames of user mode code must be in user memory.
+static bool
+prof_peek(uintptr_t va, bool user, uintptr_t *val)
+{
+	pte_t *pte;
+
+	if ((va & 3) || (user && va >= ULIM))
+		return false;
+	pte = pgdir_walk(cr3_pgdir(rcr3()), (void *) va, 0);
+	if (!pte || !(*pte & PTE_P) || (user && !(*pte & PTE_U)))
+		return false;
+	*val = *(const uintptr_t *) va;
+	return true;
+}
+
+//
+// Called from the clock interrupts with the interrupted trap frame:
+// record a sample if one is due.
+//
+void
+prof_sample(struct Trapframe *tf)
+{
+	struct ProfSample *ps;
+	bool user = (tf->tf_cs & 3) == 3;
+	uintptr_t ebp, next;
+	uint64_t now;
+
+	if (!prof_period)
+		return;
+	// IRQ_TIMER also fires for other timers; half a period of slack
+	// absorbs the jitter of the profiling timer itself.
+	now = clock_monotonic();
+	if (now + prof_period / 2 < prof_due)
+		return;
+	prof_due = now + prof_period;
+	if (prof_head - prof_tail == PROF_NSAMPLES)
+		return;
+
+	ps = &prof_ring[prof_head % PROF_NSAMPLES];
+	ps->ps_env = curenv && curenv->env_status == ENV_RUNNING ?
+		curenv->env_id : 0;
+	ps->ps_pc[0] = tf->tf_eip;
+	ps->ps_depth = 1;
+
+	// Frames move towards higher addresses; anything else ends the walk.
+	for (ebp = tf->tf_regs.reg_ebp; ps->ps_depth < PROF_DEPTH; ebp = next) {
+		if (!ebp || !prof_peek(ebp, user, &next) ||
+		    !prof_peek(ebp + 4, user, &ps->ps_pc[ps->ps_depth]))
+			break;
+		ps->ps_depth++;
+		if (next <= ebp)
+			break;
+	}
+	prof_head++;
+}
+
+//
+// Copy up to 'n' samples, oldest first, to 'usamples' and remove them
+// from the ring.
+//
+// Returns the number of samples copied, or -E_FAULT if 'usamples'
+// cannot be written.
+//
+int
+prof_read(struct ProfSample *usamples, size_t n)
+{
+	int copied = 0;
+
+	for (; copied < (int) n && prof_tail != prof_head; copied++) {
+		if (copy_to_user(usamples + copied,
+				 &prof_ring[prof_tail % PROF_NSAMPLES],
+				 sizeof(struct ProfSample)) < 0)
+			return -E_FAULT;
+		prof_tail++;
+	}
+	return copied;
+}
+
+//
+// Find the function containing 'pc' in environment 'envid', from the
+// kernel stabs or those of the environment's binary.
+//
+// Returns 0 on success, -E_BAD_ENV if a user 'pc' belongs to an
+// environment that no longer exists.
+//
+int
+prof_symbol(envid_t envid, uintptr_t pc, struct ProfSymbol *sym)
+{
+	struct Eipdebuginfo info;
+	struct Env *e = NULL;
+	int r;
+
+	if (pc < ULIM) {
+		if ((r = envid2env(envid, &e, 0)) < 0 || !envid)
+			return -E_BAD_ENV;
+		if (e != curenv)
+			lcr3(pgdir_cr3(e->env_pgdir));
+	}
+
+	// The name lives in the stabs of 'e', read it before switching back.
+	debuginfo_env_eip(e, pc, &info);
+	memset(sym, 0, sizeof(*sym));
+	strncpy(sym->psym_name, info.eip_fn_name,
+		MIN(info.eip_fn_namelen, (int) sizeof(sym->psym_name) - 1));
+	sym->psym_addr = info.eip_fn_addr;
+
+	if (e && e != curenv)
+		lcr3(pgdir_cr3(curenv->env_pgdir));
+	return 0;
+}
@@ -0,0 +1,17 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_PROF_H
+#define JOS_KERN_PROF_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/prof.h>
+#include <inc/trap.h>
+
+int	prof_start(unsigned hz);
+void	prof_sample(struct Trapframe *tf);
+int	prof_read(struct ProfSample *usamples, size_t n);
+int	prof_symbol(envid_t envid, uintptr_t pc, struct ProfSymbol *sym);
+
+#endif	// !JOS_KERN_PROF_H
@@ -8,11 +8,58 @@
 #include <kern/picirq.h>
 #include <kern/time.h>
 #include <kern/tsc.h>
+#include <kern/pmap.h>
+#include <kern/swap.h>
+#include <kern/merge.h>
+#include <kern/hrtimer.h>
+#include <kern/lapic.h>
 
 
 struct Taskstate cpu_ts;
 void sched_halt(void);
 
+static struct hrtimer sleep_timer[NENV];	// Per env, for clock_nanosleep
+static struct Env *sched_next;			// Run this one next
+
+// Have the next sched_yield run 'e', which a timer just made ready,
+// before any other environment.
+void
+sched_run_next(struct Env *e)
+{
+	sched_next = e;
+}
+
+static void
+sleep_expired(struct hrtimer *t)
+{
+	struct Env *e = &envs[t - sleep_timer];
+
+	e->env_sleep_clock_type = 0;
+	e->env_status = ENV_RUNNABLE;
+	sched_run_next(e);
+}
+
+// Put 'e' to sleep until CLOCK_MONOTONIC reaches 'until' nanoseconds.
+// 'clock' is the clock the caller asked for, for the record.
+void
+sched_sleep(struct Env *e, uint64_t until, int clock)
+{
+	struct hrtimer *t = &sleep_timer[ENVX(e->env_id)];
+
+	e->env_sleep_until = until;
+	e->env_sleep_clock_type = clock;
+	e->env_status = ENV_NOT_RUNNABLE;
+	t->ht_fn = sleep_expired;
+	hrtimer_start(t, until);
+}
+
+void
+sched_sleep_cancel(struct Env *e)
+{
+	hrtimer_cancel(&sleep_timer[ENVX(e->env_id)]);
+	e->env_sleep_clock_type = 0;
+}
+
 
 // Choose a user environment to run and run it.
 void
@@ -35,40 +82,38 @@ sched_yield(void)
 	//LAB 3: Your code here.
 	// debug_mem();
 	// show_env(curenv);
-	int sleeping_process_exists = 0;
-	long long monotonic_time = nanosec_from_timer() - monotonic_time_start;
-	curenv->env_time.tv_nsec += nanosec_from_timer() - curenv->env_time_start;
-	normalize_time(&curenv->env_time);
 
-	// check if we need to wakeup sleeping process
-	time_t current_time = gettime();
+	// Keep a reserve of free pages so that allocations in the kernel
+	// (page tables, fault handling) rarely find the free list empty.
+	if (page_free_count < RECLAIM_LOW)
+		page_reclaim(RECLAIM_BATCH);
+	page_merge_scan(MERGE_BATCH);
+	env_reap(REAP_BATCH);
+
+	if (curenv) {
+		curenv->env_time.tv_nsec += nanosec_from_timer() - curenv->env_time_start;
+		normalize_time(&curenv->env_time);
+	}
 
-	// we don't want to halt while have some sleeping processes
+	// Without a timer interrupt to wake the CPU, poll for sleeping
+	// environments instead of halting.
 	do {
-	 	sleeping_process_exists = 0;
-		for (int i = 0;  i < NENV; i++) {
-			if (envs[i].env_status == ENV_NOT_RUNNABLE && envs[i].env_sleep_clock_type) {
-				sleeping_process_exists = 1;
-				switch(envs[i].env_sleep_clock_type) {
-					case CLOCK_REALTIME:
-						if (current_time > envs[i].env_sleep_until) {
-							envs[i].env_sleep_clock_type = 0;
-							envs[i].env_status = ENV_RUNNABLE;
-						}
-						break;
-					case CLOCK_MONOTONIC:
-						if (monotonic_time > envs[i].env_sleep_until) {
-
-							envs[i].env_sleep_clock_type = 0;
-							envs[i].env_status = ENV_RUNNABLE;
-						}
-						break;
-				}
-			}
-		}
+		// wake up sleeping environments whose time has come
+		hrtimer_run();
 
 		struct Env* next_env = NULL;
-		int curr = (int) (curenv - envs);
+		int curr = curenv ? (int) (curenv - envs) : 0;
+
+		// An environment a timer is for goes first, so that it runs
+		// as close to the deadline as possible.
+		if (sched_next && (sched_next->env_status == ENV_RUNNABLE ||
+				   sched_next->env_status == ENV_RUNNING)) {
+			next_env = sched_next;
+			sched_next = NULL;
+			goto run_env;
+		}
+		sched_next = NULL;
+
 		for (int i = curr; i < NENV; i++) {
 			if (envs[i].env_status == ENV_RUNNABLE) {
 				next_env = &envs[i];
@@ -81,7 +126,7 @@ sched_yield(void)
 				goto run_env;
 			}
 		}
-		if(!next_env && 
+		if(!next_env && curenv &&
 			(curenv->env_status == ENV_RUNNING || 
 				curenv->env_status == ENV_RUNNABLE)) {
 			next_env = curenv;
@@ -92,12 +137,7 @@ run_env:
 			// show_env(next_env);
 			env_run(next_env);
 		}
-		if (sleeping_process_exists) {
-			monotonic_time = nanosec_from_timer() - monotonic_time_start;
-			current_time = gettime();
-		}
-	
-	} while (sleeping_process_exists);
+	} while (!lapic_timer && hrtimer_pending());
 
 	// sched_halt never returns
 	sched_halt();
@@ -111,12 +151,17 @@ sched_halt(void)
 {
 	int i;
 
+	// Nothing else to do: finish tearing down destroyed environments.
+	env_reap(-1);
+
 	// For debugging and testing purposes, if there are no runnable
 	// environments in the system, then drop into the kernel monitor.
 	for (i = 0; i < NENV; i++) {
 		if ((envs[i].env_status == ENV_RUNNABLE ||
 		     envs[i].env_status == ENV_RUNNING ||
-		     envs[i].env_status == ENV_DYING))
+		     envs[i].env_status == ENV_DYING ||
+		     envs[i].env_sleep_clock_type ||
+		     envs[i].env_irq_wait))
 			break;
 	}
 	if (i == NENV) {
@@ -128,14 +173,19 @@ sched_halt(void)
 	// Mark that no environment is running on CPU
 	curenv = NULL;
 
-	// Reset stack pointer, enable interrupts and then halt.
+	// Reset stack pointer, enable interrupts and then halt.  cpu_ts
+	// is never loaded, the TSS in use has KSTACKTOP as its ts_esp0.
+	// Interrupts that do not schedule (keyboard, serial) return to the
+	// loop.
 	asm volatile (
 		"movl $0, %%ebp\n"
 		"movl %0, %%esp\n"
 		"pushl $0\n"
 		"pushl $0\n"
 		"sti\n"
+		"1:\n"
 		"hlt\n"
-	: : "a" (cpu_ts.ts_esp0));
+		"jmp 1b\n"
+	: : "a" (KSTACKTOP));
 }
 
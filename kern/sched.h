@@ -6,7 +6,13 @@
 # error "This is a JOS kernel header; user programs should not #include it"
 #endif
 
+#include <inc/env.h>
+
 // This function does not return.
 void sched_yield(void) __attribute__((noreturn));
 
+void sched_sleep(struct Env *e, uint64_t until, int clock);
+void sched_sleep_cancel(struct Env *e);
+void sched_run_next(struct Env *e);
+
 #endif	// !JOS_KERN_SCHED_H
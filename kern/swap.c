@@ -0,0 +1,291 @@
+/* See COPYRIGHT for copyright information. */
+
+// Page reclaim under memory pressure.
+//
+// Pages are aged CLOCK-style: a hand sweeps over 'pages', clearing the
+// PTE_A bit of every mapping of a page (found through the reverse map
+// kept by page_insert) and reclaiming pages whose mappings were not
+// accessed since the previous sweep.  Clean block cache pages of the
+// file server are simply dropped, bc_pgfault reads them back from disk;
+// other user pages are written to a swap area on the secondary IDE
+// master and their PTE is replaced by a PTE_SWAPPED entry.
+
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/error.h>
+#include <inc/string.h>
+#include <inc/assert.h>
+#include <inc/fs.h>
+
+#include <kern/pmap.h>
+#include <kern/env.h>
+#include <kern/swap.h>
+
+// PIO access to the swap disk, see fs/ide.c for the primary channel.
+#define SWAP_IOBASE	0x170
+#define SECTSIZE	512
+#define SWAP_SLOTSECTS	(PGSIZE / SECTSIZE)
+
+#define IDE_BSY		0x80
+#define IDE_DRDY	0x40
+#define IDE_DF		0x20
+#define IDE_DRQ		0x08
+#define IDE_ERR		0x01
+
+// Upper bound on the swap area: 128MB.
+#define SWAP_MAXSLOTS	32768
+
+struct SwapStat swapstat;
+
+static uint32_t swap_map[SWAP_MAXSLOTS / 32];	// bit set = slot in use
+static uint32_t swap_hint;			// where swap_alloc looks first
+
+static int
+swap_wait_ready(bool check_error)
+{
+	int r;
+
+	while (((r = inb(SWAP_IOBASE + 7)) & (IDE_BSY|IDE_DRDY)) != IDE_DRDY)
+		/* do nothing */;
+
+	if (check_error && (r & (IDE_DF|IDE_ERR)) != 0)
+		return -E_UNSPECIFIED;
+	return 0;
+}
+
+// Read or write one page-sized slot of the swap area.
+static int
+swap_io(uint32_t slot, void *buf, bool write)
+{
+	uint32_t secno = slot * SWAP_SLOTSECTS;
+	int nsecs, r;
+
+	swap_wait_ready(0);
+
+	outb(SWAP_IOBASE + 2, SWAP_SLOTSECTS);
+	outb(SWAP_IOBASE + 3, secno & 0xFF);
+	outb(SWAP_IOBASE + 4, (secno >> 8) & 0xFF);
+	outb(SWAP_IOBASE + 5, (secno >> 16) & 0xFF);
+	outb(SWAP_IOBASE + 6, 0xE0 | ((secno >> 24) & 0x0F));
+	outb(SWAP_IOBASE + 7, write ? 0x30 : 0x20);
+
+	for (nsecs = SWAP_SLOTSECTS; nsecs > 0; nsecs--, buf += SECTSIZE) {
+		if ((r = swap_wait_ready(1)) < 0)
+			return r;
+		if (write)
+			outsl(SWAP_IOBASE, buf, SECTSIZE / 4);
+		else
+			insl(SWAP_IOBASE, buf, SECTSIZE / 4);
+	}
+
+	return 0;
+}
+
+// Look for a disk on the secondary master and size the swap area
+// from its IDENTIFY data.  Without one, only clean block cache pages
+// can be reclaimed.
+void
+swap_init(void)
+{
+	static uint16_t ident[SECTSIZE / 2];
+	uint32_t nsecs;
+	int r, x;
+
+	outb(SWAP_IOBASE + 6, 0xE0);
+	if ((r = inb(SWAP_IOBASE + 7)) == 0xFF || r == 0)
+		goto none;
+
+	outb(SWAP_IOBASE + 2, 0);
+	outb(SWAP_IOBASE + 3, 0);
+	outb(SWAP_IOBASE + 4, 0);
+	outb(SWAP_IOBASE + 5, 0);
+	outb(SWAP_IOBASE + 7, 0xEC);	// CMD 0xEC means identify device
+	for (x = 0;
+	     x < 100000 && ((r = inb(SWAP_IOBASE + 7)) & IDE_BSY);
+	     x++)
+		/* do nothing */;
+	if (r == 0 || (r & (IDE_BSY|IDE_ERR)) || !(r & IDE_DRQ))
+		goto none;
+	insl(SWAP_IOBASE, ident, SECTSIZE / 4);
+
+	// Words 60-61 hold the number of LBA28 addressable sectors.
+	nsecs = ident[60] | ((uint32_t) ident[61] << 16);
+	swapstat.ss_nslots = MIN(nsecs / SWAP_SLOTSECTS, SWAP_MAXSLOTS);
+	cprintf("swap: %u pages on secondary IDE master\n", swapstat.ss_nslots);
+	return;
+
+none:
+	cprintf("swap: no swap device\n");
+}
+
+static int
+swap_alloc(void)
+{
+	for (uint32_t i = 0; i < swapstat.ss_nslots; i++) {
+		uint32_t slot = (swap_hint + i) % swapstat.ss_nslots;
+
+		if (!(swap_map[slot / 32] & (1 << (slot % 32)))) {
+			swap_map[slot / 32] |= 1 << (slot % 32);
+			swap_hint = slot + 1;
+			swapstat.ss_used++;
+			return slot;
+		}
+	}
+	return -E_NO_MEM;
+}
+
+// Release a swap slot whose page is no longer needed.
+void
+swap_free(uint32_t slot)
+{
+	assert(slot < swapstat.ss_nslots);
+	assert(swap_map[slot / 32] & (1 << (slot % 32)));
+	swap_map[slot / 32] &= ~(1 << (slot % 32));
+	swapstat.ss_used--;
+}
+
+//
+// Bring the swapped-out page at 'va' in 'pgdir' back into memory.
+//
+// Returns 0 on success, -E_FAULT if 'va' is not swapped out,
+// -E_NO_MEM if no page can be found for it, or a disk error.
+//
+int
+page_swapin(pde_t *pgdir, void *va)
+{
+	struct PageInfo *pp;
+	uint32_t slot;
+	pte_t *pte, old;
+	void *kva;
+	int r;
+
+	pte = pgdir_walk(pgdir, va, 0);
+	if (!pte || !PTE_IS_SWAPPED(*pte))
+		return -E_FAULT;
+	if (!(pp = page_alloc(ALLOC_HIGHMEM)) &&
+	    (page_reclaim(RECLAIM_BATCH) == 0 ||
+	     !(pp = page_alloc(ALLOC_HIGHMEM))))
+		return -E_NO_MEM;
+
+	old = *pte;
+	slot = PTE_SWAPSLOT(old);
+	kva = kmap(pp);
+	r = swap_io(slot, kva, 0);
+	kunmap(kva);
+	if (r < 0) {
+		page_free(pp);
+		return r;
+	}
+
+	// Clear the entry first so page_insert doesn't release the slot.
+	*pte = 0;
+	if ((r = page_insert(pgdir, pp, va, old & (PTE_U | PTE_W))) < 0) {
+		*pte = old;
+		page_free(pp);
+		return r;
+	}
+	swap_free(slot);
+	swapstat.ss_swapin++;
+	if (pgdir2env(pgdir))
+		pgdir2env(pgdir)->env_memstat.ms_swapped--;
+
+	return 0;
+}
+
+// Test and clear the accessed bit of every mapping of 'pp'.
+static bool
+page_referenced(struct PageInfo *pp)
+{
+	bool referenced = false;
+
+	for (struct Rmap *rm = pp->pp_rmap; rm; rm = rm->rm_next) {
+		pte_t *pte = pgdir_walk(rm->rm_pgdir, (void *) rm->rm_va, 0);
+
+		if (*pte & PTE_A) {
+			*pte &= ~PTE_A;
+			tlb_invalidate(rm->rm_pgdir, (void *) rm->rm_va);
+			referenced = true;
+		}
+	}
+	return referenced;
+}
+
+// Free 'pp' by dropping it (clean block cache page) or writing it to
+// swap.  Only pages mapped exactly once by a user environment qualify.
+static int
+page_evict(struct PageInfo *pp)
+{
+	struct Rmap *rm = pp->pp_rmap;
+	pde_t *pgdir = rm->rm_pgdir;
+	void *va = (void *) rm->rm_va;
+	struct Env *e;
+	pte_t *pte;
+	void *kva;
+	int slot, perm, r;
+
+	if (pp->pp_ref != 1 || rm->rm_next || rm->rm_va >= UTOP ||
+	    !(e = pgdir2env(pgdir)))
+		return -E_INVAL;
+	pte = pgdir_walk(pgdir, va, 0);
+
+	if (e->env_type == ENV_TYPE_FS &&
+	    rm->rm_va >= DISKMAP && rm->rm_va < DISKMAP + DISKSIZE) {
+		if (*pte & PTE_D)
+			return -E_INVAL;
+		page_remove(pgdir, va);
+		swapstat.ss_evicted++;
+		return 0;
+	}
+
+	// User-level conventions (PTE_SHARE, PTE_COW) inspect these bits
+	// through uvpt, so such pages stay resident.
+	if ((*pte & PTE_AVAIL) || !swapstat.ss_nslots)
+		return -E_INVAL;
+
+	if ((slot = swap_alloc()) < 0)
+		return slot;
+	kva = kmap(pp);
+	r = swap_io(slot, kva, 1);
+	kunmap(kva);
+	if (r < 0) {
+		swap_free(slot);
+		return r;
+	}
+	perm = *pte & (PTE_U | PTE_W);
+	page_remove(pgdir, va);
+	*pte = (slot << PGSHIFT) | PTE_SWAPPED | perm;
+	swapstat.ss_swapout++;
+	e->env_memstat.ms_swapped++;
+
+	return 0;
+}
+
+//
+// Try to free up to 'target' pages.  Must only be called where no
+// kernel code holds a reference to a user page (the fault path,
+// syscall entry, the scheduler): the page that is evicted can be any.
+//
+// Returns the number of pages freed.
+//
+int
+page_reclaim(int target)
+{
+	static size_t hand;
+	int freed;
+
+	// Memory of destroyed environments is the cheapest to get back.
+	if ((freed = env_reap(-1)) >= target)
+		return freed;
+
+	// Two full turns: the first may only clear accessed bits.
+	for (size_t n = 0; n < 2 * npages && freed < target; n++) {
+		struct PageInfo *pp = &pages[hand];
+
+		hand = (hand + 1) % npages;
+		if (!pp->pp_ref || !pp->pp_rmap || page_referenced(pp))
+			continue;
+		if (page_evict(pp) == 0)
+			freed++;
+	}
+	return freed;
+}
@@ -0,0 +1,32 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_SWAP_H
+#define JOS_KERN_SWAP_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/memlayout.h>
+
+// The scheduler starts reclaiming when fewer than RECLAIM_LOW pages are
+// free, RECLAIM_BATCH pages at a time.
+#define RECLAIM_LOW		64
+#define RECLAIM_BATCH		32
+
+struct SwapStat {
+	uint32_t ss_nslots;		// Size of the swap area in pages
+	uint32_t ss_used;		// Slots holding swapped-out pages
+	uint32_t ss_evicted;		// Clean block cache pages dropped
+	uint32_t ss_swapout;		// Anonymous pages written to swap
+	uint32_t ss_swapin;		// Pages read back from swap
+};
+
+extern struct SwapStat swapstat;
+
+void	swap_init(void);
+void	swap_free(uint32_t slot);
+int	page_swapin(pde_t *pgdir, void *va);
+int	page_reclaim(int target);
+
+#endif	// !JOS_KERN_SWAP_H
@@ -14,6 +14,10 @@
 #include <kern/kclock.h>
 #include <kern/tsc.h>
 #include <kern/time.h>
+#include <kern/swap.h>
+#include <kern/merge.h>
+#include <kern/itimer.h>
+#include <kern/prof.h>
 
 // Print a string to the system console.
 // The string is exactly 'len' characters long.
@@ -21,12 +25,22 @@
 static void
 sys_cputs(const char *s, size_t len)
 {
+	static char buf[PGSIZE];
+
 	// Check that the user has permission to read memory [s, s+len).
-	// Destroy the environment if not.
-	user_mem_assert(curenv, s, len, PTE_U);
+	// Destroy the environment if not.  Nothing is printed then, so
+	// the whole string is probed before the first piece is copied.
+	if (user_mem_probe(s, len) < 0)
+		user_mem_fault(curenv);
 
 	// Print the string supplied by the user.
-	cprintf("%.*s", len, s);
+	for (size_t off = 0; off < len; off += sizeof(buf)) {
+		size_t n = MIN(len - off, sizeof(buf));
+
+		if (copy_from_user(buf, s + off, n) < 0)
+			user_mem_fault(curenv);
+		cprintf("%.*s", n, buf);
+	}
 }
 
 // Read a character from the system console without blocking.
@@ -95,6 +109,8 @@ sys_exofork(void)
 	child->env_status = ENV_NOT_RUNNABLE;
 	child->env_tf = curenv->env_tf;
 	child->env_tf.tf_regs.reg_eax = 0;
+	memmove(child->env_vm_reserve, curenv->env_vm_reserve,
+		sizeof(child->env_vm_reserve));
 
 	return child->env_id;
 }
@@ -139,12 +155,13 @@ sys_env_set_status(envid_t envid, int status)
 //	-E_BAD_ENV if environment envid doesn't currently exist,
 //		or the caller doesn't have permission to change envid.
 static int
-sys_env_set_trapframe(envid_t envid, struct Trapframe *tf)
+sys_env_set_trapframe(envid_t envid, struct Trapframe *utf)
 {
 	// LAB 11: Your code here.
 	// Remember to check whether the user has supplied us with a good
 	// address!
 
+	struct Trapframe tf;
 	struct Env *env;
 	int res;
 
@@ -152,13 +169,14 @@ sys_env_set_trapframe(envid_t envid, struct Trapframe *tf)
 		return res;
 	}
 
-	user_mem_assert(curenv, tf, sizeof(struct Trapframe), PTE_U | PTE_P);
+	if (copy_from_user(&tf, utf, sizeof(tf)) < 0) {
+		user_mem_fault(curenv);
+	}
 
-	
-	tf->tf_eflags = FL_IF;
-	tf->tf_cs = GD_UT | 3;
+	tf.tf_eflags = FL_IF;
+	tf.tf_cs = GD_UT | 3;
 
-	env->env_tf = *tf;
+	env->env_tf = tf;
 
 
 	return 0;
@@ -187,6 +205,92 @@ sys_env_set_pgfault_upcall(envid_t envid, void *func)
 	return 0;
 }
 
+// Set the interval timer upcall for 'envid'.  When timers of 'envid'
+// expire, the kernel pushes a UTrapframe with the mask of expired timer
+// ids in utf_err onto the exception stack and branches to 'func' the
+// next time 'envid' runs.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or the caller doesn't have permission to change envid.
+static int
+sys_env_set_timer_upcall(envid_t envid, void *func)
+{
+	struct Env *env;
+	int res;
+
+	if ((res = envid2env(envid, &env, 1)) < 0) {
+		return res;
+	}
+
+	env->env_timer_upcall = func;
+
+	return 0;
+}
+
+// Copy the memory accounting of environment 'envid' to 'ms'.
+// Any environment may be inspected, the same data is readable through
+// the 'envs' array.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist.
+static int
+sys_env_memstat(envid_t envid, struct EnvMemStat *ms)
+{
+	struct Env *env;
+	int res;
+
+	if ((res = envid2env(envid, &env, 0)) < 0) {
+		return res;
+	}
+
+	if (copy_to_user(ms, &env->env_memstat, sizeof(*ms)) < 0) {
+		user_mem_fault(curenv);
+	}
+
+	return 0;
+}
+
+// Allow or forbid the kernel to merge pages of environment 'envid' with
+// identical pages of other mergeable environments.  Merged pages are
+// mapped PTE_COW and copied again by the kernel when written.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or the caller doesn't have permission to change envid.
+//	-E_INVAL if envid is the file server, whose block cache pages
+//		must stay private.
+static int
+sys_env_set_mergeable(envid_t envid, bool mergeable)
+{
+	struct Env *env;
+	int res;
+
+	if ((res = envid2env(envid, &env, 1)) < 0) {
+		return res;
+	}
+	if (env->env_type == ENV_TYPE_FS) {
+		return -E_INVAL;
+	}
+
+	env_set_mergeable(env, mergeable);
+	return 0;
+}
+
+// Copy the same-page merging statistics to 'stat'.
+static int
+sys_page_merge_stat(struct MergeStat *ustat)
+{
+	struct MergeStat stat = mergestat;
+
+	stat.mg_saved = page_merge_saved();
+	if (copy_to_user(ustat, &stat, sizeof(stat)) < 0) {
+		user_mem_fault(curenv);
+	}
+
+	return 0;
+}
+
 // Allocate a page of memory and map it at 'va' with permission
 // 'perm' in the address space of 'envid'.
 // The page's contents are set to 0.
@@ -228,13 +332,21 @@ sys_page_alloc(envid_t envid, void *va, int perm)
 		return res;
 	}
 
-	struct PageInfo *pp = page_alloc(ALLOC_ZERO);
+	// Under memory pressure, reclaim some pages and try again.  This
+	// is safe here since no other user page is being held.
+	struct PageInfo *pp = page_alloc(ALLOC_ZERO | ALLOC_HIGHMEM);
+
+	if (!pp && page_reclaim(RECLAIM_BATCH) > 0) {
+		pp = page_alloc(ALLOC_ZERO | ALLOC_HIGHMEM);
+	}
 
 	if (!pp) {
 		return -E_NO_MEM;
 	}
 
-	if ((res = page_insert(env->env_pgdir, pp, va, PTE_U | perm)) < 0) {
+	if ((res = page_insert(env->env_pgdir, pp, va, PTE_U | perm)) < 0 &&
+	    (page_reclaim(RECLAIM_BATCH) == 0 ||
+	     (res = page_insert(env->env_pgdir, pp, va, PTE_U | perm)) < 0)) {
 		page_free(pp);
 		return res;
 	}
@@ -242,6 +354,91 @@ sys_page_alloc(envid_t envid, void *va, int perm)
 	return 0;
 }
 
+// Reserve [va, va+len) in the current environment's address space as
+// demand-zero memory: pages in the range are not allocated now, but the
+// kernel maps a zeroed page with permission 'perm' the first time each of
+// them is touched, without calling the page fault upcall.
+// A reservation adjacent to an existing one with the same permissions
+// extends it, so heaps and stacks can grow one step at a time.
+// Passing len == 0 cancels the reservation starting at 'va'; pages
+// already faulted in stay mapped.
+//
+// perm -- same restrictions as in sys_page_alloc.
+//
+// Return 0 on success, < 0 on error.  Errors are:
+//	-E_INVAL if va or len is not page-aligned, or the range reaches
+//		above UTOP or overlaps an existing reservation.
+//	-E_INVAL if perm is inappropriate (see sys_page_alloc).
+//	-E_NOT_FOUND if len == 0 and no reservation starts at 'va'.
+//	-E_NO_MEM if all NVMRESERVE slots are in use.
+static int
+sys_vm_reserve(void *va, size_t len, int perm)
+{
+	uintptr_t start = (uintptr_t) va, end = start + len;
+	struct VmReserve *vr, *slot = NULL;
+
+	if (start % PGSIZE != 0 || len % PGSIZE != 0 ||
+	    end < start || end > UTOP) {
+		return -E_INVAL;
+	}
+
+	if ((~PTE_SYSCALL & perm) != 0) {
+		return -E_INVAL;
+	}
+	perm |= PTE_U | PTE_P;
+
+	for (vr = curenv->env_vm_reserve;
+	     vr < curenv->env_vm_reserve + NVMRESERVE;
+	     vr++) {
+		if (vr->vr_start == vr->vr_end) {
+			if (!slot) {
+				slot = vr;
+			}
+			continue;
+		}
+		if (len == 0) {
+			if (vr->vr_start == start) {
+				vr->vr_start = vr->vr_end = 0;
+				return 0;
+			}
+			continue;
+		}
+		if (start < vr->vr_end && vr->vr_start < end) {
+			return -E_INVAL;
+		}
+	}
+
+	if (len == 0) {
+		return -E_NOT_FOUND;
+	}
+
+	for (vr = curenv->env_vm_reserve;
+	     vr < curenv->env_vm_reserve + NVMRESERVE;
+	     vr++) {
+		if (vr->vr_start == vr->vr_end || vr->vr_perm != perm) {
+			continue;
+		}
+		if (vr->vr_end == start) {
+			vr->vr_end = end;
+			return 0;
+		}
+		if (vr->vr_start == end) {
+			vr->vr_start = start;
+			return 0;
+		}
+	}
+
+	if (!slot) {
+		return -E_NO_MEM;
+	}
+
+	slot->vr_start = start;
+	slot->vr_end = end;
+	slot->vr_perm = perm;
+
+	return 0;
+}
+
 // Map the page of memory at 'srcva' in srcenvid's address space
 // at 'dstva' in dstenvid's address space with permission 'perm'.
 // Perm has the same restrictions as in sys_page_alloc, except
@@ -292,6 +489,7 @@ sys_page_map(envid_t srcenvid, void *srcva,
 		return res;
 	}
 
+	page_swapin(srcenv->env_pgdir, srcva);
 	struct PageInfo *pp = page_lookup(srcenv->env_pgdir, srcva, 0);
 
 	if (!pp) {
@@ -330,6 +528,73 @@ sys_page_unmap(envid_t envid, void *va)
 	return 0;
 }
 
+// Physically contiguous memory for device rings, see sys_dma_map.  It
+// is part of the kernel image, so the page allocator never hands it
+// out and page_reclaim never takes it back.
+#define DMA_NPAGES	8
+static uint8_t dma_region[DMA_NPAGES * PGSIZE]
+	__attribute__((aligned(PGSIZE)));
+
+// Map the DMA_NPAGES physically contiguous pages of the DMA region
+// at 'va' in the caller's address space, writable, and store the
+// physical address of the first to 'pa'.  All callers share the same
+// pages.
+//
+// Return the number of pages on success, < 0 on error.  Errors are:
+//	-E_INVAL if the caller has no I/O privilege, if va is not
+//		page-aligned, or if the region would reach UTOP.
+//	-E_NO_MEM if there's no memory to allocate page tables.
+static int
+sys_dma_map(void *va, physaddr_t *upa)
+{
+	physaddr_t pa = PADDR(dma_region);
+	int res;
+
+	if ((curenv->env_tf.tf_eflags & FL_IOPL_MASK) != FL_IOPL_3 ||
+	    (uintptr_t)va % PGSIZE || va >= (void *)UTOP ||
+	    (void *)UTOP - va < DMA_NPAGES * PGSIZE)
+		return -E_INVAL;
+
+	for (int i = 0; i < DMA_NPAGES; i++) {
+		if ((res = page_insert(curenv->env_pgdir, pa2page(pa + i * PGSIZE),
+				       va + i * PGSIZE, PTE_U | PTE_W)) < 0) {
+			return res;
+		}
+	}
+	if (copy_to_user(upa, &pa, sizeof(pa)) < 0) {
+		user_mem_fault(curenv);
+	}
+
+	return DMA_NPAGES;
+}
+
+// Store the physical address of the page mapped at 'va' in the
+// caller's address space to 'pa', for a device to DMA to or from it.
+// The caller must keep the page resident meanwhile.
+//
+// Return 0 on success, < 0 on error.  Errors are:
+//	-E_INVAL if the caller has no I/O privilege, if va >= UTOP,
+//		or if no page is mapped at va.
+static int
+sys_page_paddr(void *va, physaddr_t *upa)
+{
+	struct PageInfo *pp;
+	physaddr_t pa;
+
+	if ((curenv->env_tf.tf_eflags & FL_IOPL_MASK) != FL_IOPL_3 ||
+	    va >= (void *)UTOP)
+		return -E_INVAL;
+	if (!(pp = page_lookup(curenv->env_pgdir, va, NULL)))
+		return -E_INVAL;
+
+	pa = page2pa(pp);
+	if (copy_to_user(upa, &pa, sizeof(pa)) < 0) {
+		user_mem_fault(curenv);
+	}
+
+	return 0;
+}
+
 // Try to send 'value' to the target env 'envid'.
 // If srcva < UTOP, then also send page currently mapped at 'srcva',
 // so that receiver gets a duplicate mapping of the same page.
@@ -391,6 +656,7 @@ sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
 			return -E_INVAL;
 		}
 
+		page_swapin(curenv->env_pgdir, srcva);
 		struct PageInfo *pp = page_lookup(curenv->env_pgdir, srcva, 0);
 
 		if (!pp) {
@@ -424,6 +690,8 @@ sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
 // return 0 on success.
 // Return < 0 on error.  Errors are:
 //	-E_INVAL if dstva < UTOP but dstva is not page-aligned.
+//	-E_INTR if an interval timer of the environment expired first
+//		(see kern/itimer.c).
 static int
 sys_ipc_recv(void *dstva)
 {
@@ -444,26 +712,24 @@ static int
 sys_gettime(void)
 {
 	// LAB 12: Your code here.
-	return gettime();
+	return clock_realtime() / NANOSECONDS;
 }
 
 static int
-sys_clock_gettime(clockid_t clock_id, struct timespec* tp)
+sys_clock_gettime(clockid_t clock_id, struct timespec* utp)
 {	
 
-	long long current;
+	struct timespec ts, *tp = &ts;
     switch(clock_id) {
 
 	    case CLOCK_REALTIME:
-	    	set_tp_from_timestamp(
-                tp,
-                gettime()
-            );
+	    	tp->tv_sec = 0;
+	    	tp->tv_nsec = clock_realtime();
+	    	normalize_time(tp);
 	        break;
 	    case CLOCK_MONOTONIC:
-	    	current = nanosec_from_timer();
 	    	tp->tv_sec = 0;
-	    	tp->tv_nsec = current - monotonic_time_start;
+	    	tp->tv_nsec = clock_monotonic();
 	    	normalize_time(tp);
 	    	break;
 	    case CLOCK_PROCESS_CPUTIME_ID:
@@ -472,15 +738,19 @@ sys_clock_gettime(clockid_t clock_id, struct timespec* tp)
 	    	tp->tv_nsec += nanosec_from_timer() - curenv->env_time_start;
 			normalize_time(tp);
 	    	break;
+	    default:
+	    	return 0;
 	}
-	return 0;
+	return copy_to_user(utp, &ts, sizeof(ts));
 }
 
 static int
-sys_clock_getres(clockid_t clock_id, struct timespec* res)
+sys_clock_getres(clockid_t clock_id, struct timespec* ures)
 {
 
-	if (res == NULL || !check_clock_arg(clock_id)) {
+	struct timespec ts, *res = &ts;
+
+	if (ures == NULL || !check_clock_arg(clock_id)) {
         return -E_INVAL;
     }
     if (clock_id != CLOCK_REALTIME) {
@@ -491,7 +761,7 @@ sys_clock_getres(clockid_t clock_id, struct timespec* res)
         res->tv_nsec = 0;
         res->tv_sec = 1;
     }
-    return 0;
+    return copy_to_user(ures, &ts, sizeof(ts));
 }
 
 static int
@@ -508,8 +778,9 @@ sys_clock_settime(clockid_t clock_id, const struct timespec* tp)
     struct timespec* res = resolution_by_clock(clock_id);
     // we need to allign timespec but changin the original seemed to be bad idea
     struct timespec ts;
-   	ts.tv_sec = tp->tv_sec;
-   	ts.tv_nsec = tp->tv_nsec;
+    if (copy_from_user(&ts, tp, sizeof(ts)) < 0) {
+        return -E_FAULT;
+    }
     allign_by_resolution(&ts, res);
 
     switch(clock_id) {
@@ -517,6 +788,7 @@ sys_clock_settime(clockid_t clock_id, const struct timespec* tp)
         case CLOCK_REALTIME:
 	        mktime(ts.tv_sec, &date);
             settime(&date);
+            clock_set_realtime((int64_t) ts.tv_sec * NANOSECONDS);
             break;
         case CLOCK_MONOTONIC:
 #if ENABLE_POSIX_SETTIME_RESTRICTION
@@ -526,6 +798,7 @@ sys_clock_settime(clockid_t clock_id, const struct timespec* tp)
           	current = nanosec_from_timer() - monotonic_time_start;
 	    	new = ts.tv_nsec + (long long) ts.tv_sec * NANOSECONDS;
 	    	monotonic_time_start += (current - new);
+	    	clock_data_update();
             break;
 #endif
         case CLOCK_PROCESS_CPUTIME_ID:
@@ -547,36 +820,46 @@ static int
 sys_clock_nanosleep(
 	clockid_t clock_id,
 	int flags,
-	const struct timespec* rqtp,
+	const struct timespec* urqtp,
 	struct timespec* rmtp // we don't need this field because we have no signals
 )
 {
 
 	long long current_ns, rq_nanoseconds;
 	time_t rq_timestamp, current_ts;
+	struct timespec rq, *rqtp = &rq;
 
-	if (rqtp == NULL || !check_clock_arg(clock_id)) {
+	if (urqtp == NULL || !check_clock_arg(clock_id)) {
         return -E_INVAL;
     }
+    if (copy_from_user(&rq, urqtp, sizeof(rq)) < 0) {
+        return -E_FAULT;
+    }
 
+	// The call returns 0 once the sleep is over.
+	curenv->env_tf.tf_regs.reg_eax = 0;
+
+	// Both clocks sleep on a CLOCK_MONOTONIC timer.
 	switch(clock_id) {
 
         case CLOCK_REALTIME:
-	        current_ts = gettime();
+	        current_ns = clock_monotonic();
+	        current_ts = clock_realtime() / NANOSECONDS;
 	        rq_timestamp = timestamp_from_timespec(rqtp);
 	        if (flags == TIMER_ABSTIME) {
 	        	if (current_ts >= rq_timestamp) {
 	        		return 0;
 	        	}
-	        	curenv->env_sleep_until = rq_timestamp;
+	        	rq_nanoseconds = (long long) rq_timestamp * NANOSECONDS -
+	        		(clock_realtime() - current_ns);
 	        } else {
-	        	curenv->env_sleep_until = current_ts + rq_timestamp;
+	        	rq_nanoseconds = current_ns +
+	        		(long long) rq_timestamp * NANOSECONDS;
 	        }
-	        curenv->env_sleep_clock_type = CLOCK_REALTIME;
-	        curenv->env_status = ENV_NOT_RUNNABLE;
+	        sched_sleep(curenv, rq_nanoseconds, CLOCK_REALTIME);
 	        sched_yield();
         case CLOCK_MONOTONIC:
-        	current_ns = nanosec_from_timer() - monotonic_time_start;
+        	current_ns = clock_monotonic();
 	        rq_nanoseconds = (
         		rqtp->tv_nsec +
         		(long long) rqtp->tv_sec * NANOSECONDS
@@ -585,12 +868,10 @@ sys_clock_nanosleep(
 	        	if (current_ns >= rq_nanoseconds) {
 	        		return 0;
 	        	}
-	        	curenv->env_sleep_until = rq_nanoseconds;
 	        } else {
-	        	curenv->env_sleep_until = rq_nanoseconds + current_ns;
+	        	rq_nanoseconds += current_ns;
 	        }
-        	curenv->env_sleep_clock_type = CLOCK_MONOTONIC;
-	        curenv->env_status = ENV_NOT_RUNNABLE;
+	        sched_sleep(curenv, rq_nanoseconds, CLOCK_MONOTONIC);
 	        sched_yield();
         case CLOCK_PROCESS_CPUTIME_ID:
         	return -E_NOT_SUPP;
@@ -599,6 +880,126 @@ sys_clock_nanosleep(
 	return 0;
 }
 
+// Allocate an interval timer on 'clock_id' for the current environment.
+//
+// Returns the timer id on success, < 0 on error.  Errors are:
+//	-E_INVAL if clock_id is not CLOCK_MONOTONIC or CLOCK_REALTIME.
+//	-E_NO_MEM if the environment has NITIMER timers already.
+static int
+sys_timer_create(clockid_t clock_id)
+{
+	return itimer_create(curenv, clock_id);
+}
+
+// Arm timer 'id' with 'value', or disarm it if value->it_value is zero.
+// A nonzero value->it_interval makes it periodic.  With TIMER_ABSTIME in
+// 'flags', value->it_value is a time on the timer's clock.  If 'ovalue'
+// is not null, the previous setting is stored there.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_INVAL if id is not a timer of the environment or a
+//		nanosecond field is out of range.
+static int
+sys_timer_settime(timer_t id, int flags, const struct itimerspec *uvalue,
+		  struct itimerspec *uovalue)
+{
+	struct itimerspec value, ovalue;
+	int res;
+
+	if (copy_from_user(&value, uvalue, sizeof(value)) < 0) {
+		user_mem_fault(curenv);
+	}
+
+	res = itimer_settime(curenv, id, flags, &value, uovalue ? &ovalue : NULL);
+	if (res == 0 && uovalue &&
+	    copy_to_user(uovalue, &ovalue, sizeof(ovalue)) < 0) {
+		user_mem_fault(curenv);
+	}
+
+	return res;
+}
+
+// Disarm and free timer 'id'.
+static int
+sys_timer_delete(timer_t id)
+{
+	return itimer_delete(curenv, id);
+}
+
+// Return the number of expiries of timer 'id' that were not delivered
+// separately before its last upcall.
+static int
+sys_timer_getoverrun(timer_t id)
+{
+	return itimer_getoverrun(curenv, id);
+}
+
+// Start the sampling profiler at 'hz' samples a second, or stop it if
+// 'hz' is 0.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_INVAL if hz is above PROF_MAXHZ.
+static int
+sys_prof_start(unsigned hz)
+{
+	return prof_start(hz);
+}
+
+// Move up to 'n' profiler samples, oldest first, to 'samples'.
+// Returns the number of samples stored.
+static int
+sys_prof_read(struct ProfSample *samples, size_t n)
+{
+	int res;
+
+	if ((res = prof_read(samples, n)) < 0) {
+		user_mem_fault(curenv);
+	}
+
+	return res;
+}
+
+// Store the function containing 'pc' in environment 'envid' to 'sym'.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if pc is a user address and environment envid
+//		doesn't currently exist.
+static int
+sys_prof_symbol(envid_t envid, uintptr_t pc, struct ProfSymbol *usym)
+{
+	struct ProfSymbol sym;
+	int res;
+
+	if ((res = prof_symbol(envid, pc, &sym)) < 0) {
+		return res;
+	}
+	if (copy_to_user(usym, &sym, sizeof(sym)) < 0) {
+		user_mem_fault(curenv);
+	}
+
+	return 0;
+}
+
+// Block until the device raises interrupt 'irq', or return at once if
+// it did since the last call.  The file server sleeps here while the
+// disk works instead of polling its status register.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_INVAL if irq is not one of the IRQ_USER_MASK lines (see
+//		irq_wait) or the caller has no I/O privilege.
+static int
+sys_irq_wait(int irq)
+{
+	int res;
+
+	if ((res = irq_wait(curenv, irq)) <= 0) {
+		return res;
+	}
+
+	curenv->env_tf.tf_regs.reg_eax = 0;
+	sched_yield();
+}
+
 
 // Dispatches to the correct kernel function, passing the arguments.
 int32_t
@@ -627,8 +1028,22 @@ syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
 			return sys_page_map(a1, (void *)a2, a3, (void *)a4, a5);
 		case SYS_page_unmap:
 			return sys_page_unmap(a1, (void *)a2);
+		case SYS_page_paddr:
+			return sys_page_paddr((void *)a1, (physaddr_t *)a2);
+		case SYS_dma_map:
+			return sys_dma_map((void *)a1, (physaddr_t *)a2);
+		case SYS_vm_reserve:
+			return sys_vm_reserve((void *)a1, a2, a3);
+		case SYS_env_memstat:
+			return sys_env_memstat(a1, (void *)a2);
+		case SYS_env_set_mergeable:
+			return sys_env_set_mergeable(a1, a2);
+		case SYS_page_merge_stat:
+			return sys_page_merge_stat((void *)a1);
 		case SYS_env_set_pgfault_upcall:
 			return sys_env_set_pgfault_upcall(a1, (void *)a2);
+		case SYS_env_set_timer_upcall:
+			return sys_env_set_timer_upcall(a1, (void *)a2);
 		case SYS_ipc_try_send:
 			return sys_ipc_try_send(a1, a2, (void *)a3, a4);
 		case SYS_ipc_recv:
@@ -645,6 +1060,22 @@ syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
 			return sys_clock_settime(a1, (void *)a2);
 		case SYS_clock_nanosleep:
 			return sys_clock_nanosleep(a1, a2, (void *)a3, (void *)a4);
+		case SYS_timer_create:
+			return sys_timer_create(a1);
+		case SYS_timer_settime:
+			return sys_timer_settime(a1, a2, (void *)a3, (void *)a4);
+		case SYS_timer_delete:
+			return sys_timer_delete(a1);
+		case SYS_timer_getoverrun:
+			return sys_timer_getoverrun(a1);
+		case SYS_prof_start:
+			return sys_prof_start(a1);
+		case SYS_prof_read:
+			return sys_prof_read((void *)a1, a2);
+		case SYS_prof_symbol:
+			return sys_prof_symbol(a1, a2, (void *)a3);
+		case SYS_irq_wait:
+			return sys_irq_wait(a1);
 		default:
 			return -E_INVAL;
 	}
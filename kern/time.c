@@ -1,9 +1,14 @@
 /* See COPYRIGHT for copyright information. */
 
 #include <inc/error.h>
+#include <inc/x86.h>
 
 #include <kern/time.h>
 #include <kern/tsc.h>
+#include <kern/kclock.h>
+
+// Clock data shared with user space, see inc/vsyscall.h.
+#define vclock ((struct vsys_clock *) (vsys + VSYS_clock))
 
 bool is_leap_year(int year)
 {
@@ -15,64 +20,55 @@ int d_to_s(int d)
     return d * 24 * 60 * 60;
 }
 
-int timestamp(const struct tm *time)
+// Days from 1970-01-01 to the given date of the proleptic Gregorian
+// calendar (month 1-12), in constant time: shifting the year to start in
+// March puts the leap day last, so the day of the year follows from the
+// month with a linear formula, and 400-year eras repeat exactly.
+static int days_from_civil(int y, int m, int d)
 {
-    int result = 0, year, month;
-    for (year = 1970; year < time->tm_year + 1970; year++)
-    {
-        result += d_to_s(365 + is_leap_year(year));
-    }
-    int months[] = {31, 28 + is_leap_year(year), 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
-    for (month = 0; month < time->tm_mon; month++)
-    {
-        result += d_to_s(months[month]);
-    }
-    result += d_to_s(time->tm_mday) + time->tm_hour*60*60 + time->tm_min*60 + time->tm_sec;
-    return result;
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
 }
 
-void mktime(int time, struct tm *tm)
+// The inverse of days_from_civil.
+static void civil_from_days(int z, int *yp, int *mp, int *dp)
 {
-    int year = 70;
-    int month = 0;
-    int day = 0;
-    int hour = 0;
-    int minute = 0;
-
-    while (time > d_to_s(365 + is_leap_year(1900+year))) {
-        time -= d_to_s(365 + is_leap_year(1900+year));
-        year++;
-    }
-    tm->tm_year = year;
+    z += 719468;
+    int era = (z >= 0 ? z : z - 146096) / 146097;
+    int doe = z - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mon = (5 * doy + 2) / 153;
+    *dp = doy - (153 * mon + 2) / 5 + 1;
+    *mp = mon < 10 ? mon + 3 : mon - 9;
+    *yp = yoe + era * 400 + (*mp <= 2);
+}
 
-    int months[] = {31, 28 + is_leap_year(1900+year), 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+// Note that tm_year counts from 1970 here, as the RTC keeps it.
+int timestamp(const struct tm *time)
+{
+    return d_to_s(days_from_civil(time->tm_year + 1970, time->tm_mon + 1,
+                                  time->tm_mday)) +
+        time->tm_hour*60*60 + time->tm_min*60 + time->tm_sec;
+}
 
-    while (time > d_to_s(months[month])){
-        time -= d_to_s(months[month]);
-        month++;
-    }
-    tm->tm_mon = month;
+void mktime(int time, struct tm *tm)
+{
+    int year, month, day;
 
-    while (time > d_to_s(1)) {
-        time -= d_to_s(1);
-        day++;
-    }
+    civil_from_days(time / d_to_s(1), &year, &month, &day);
+    tm->tm_year = year - 1900;
+    tm->tm_mon = month - 1;
     tm->tm_mday = day;
 
-    while (time >= 60*60) {
-        time -= 60*60;
-        hour++;
-    }
-
-    tm->tm_hour = hour;
-
-    while (time >= 60) {
-        time -= 60;
-        minute++;
-    }
-
-    tm->tm_min = minute;
-    tm->tm_sec = time;
+    time %= d_to_s(1);
+    tm->tm_hour = time / (60*60);
+    tm->tm_min = time / 60 % 60;
+    tm->tm_sec = time % 60;
 }
 
 void print_datetime(struct tm *tm)
@@ -159,10 +155,10 @@ struct timespec* resolution_by_clock(clockid_t clock_id)
         return NULL;
     }
     if (clock_id != CLOCK_REALTIME) {
-        return (struct timespec*) vsys + VSYS_CLOCK_MONOTONIC;
+        return (struct timespec*) (vsys + VSYS_CLOCK_MONOTONIC);
     }
     else {
-        return (struct timespec*) vsys + VSYS_CLOCK_REALTIME;
+        return (struct timespec*) (vsys + VSYS_CLOCK_REALTIME);
     }
 }
 
@@ -177,4 +173,52 @@ int allign_by_resolution(struct timespec* tp, struct timespec* res)
     tp->tv_sec = 0;
     normalize_time(tp);
     return 0;
-}
\ No newline at end of file
+}
+
+static int64_t realtime_offset;	// CLOCK_REALTIME - CLOCK_MONOTONIC
+
+// Copy the clock state to the vsyscall page for lib/vsyscall.c.
+static void clock_data_publish(void)
+{
+    vclock->vc_seq++;
+    asm volatile("" ::: "memory");
+    vclock->vc_mult = tsc_cs.cs_mult;
+    vclock->vc_shift = tsc_cs.cs_shift;
+    vclock->vc_tsc_base = tsc_cs.cs_tsc_base;
+    vclock->vc_mono_base = tsc_cs.cs_ns_base - monotonic_time_start;
+    vclock->vc_real_offset = realtime_offset;
+    asm volatile("" ::: "memory");
+    vclock->vc_seq++;
+}
+
+// Start CLOCK_REALTIME at the RTC time.
+void clock_data_init(void)
+{
+    realtime_offset = (int64_t) gettime() * NANOSECONDS - clock_monotonic();
+    clock_data_publish();
+}
+
+// Called on every clock tick.
+void clock_data_update(void)
+{
+    clocksource_tick();
+    clock_data_publish();
+}
+
+// Nanoseconds since boot.
+uint64_t clock_monotonic(void)
+{
+    return nanosec_from_timer() - monotonic_time_start;
+}
+
+// Nanoseconds since the epoch.
+int64_t clock_realtime(void)
+{
+    return clock_monotonic() + realtime_offset;
+}
+
+void clock_set_realtime(int64_t realtime)
+{
+    realtime_offset = realtime - (int64_t) clock_monotonic();
+    clock_data_publish();
+}
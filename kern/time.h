@@ -22,4 +22,10 @@ struct timespec* resolution_by_clock(clockid_t clock_id);
 
 int allign_by_resolution(struct timespec* tp, struct timespec* res);
 
+void clock_data_init(void);
+void clock_data_update(void);
+uint64_t clock_monotonic(void);
+int64_t clock_realtime(void);
+void clock_set_realtime(int64_t realtime);
+
 #endif // !JOS_KERN_TIME_H
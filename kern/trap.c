@@ -2,6 +2,7 @@
 #include <inc/x86.h>
 #include <inc/assert.h>
 #include <inc/string.h>
+#include <inc/error.h>
 #include <inc/vsyscall.h>
 
 #include <kern/pmap.h>
@@ -17,6 +18,9 @@
 #include <kern/vsyscall.h>
 #include <kern/time.h>
 #include <kern/tsc.h>
+#include <kern/swap.h>
+#include <kern/hrtimer.h>
+#include <kern/prof.h>
 
 #ifndef debug
 # define debug 0
@@ -32,6 +36,16 @@ static struct Taskstate ts;
  */
 static struct Trapframe *last_tf;
 
+// Device IRQs handed to user mode drivers: the primary IDE channel and
+// the lines the BIOS routes PCI interrupts to.
+#define IRQ_USER_MASK	((1 << IRQ_IDE) | (1 << 5) | (1 << 9) | \
+			 (1 << 10) | (1 << 11))
+
+// Environments blocked in sys_irq_wait, and IRQs raised while nobody
+// waited for them.
+static struct Env *irq_waiter[MAX_IRQS];
+static uint16_t irq_pending;
+
 /* Interrupt descriptor table.  (Must be built at run time because
  * shifted function addresses can't be represented in relocation records.)
  */
@@ -95,11 +109,19 @@ void trap_mchk();
 void trap_simderr();
 void trap_syscall();
 
+#ifndef CONFIG_KSPACE
+void sysenter_handler();
+#endif
+
 void irq_timer();
 void irq_kbd();
 void irq_serial();
 void irq_spurious();
 void irq_ide();
+void irq_pci5();
+void irq_pci9();
+void irq_pci10();
+void irq_pci11();
 void irq_error();
 
 void
@@ -140,6 +162,10 @@ trap_init(void)
 	SETGATE(idt[IRQ_OFFSET + IRQ_SERIAL], 0, GD_KT, irq_serial, 0);
 	SETGATE(idt[IRQ_OFFSET + IRQ_SPURIOUS], 0, GD_KT, irq_spurious, 0);
 	SETGATE(idt[IRQ_OFFSET + IRQ_IDE], 0, GD_KT, irq_ide, 0);
+	SETGATE(idt[IRQ_OFFSET + 5], 0, GD_KT, irq_pci5, 0);
+	SETGATE(idt[IRQ_OFFSET + 9], 0, GD_KT, irq_pci9, 0);
+	SETGATE(idt[IRQ_OFFSET + 10], 0, GD_KT, irq_pci10, 0);
+	SETGATE(idt[IRQ_OFFSET + 11], 0, GD_KT, irq_pci11, 0);
 	SETGATE(idt[IRQ_OFFSET + IRQ_ERROR], 0, GD_KT, irq_error, 0);
 
 	// Per-CPU setup 
@@ -166,6 +192,27 @@ trap_init_percpu(void)
 
 	// Load the IDT
 	lidt(&idt_pd);
+
+#ifndef CONFIG_KSPACE
+	// Fast system calls, if the CPU has them (CPUID.01H:EDX.SEP).
+	// sysexit derives the user selectors from the kernel CS, which
+	// relies on GD_UT and GD_UD following GD_KT and GD_KD in the GDT.
+	uint32_t edx;
+
+	cpuid(1, NULL, NULL, NULL, &edx);
+	if (edx & (1 << 11)) {
+		static_assert(GD_KD == GD_KT + 8 && GD_UT == GD_KT + 16 &&
+			      GD_UD == GD_KT + 24);
+		// clock_idt_init fills the resolution below the flag.
+		static_assert((VSYS_sysenter - VSYS_CLOCK_MONOTONIC) *
+			      sizeof(int) >= sizeof(struct timespec) &&
+			      VSYS_clock > VSYS_sysenter);
+		wrmsr(MSR_SYSENTER_CS, GD_KT);
+		wrmsr(MSR_SYSENTER_ESP, KSTACKTOP);
+		wrmsr(MSR_SYSENTER_EIP, (uintptr_t) sysenter_handler);
+		vsys[VSYS_sysenter] = 1;
+	}
+#endif
 }
 
 
@@ -178,10 +225,18 @@ clock_idt_init(void)
 	lidt(&idt_pd);
 
 	patch_year(); // for time from 1970
-	vsys[VSYS_gettime] = gettime();
-	clock_getres(CLOCK_MONOTONIC, (struct timespec*) vsys + VSYS_CLOCK_MONOTONIC);
-	clock_getres(CLOCK_REALTIME, (struct timespec*) vsys + VSYS_CLOCK_REALTIME);
+	static_assert(VSYS_CLOCK_REALTIME > VSYS_gettime &&
+		      (VSYS_CLOCK_MONOTONIC - VSYS_CLOCK_REALTIME) * sizeof(int) >=
+		      sizeof(struct timespec) &&
+		      (VSYS_clock - VSYS_CLOCK_MONOTONIC) * sizeof(int) >=
+		      sizeof(struct timespec) &&
+		      NVSYSCALLS * sizeof(int) <= PGSIZE);
+	clock_getres(CLOCK_MONOTONIC, (struct timespec*) (vsys + VSYS_CLOCK_MONOTONIC));
+	clock_getres(CLOCK_REALTIME, (struct timespec*) (vsys + VSYS_CLOCK_REALTIME));
 	monotonic_time_start = nanosec_from_timer();
+	// The only RTC read: realtime is kept from the TSC afterwards.
+	clock_data_init();
+	vsys[VSYS_gettime] = clock_realtime() / NANOSECONDS;
 }
 
 
@@ -229,6 +284,54 @@ print_regs(struct PushRegs *regs)
 	cprintf("  eax  0x%08x\n", regs->reg_eax);
 }
 
+//
+// Block 'e' until IRQ 'irq' is raised, unless it was raised since the
+// last irq_wait.  Only IRQ_USER_MASK lines go to user mode, and only to
+// an environment with I/O privilege: the file server drives the disk.
+//
+// The line stays masked from the interrupt until the next irq_wait, so
+// the driver must have quieted the device (for a level-triggered PCI
+// line) before it waits again.
+//
+// Returns 1 if 'e' is now blocked, 0 if the IRQ was pending, or
+// -E_INVAL.
+//
+int
+irq_wait(struct Env *e, int irq)
+{
+	if (irq < 0 || irq >= MAX_IRQS || !(IRQ_USER_MASK & (1 << irq)) ||
+	    (e->env_tf.tf_eflags & FL_IOPL_MASK) != FL_IOPL_3)
+		return -E_INVAL;
+	irq_set_masked(irq, false);
+	if (irq_pending & (1 << irq)) {
+		irq_pending &= ~(1 << irq);
+		return 0;
+	}
+	irq_waiter[irq] = e;
+	e->env_irq_wait = irq + 1;
+	e->env_status = ENV_NOT_RUNNABLE;
+	return 1;
+}
+
+// IRQ 'irq' was raised: make its waiter runnable, or remember the IRQ
+// for the next irq_wait.  Returns whether an environment woke up.
+static bool
+irq_notify(int irq)
+{
+	struct Env *e = irq_waiter[irq];
+
+	irq_waiter[irq] = NULL;
+	// env_destroy clears env_irq_wait of a waiter it destroys.
+	if (!e || e->env_irq_wait != irq + 1 ||
+	    e->env_status != ENV_NOT_RUNNABLE) {
+		irq_pending |= 1 << irq;
+		return false;
+	}
+	e->env_irq_wait = 0;
+	e->env_status = ENV_RUNNABLE;
+	sched_run_next(e);
+	return true;
+}
 
 static void
 trap_dispatch(struct Trapframe *tf)
@@ -266,11 +369,33 @@ trap_dispatch(struct Trapframe *tf)
 		return;
 	}
 
+	// A user mode driver sleeps on the device, have it run at once.
+	if (tf->tf_trapno >= IRQ_OFFSET &&
+	    tf->tf_trapno < IRQ_OFFSET + MAX_IRQS &&
+	    (IRQ_USER_MASK & (1 << (tf->tf_trapno - IRQ_OFFSET)))) {
+		int irq = tf->tf_trapno - IRQ_OFFSET;
+
+		irq_set_masked(irq, true);
+		pic_send_eoi(irq);
+		if (irq_notify(irq))
+			sched_yield();
+		return;
+	}
+
+	if (tf->tf_trapno == IRQ_OFFSET + IRQ_TIMER) {
+		prof_sample(tf);
+		hrtimer_interrupt();
+		sched_yield();
+		return;
+	}
+
 	if (tf->tf_trapno == IRQ_OFFSET + IRQ_CLOCK) {
 		rtc_check_status();
 		pic_send_eoi(IRQ_CLOCK);
+		prof_sample(tf);
 
-		vsys[VSYS_gettime] = gettime();
+		clock_data_update();
+		vsys[VSYS_gettime] = clock_realtime() / NANOSECONDS;
 		sched_yield();
 		return;
 	}
@@ -318,14 +443,22 @@ trap(struct Trapframe *tf)
 		cprintf("Incoming TRAP frame at %p\n", tf);
 	}
 
+#ifndef CONFIG_KSPACE
+	// A trap taken in kernel mode (e.g. a demand-zero fault on a user
+	// buffer) is not a switch away from curenv: handle it on the kernel
+	// stack and resume the interrupted kernel code.
+	if ((tf->tf_cs & 3) == 0) {
+		last_tf = tf;
+		trap_dispatch(tf);
+		env_pop_tf(tf);
+	}
+#endif
+
 	assert(curenv);
 
-	// Garbage collect if current enviroment is a zombie
-	if (curenv->env_status == ENV_DYING) {
-		env_free(curenv);
-		curenv = NULL;
+	// A zombie never runs again, env_reap frees it later
+	if (curenv->env_status == ENV_DYING)
 		sched_yield();
-	}
 
 	// Copy trap frame (which is currently on the stack)
 	// into 'curenv->env_tf', so that running the environment
@@ -353,6 +486,74 @@ trap(struct Trapframe *tf)
 		sched_yield();
 }
 
+#ifndef CONFIG_KSPACE
+//
+// Called by sysenter_handler with the Trapframe it built on the kernel
+// stack.  System calls that cannot switch away from curenv run right
+// here, and their result goes back to user mode through sysexit.  The
+// rest need curenv->env_tf to be up to date, so they take the full
+// trap() path, which returns to user mode with iret.
+//
+int32_t
+sysenter_dispatch(struct Trapframe *tf)
+{
+	int32_t r;
+
+	switch (tf->tf_regs.reg_eax) {
+	case SYS_yield:
+	case SYS_exofork:
+	case SYS_ipc_recv:
+	case SYS_env_set_trapframe:
+	case SYS_clock_nanosleep:
+	case SYS_irq_wait:
+		trap(tf);
+	}
+
+	last_tf = tf;
+	r = syscall(tf->tf_regs.reg_eax, tf->tf_regs.reg_edx,
+		    tf->tf_regs.reg_ecx, tf->tf_regs.reg_ebx,
+		    tf->tf_regs.reg_edi, 0);
+
+	// The call may still have made curenv not runnable
+	// (sys_env_set_status on itself).
+	if (curenv->env_status != ENV_RUNNING) {
+		tf->tf_regs.reg_eax = r;
+		curenv->env_tf = *tf;
+		sched_yield();
+	}
+	return r;
+}
+#endif
+
+// Kernel code that may fault on user addresses (kern/usercopy.S), and
+// where to resume it.
+extern char user_copy_start[], user_copy_end[], user_copy_fixup[];
+extern char user_probe_start[], user_probe_end[], user_probe_fixup[];
+
+static const struct {
+	char *ex_start;			// First faulting instruction
+	char *ex_end;			// End of the range
+	char *ex_fixup;			// Resume here with %eax = -E_FAULT
+} ex_table[] = {
+	{ user_copy_start, user_copy_end, user_copy_fixup },
+	{ user_probe_start, user_probe_end, user_probe_fixup },
+};
+
+// If the kernel faulted in one of the ex_table ranges, arrange for it
+// to continue at the fixup code and return true.
+static bool
+trap_fixup(struct Trapframe *tf)
+{
+	for (size_t i = 0; i < sizeof(ex_table) / sizeof(ex_table[0]); i++) {
+		if ((uintptr_t) ex_table[i].ex_start <= tf->tf_eip &&
+		    tf->tf_eip < (uintptr_t) ex_table[i].ex_end) {
+			tf->tf_eip = (uintptr_t) ex_table[i].ex_fixup;
+			tf->tf_regs.reg_eax = -E_FAULT;
+			return true;
+		}
+	}
+	return false;
+}
 
 void
 page_fault_handler(struct Trapframe *tf)
@@ -362,9 +563,38 @@ page_fault_handler(struct Trapframe *tf)
 	// Read processor's CR2 register to find the faulting address
 	fault_va = rcr2();
 
+	// A swapped-out page, or the first touch of a page in a demand-zero
+	// region: bring in the page and retry the access.  This also covers
+	// the kernel touching user memory on behalf of the current
+	// environment.
+	if (!(tf->tf_err & FEC_PR) && fault_va < UTOP && curenv) {
+		if (page_swapin(curenv->env_pgdir, (void *) fault_va) == 0) {
+			curenv->env_memstat.ms_faults[FAULT_SWAP]++;
+			return;
+		}
+		if (vm_reserve_fault(curenv, fault_va) == 0) {
+			curenv->env_memstat.ms_faults[FAULT_ZERO]++;
+			return;
+		}
+	}
+
+	// A write to a copy-on-write page by the kernel, or by an
+	// environment whose pages may have been merged behind its back.
+	// Other environments resolve their own COW faults in the upcall.
+	if ((tf->tf_err & (FEC_PR | FEC_WR)) == (FEC_PR | FEC_WR) &&
+	    fault_va < UTOP && curenv &&
+	    ((tf->tf_cs & 3) == 0 || curenv->env_mergeable) &&
+	    page_cow_break(curenv->env_pgdir, (void *) fault_va) == 0) {
+		curenv->env_memstat.ms_faults[FAULT_COW]++;
+		return;
+	}
+
 	// Handle kernel-mode page faults.
 
 	// LAB 8: Your code here.
+	if (tf->tf_cs == GD_KT && trap_fixup(tf)) {
+		return;
+	}
 	if (tf->tf_cs == GD_KT) {
 		panic(
 			"[0x%08x] page fault in kernel, fault va: 0x%08x",
@@ -408,19 +638,23 @@ page_fault_handler(struct Trapframe *tf)
 
 	if (curenv->env_pgfault_upcall) {
 		uintptr_t uxstacktop = UXSTACKTOP;
+		curenv->env_memstat.ms_faults[FAULT_UPCALL]++;
 		// check if we allready in the exception stack
 		if (tf->tf_esp >= UXSTACKTOP - PGSIZE && tf->tf_esp <= UXSTACKTOP -1) {
 			uxstacktop = tf->tf_esp - 4;
 		}
 		uint32_t offset = sizeof(struct UTrapframe) + sizeof(uint32_t);
-		user_mem_assert(curenv, (void *) uxstacktop - offset, offset, PTE_U | PTE_W);
 		struct UTrapframe *utr = (struct UTrapframe *)(uxstacktop - offset);
-		utr->utf_fault_va = fault_va;
-		utr->utf_err = tf->tf_err;
-		utr->utf_regs = tf->tf_regs;
-		utr->utf_eflags = tf->tf_eflags;
-		utr->utf_esp = tf->tf_esp;
-		utr->utf_eip = tf->tf_eip;
+		struct UTrapframe utf;
+		utf.utf_fault_va = fault_va;
+		utf.utf_err = tf->tf_err;
+		utf.utf_regs = tf->tf_regs;
+		utf.utf_eflags = tf->tf_eflags;
+		utf.utf_esp = tf->tf_esp;
+		utf.utf_eip = tf->tf_eip;
+		if (copy_to_user(utr, &utf, sizeof(utf)) < 0) {
+			user_mem_fault(curenv);
+		}
 
 		tf->tf_eip = (uintptr_t) curenv->env_pgfault_upcall;
 		tf->tf_esp = (uintptr_t) utr;
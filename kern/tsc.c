@@ -10,9 +10,22 @@
 #define DEFAULT_FREQ 2500000
 #define TIMES 100
 
+// The RTC periodic interrupt rate set up by rtc_init.
+#define RTC_HZ 2
+
+// Cycles since the last clocksource_tick may grow to this many seconds
+// before the conversion to nanoseconds overflows.
+#define CS_MAXSEC 600
+
+// Compare the TSC against this many RTC ticks to refine cpu_freq, and
+// accept the result only within CS_MAXDRIFT parts per million.
+#define CS_REFINE_TICKS (64 * RTC_HZ)
+#define CS_MAXDRIFT 10000
+
 static uint64_t timer_start_time;
 
 unsigned long cpu_freq;
+struct clocksource tsc_cs;
 /*
  * This reads the current MSB of the PIT counter, and
  * checks if we are running on sufficiently fast and
@@ -165,6 +178,84 @@ success:
 	return delta;
 }
 
+// Pick the fixed-point factor for converting a count at rate 'from' to
+// one at rate 'to', out = in * mult >> shift: the largest shift for
+// which mult fits in 32 bits and 'maxval' times mult fits in 64 bits.
+void
+calc_mult_shift(uint32_t *mult, uint32_t *shift, uint32_t from,
+		uint32_t to, uint64_t maxval)
+{
+	uint64_t m = 0;
+	uint32_t sh;
+
+	for (sh = 32; sh > 0; sh--) {
+		m = (((uint64_t) to << sh) + from / 2) / from;
+		if (!(m >> 32) && maxval <= ~(uint64_t) 0 / m)
+			break;
+	}
+	*mult = m;
+	*shift = sh;
+}
+
+// Set both conversions of tsc_cs for cycles at 'khz', over at most
+// CS_MAXSEC seconds.
+static void
+clocksource_calc_mult_shift(unsigned long khz)
+{
+	calc_mult_shift(&tsc_cs.cs_mult, &tsc_cs.cs_shift, khz, 1000000,
+			(uint64_t) CS_MAXSEC * khz * 1000);
+	calc_mult_shift(&tsc_cs.cs_cyc_mult, &tsc_cs.cs_cyc_shift, 1000000,
+			khz, (uint64_t) CS_MAXSEC * 1000000000);
+}
+
+// Fold the cycles since the last call into cs_ns_base, so that the
+// delta nanosec_from_timer multiplies stays small.
+static void
+clocksource_accumulate(void)
+{
+	uint64_t tsc = read_tsc();
+
+	tsc_cs.cs_ns_base += (tsc - tsc_cs.cs_tsc_base) * tsc_cs.cs_mult >>
+			     tsc_cs.cs_shift;
+	tsc_cs.cs_tsc_base = tsc;
+}
+
+//
+// Called on every RTC tick.  Besides accumulating, measure the TSC
+// against the RTC crystal: the quick PIT calibration is only good to
+// about 500ppm.  A run of ticks with one missed (interrupts were off for
+// too long) is discarded.
+//
+void
+clocksource_tick(void)
+{
+	static uint64_t ref_tsc, last_tsc;
+	static int nticks;
+	uint64_t tsc = read_tsc();
+	unsigned long khz;
+
+	clocksource_accumulate();
+
+	if (!nticks || tsc - last_tsc > (uint64_t) cpu_freq * 1500 / RTC_HZ) {
+		ref_tsc = last_tsc = tsc;
+		nticks = 1;
+		return;
+	}
+	last_tsc = tsc;
+	if (nticks++ < CS_REFINE_TICKS)
+		return;
+
+	khz = (tsc - ref_tsc) * RTC_HZ / CS_REFINE_TICKS / 1000;
+	ref_tsc = tsc;
+	nticks = 1;
+	if (khz == cpu_freq ||
+	    (uint64_t) (khz > cpu_freq ? khz - cpu_freq : cpu_freq - khz) *
+	    1000000 > (uint64_t) cpu_freq * CS_MAXDRIFT)
+		return;
+	cpu_freq = khz;
+	clocksource_calc_mult_shift(cpu_freq);
+}
+
 void tsc_calibrate(void)
 {
     int i;
@@ -180,6 +271,10 @@ void tsc_calibrate(void)
     cprintf("Detected %lu.%03lu MHz processor.\n",
 		(unsigned long)cpu_freq / 1000,
 		(unsigned long)cpu_freq % 1000);
+
+    tsc_cs.cs_tsc_base = read_tsc();
+    tsc_cs.cs_ns_base = 0;
+    clocksource_calc_mult_shift(cpu_freq);
 }
 
 void print_time(unsigned seconds)
@@ -201,22 +296,32 @@ int second_from_timer(void)
 	return read_tsc() / cpu_freq / 1000;
 }
 
+// Nanoseconds since tsc_calibrate.
 long long nanosec_from_timer(void)
 {
-	return (read_tsc() / cpu_freq) * 1000000;
+	return tsc_cs.cs_ns_base +
+	       ((read_tsc() - tsc_cs.cs_tsc_base) * tsc_cs.cs_mult >>
+		tsc_cs.cs_shift);
 }
 
+// The TSC value at which nanosec_from_timer will reach 'ns'.  Far
+// deadlines are cut to CS_MAXSEC ahead.
+uint64_t tsc_from_nanosec(long long ns)
+{
+	uint64_t now = nanosec_from_timer();
+
+	if (ns <= (long long) now)
+		return read_tsc();
+	ns = MIN(ns - now, (long long) CS_MAXSEC * 1000000000);
+	return read_tsc() + ((uint64_t) ns * tsc_cs.cs_cyc_mult >>
+			     tsc_cs.cs_cyc_shift);
+}
+
+// Resolution of nanosec_from_timer: one cycle, rounded up.
 long long nanosec_interval(void)
 {
-	int fst = read_tsc() / cpu_freq;
-	int snd = read_tsc() / cpu_freq;
-	int delta = snd - fst;
-	if (delta) {
-		return delta * 1000000;
-	}
-	else {
-		return 1000000;
-	}
+	return MAX((tsc_cs.cs_mult + (1ULL << tsc_cs.cs_shift) - 1) >>
+		   tsc_cs.cs_shift, 1);
 }
 
 void timer_start(void)
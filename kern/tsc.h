@@ -6,10 +6,31 @@
 # error "This is a JOS kernel header; user programs should not #include it"
 #endif
 
+#include <inc/types.h>
+
+// Conversion of TSC cycles to nanoseconds:
+// ns = cs_ns_base + ((tsc - cs_tsc_base) * cs_mult >> cs_shift)
+// and of nanoseconds to cycles: cycles = ns * cs_cyc_mult >> cs_cyc_shift
+struct clocksource {
+	uint64_t cs_tsc_base;
+	uint64_t cs_ns_base;
+	uint32_t cs_mult;
+	uint32_t cs_shift;
+	uint32_t cs_cyc_mult;
+	uint32_t cs_cyc_shift;
+};
+
+extern unsigned long cpu_freq;	// kHz
+extern struct clocksource tsc_cs;
+
+void calc_mult_shift(uint32_t *mult, uint32_t *shift, uint32_t from,
+		     uint32_t to, uint64_t maxval);
 void tsc_calibrate(void);
+void clocksource_tick(void);
 void timer_start(void);
 void timer_stop(void);
 long long nanosec_interval(void);
 long long nanosec_from_timer(void);
+uint64_t tsc_from_nanosec(long long ns);
 
 #endif	// !JOS_KERN_TSC_H
@@ -301,6 +301,7 @@ fstat(int fdnum, struct Stat *stat)
 	stat->st_name[0] = 0;
 	stat->st_size = 0;
 	stat->st_isdir = 0;
+	stat->st_extents = 0;
 	stat->st_dev = dev;
 	return (*dev->dev_stat)(fd, stat);
 }
@@ -165,6 +165,7 @@ devfile_stat(struct Fd *fd, struct Stat *st)
 	strcpy(st->st_name, fsipcbuf.statRet.ret_name);
 	st->st_size = fsipcbuf.statRet.ret_size;
 	st->st_isdir = fsipcbuf.statRet.ret_isdir;
+	st->st_extents = fsipcbuf.statRet.ret_extents;
 	return 0;
 }
 
@@ -188,3 +189,29 @@ sync(void)
 	return fsipc(FSREQ_SYNC, NULL);
 }
 
+// Return the file server's block cache statistics in 'stat', after
+// setting its budget to 'budget' blocks and its read-ahead limit to
+// 'ra_max' blocks, each unless it is 0.
+int
+bcstat(uint32_t budget, uint32_t ra_max, struct BcStat *stat)
+{
+	int r;
+
+	fsipcbuf.bcstat.req_budget = budget;
+	fsipcbuf.bcstat.req_ra_max = ra_max;
+	fsipcbuf.bcstat.req_dma = -1;
+	if ((r = fsipc(FSREQ_BCSTAT, NULL)) < 0)
+		return r;
+	*stat = fsipcbuf.bcstatRet.ret_stat;
+	return 0;
+}
+
+// Have the file server move disk data by DMA if 'dma', else by PIO.
+int
+bcdma(bool dma)
+{
+	fsipcbuf.bcstat.req_budget = 0;
+	fsipcbuf.bcstat.req_ra_max = 0;
+	fsipcbuf.bcstat.req_dma = dma;
+	return fsipc(FSREQ_BCSTAT, NULL);
+}
@@ -3,10 +3,6 @@
 #include <inc/string.h>
 #include <inc/lib.h>
 
-// PTE_COW marks copy-on-write page table entries.
-// It is one of the bits explicitly allocated to user processes (PTE_AVAIL).
-#define PTE_COW		0x800
-
 //
 // Custom page fault handler - if faulting page is copy-on-write,
 // map in our own private writable copy.
@@ -140,6 +136,12 @@ fork(void)
 			if (page_va == UXSTACKTOP - PGSIZE) { // user exception stack
 				continue;
 			}
+			// The kernel may have swapped the page out: reading it
+			// brings it back so it can be shared with the child.
+			if ((uvpd[PDX(page_va)] & PTE_P) && uvpt[PGNUM(page_va)] &&
+			    !(uvpt[PGNUM(page_va)] & PTE_P)) {
+				(void) *(volatile char *) page_va;
+			}
 			if ((uvpd[PDX(page_va)] & PTE_P) && (uvpt[PGNUM(page_va)] & PTE_P)) {
 				rc = duppage(envid, PGNUM(page_va));
 				if (rc) {
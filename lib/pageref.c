@@ -10,5 +10,5 @@ pageref(void *v)
 	pte = uvpt[PGNUM(v)];
 	if (!(pte & PTE_P))
 		return 0;
-	return pages[PGNUM(pte)].pp_ref;
+	return pages[PTE_ADDR(pte) >> PGSHIFT].pp_ref;
 }
@@ -56,7 +56,8 @@ pipe(int pfd[2])
 	fd1->fd_omode = O_WRONLY;
 
 	if (debug)
-		cprintf("[%08x] pipecreate %08x\n", thisenv->env_id, uvpt[PGNUM(va)]);
+		cprintf("[%08x] pipecreate %08llx\n", thisenv->env_id,
+			(uint64_t) uvpt[PGNUM(va)]);
 
 	pfd[0] = fd2num(fd0);
 	pfd[1] = fd2num(fd1);
@@ -110,8 +111,9 @@ devpipe_read(struct Fd *fd, void *vbuf, size_t n)
 
 	p = (struct Pipe*)fd2data(fd);
 	if (debug)
-		cprintf("[%08x] devpipe_read %08x %d rpos %d wpos %d\n",
-			thisenv->env_id, uvpt[PGNUM(p)], n, p->p_rpos, p->p_wpos);
+		cprintf("[%08x] devpipe_read %08llx %d rpos %d wpos %d\n",
+			thisenv->env_id, (uint64_t) uvpt[PGNUM(p)], n,
+			p->p_rpos, p->p_wpos);
 
 	buf = vbuf;
 	for (i = 0; i < n; i++) {
@@ -145,8 +147,9 @@ devpipe_write(struct Fd *fd, const void *vbuf, size_t n)
 
 	p = (struct Pipe*) fd2data(fd);
 	if (debug)
-		cprintf("[%08x] devpipe_write %08x %d rpos %d wpos %d\n",
-			thisenv->env_id, uvpt[PGNUM(p)], n, p->p_rpos, p->p_wpos);
+		cprintf("[%08x] devpipe_write %08llx %d rpos %d wpos %d\n",
+			thisenv->env_id, (uint64_t) uvpt[PGNUM(p)], n,
+			p->p_rpos, p->p_wpos);
 
 	buf = vbuf;
 	for (i = 0; i < n; i++) {
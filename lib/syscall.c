@@ -1,6 +1,7 @@
 // System call stubs.
 
 #include <inc/syscall.h>
+#include <inc/vsyscall.h>
 #include <inc/lib.h>
 
 static inline int32_t
@@ -8,6 +9,27 @@ syscall(int num, int check, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
 {
 	int32_t ret;
 
+	// Where the CPU supports it, enter the kernel with sysenter, which
+	// is much cheaper than an interrupt gate.  sysenter saves neither
+	// the return address nor the stack pointer: pass them in SI and BP
+	// (restored from the stack afterwards), leaving no room for a fifth
+	// parameter.  sysexit returns with DX and CX clobbered.
+	if (a5 == 0 && vsys[VSYS_sysenter]) {
+		asm volatile("pushl %%ebp\n"
+			     "\tmovl %%esp, %%ebp\n"
+			     "\tleal 1f, %%esi\n"
+			     "\tsysenter\n"
+			     "1:\tpopl %%ebp\n"
+			: "=a" (ret),
+			  "+d" (a1),
+			  "+c" (a2)
+			: "a" (num),
+			  "b" (a3),
+			  "D" (a4)
+			: "esi", "cc", "memory");
+		goto out;
+	}
+
 	// Generic system call: pass system call number in AX,
 	// up to five parameters in DX, CX, BX, DI, SI.
 	// Interrupt kernel with T_SYSCALL.
@@ -31,6 +53,7 @@ syscall(int num, int check, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
 		  "S" (a5)
 		: "cc", "memory");
 
+out:
 	if(check && ret > 0)
 		panic("syscall %d returned %d (> 0)", num, ret);
 
@@ -85,6 +108,30 @@ sys_page_unmap(envid_t envid, void *va)
 	return syscall(SYS_page_unmap, 1, envid, (uint32_t) va, 0, 0, 0);
 }
 
+int
+sys_vm_reserve(void *va, size_t len, int perm)
+{
+	return syscall(SYS_vm_reserve, 1, (uint32_t) va, len, perm, 0, 0);
+}
+
+int
+sys_env_memstat(envid_t envid, struct EnvMemStat *ms)
+{
+	return syscall(SYS_env_memstat, 0, envid, (uint32_t) ms, 0, 0, 0);
+}
+
+int
+sys_env_set_mergeable(envid_t envid, bool mergeable)
+{
+	return syscall(SYS_env_set_mergeable, 1, envid, mergeable, 0, 0, 0);
+}
+
+int
+sys_page_merge_stat(struct MergeStat *stat)
+{
+	return syscall(SYS_page_merge_stat, 0, (uint32_t) stat, 0, 0, 0, 0);
+}
+
 // sys_exofork is inlined in lib.h
 
 int
@@ -105,6 +152,74 @@ sys_env_set_pgfault_upcall(envid_t envid, void *upcall)
 	return syscall(SYS_env_set_pgfault_upcall, 1, envid, (uint32_t) upcall, 0, 0, 0);
 }
 
+int
+sys_env_set_timer_upcall(envid_t envid, void *upcall)
+{
+	return syscall(SYS_env_set_timer_upcall, 1, envid, (uint32_t) upcall, 0, 0, 0);
+}
+
+int
+sys_timer_create(clockid_t clock_id)
+{
+	return syscall(SYS_timer_create, 0, clock_id, 0, 0, 0, 0);
+}
+
+int
+sys_timer_settime(timer_t id, int flags, const struct itimerspec *value,
+		  struct itimerspec *ovalue)
+{
+	return syscall(SYS_timer_settime, 0, id, flags, (uint32_t) value,
+		       (uint32_t) ovalue, 0);
+}
+
+int
+sys_timer_delete(timer_t id)
+{
+	return syscall(SYS_timer_delete, 0, id, 0, 0, 0, 0);
+}
+
+int
+sys_timer_getoverrun(timer_t id)
+{
+	return syscall(SYS_timer_getoverrun, 0, id, 0, 0, 0, 0);
+}
+
+int
+sys_prof_start(unsigned hz)
+{
+	return syscall(SYS_prof_start, 0, hz, 0, 0, 0, 0);
+}
+
+int
+sys_prof_read(struct ProfSample *samples, size_t n)
+{
+	return syscall(SYS_prof_read, 0, (uint32_t) samples, n, 0, 0, 0);
+}
+
+int
+sys_prof_symbol(envid_t envid, uintptr_t pc, struct ProfSymbol *sym)
+{
+	return syscall(SYS_prof_symbol, 0, envid, pc, (uint32_t) sym, 0, 0);
+}
+
+int
+sys_irq_wait(int irq)
+{
+	return syscall(SYS_irq_wait, 0, irq, 0, 0, 0, 0);
+}
+
+int
+sys_page_paddr(void *va, physaddr_t *pa)
+{
+	return syscall(SYS_page_paddr, 0, (uint32_t) va, (uint32_t) pa, 0, 0, 0);
+}
+
+int
+sys_dma_map(void *va, physaddr_t *pa)
+{
+	return syscall(SYS_dma_map, 0, (uint32_t) va, (uint32_t) pa, 0, 0, 0);
+}
+
 int
 sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, int perm)
 {
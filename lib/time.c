@@ -11,64 +11,55 @@ int d_to_s(int d)
     return d * 24 * 60 * 60;
 }
 
+// Days from 1970-01-01 to the given date of the proleptic Gregorian
+// calendar (month 1-12), in constant time: shifting the year to start in
+// March puts the leap day last, so the day of the year follows from the
+// month with a linear formula, and 400-year eras repeat exactly.
+static int days_from_civil(int y, int m, int d)
+{
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// The inverse of days_from_civil.
+static void civil_from_days(int z, int *yp, int *mp, int *dp)
+{
+    z += 719468;
+    int era = (z >= 0 ? z : z - 146096) / 146097;
+    int doe = z - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mon = (5 * doy + 2) / 153;
+    *dp = doy - (153 * mon + 2) / 5 + 1;
+    *mp = mon < 10 ? mon + 3 : mon - 9;
+    *yp = yoe + era * 400 + (*mp <= 2);
+}
+
+// Note that tm_year counts from 1970 here, as the RTC keeps it.
 int timestamp(const struct tm *time)
 {
-    int result = 0, year, month;
-    for (year = 1970; year < time->tm_year + 1970; year++)
-    {
-        result += d_to_s(365 + is_leap_year(year));
-    }
-    int months[] = {31, 28 + is_leap_year(year), 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
-    for (month = 0; month < time->tm_mon; month++)
-    {
-        result += d_to_s(months[month]);
-    }
-    result += d_to_s(time->tm_mday) + time->tm_hour*60*60 + time->tm_min*60 + time->tm_sec;
-    return result;
+    return d_to_s(days_from_civil(time->tm_year + 1970, time->tm_mon + 1,
+                                  time->tm_mday)) +
+        time->tm_hour*60*60 + time->tm_min*60 + time->tm_sec;
 }
 
 void mktime(int time, struct tm *tm)
 {
-    int year = 70;
-    int month = 0;
-    int day = 0;
-    int hour = 0;
-    int minute = 0;
-
-    while (time > d_to_s(365 + is_leap_year(1900+year))) {
-        time -= d_to_s(365 + is_leap_year(1900+year));
-        year++;
-    }
-    tm->tm_year = year;
-
-    int months[] = {31, 28 + is_leap_year(1900+year), 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
-
-    while (time > d_to_s(months[month])){
-        time -= d_to_s(months[month]);
-        month++;
-    }
-    tm->tm_mon = month;
+    int year, month, day;
 
-    while (time > d_to_s(1)) {
-        time -= d_to_s(1);
-        day++;
-    }
+    civil_from_days(time / d_to_s(1), &year, &month, &day);
+    tm->tm_year = year - 1900;
+    tm->tm_mon = month - 1;
     tm->tm_mday = day;
 
-    while (time >= 60*60) {
-        time -= 60*60;
-        hour++;
-    }
-
-    tm->tm_hour = hour;
-
-    while (time >= 60) {
-        time -= 60;
-        minute++;
-    }
-
-    tm->tm_min = minute;
-    tm->tm_sec = time;
+    time %= d_to_s(1);
+    tm->tm_hour = time / (60*60);
+    tm->tm_min = time / 60 % 60;
+    tm->tm_sec = time % 60;
 }
 
 void print_datetime(struct tm *tm)
@@ -143,9 +134,20 @@ int clock_getres_dummy(clockid_t clock_id, struct timespec *res)
 
 int clock_gettime(clockid_t clock_id, struct timespec *tp)
 {
+    if (vsys_clock_gettime(clock_id, tp) == 0)
+        return 0;
     return sys_clock_gettime(clock_id, tp);
 }
 
+// Nanoseconds on CLOCK_MONOTONIC, for timing intervals.
+long long now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * NANOSECONDS + ts.tv_nsec;
+}
+
 int clock_settime(clockid_t clock_id, const struct timespec *tp)
 {
     return sys_clock_settime(clock_id, tp);
@@ -160,3 +162,62 @@ int clock_nanosleep(
 {
     return sys_clock_nanosleep(clock_id, flags, rqtp, rmtp);
 }
+
+extern void _timer_upcall(void);
+
+static void (*timer_handlers[NITIMER])(timer_t);
+
+// Called by _timer_upcall on the exception stack with the mask of
+// expired timers in utf_err.
+void _timer_handler(struct UTrapframe *utf)
+{
+    for (timer_t id = 0; id < NITIMER; id++)
+        if ((utf->utf_err & (1 << id)) && timer_handlers[id])
+            timer_handlers[id](id);
+}
+
+// Create a timer on 'clock_id' that calls 'handler' with its id each
+// time it expires.  The handler runs on the user exception stack, the
+// next time the environment is scheduled after the expiry.
+int timer_create(clockid_t clock_id, void (*handler)(timer_t), timer_t *timerid)
+{
+    static bool upcall_set;
+    void *uxstack = (void *) (UXSTACKTOP - PGSIZE);
+    int r;
+
+    if (!upcall_set) {
+        if ((!(uvpd[PDX(uxstack)] & PTE_P) || !(uvpt[PGNUM(uxstack)] & PTE_P)) &&
+            (r = sys_page_alloc(0, uxstack, PTE_P | PTE_W | PTE_U)) < 0)
+            return r;
+        if ((r = sys_env_set_timer_upcall(0, _timer_upcall)) < 0)
+            return r;
+        upcall_set = true;
+    }
+
+    if ((r = sys_timer_create(clock_id)) < 0)
+        return r;
+    timer_handlers[r] = handler;
+    *timerid = r;
+    return 0;
+}
+
+int timer_settime(timer_t timerid, int flags, const struct itimerspec *value,
+                  struct itimerspec *ovalue)
+{
+    return sys_timer_settime(timerid, flags, value, ovalue);
+}
+
+int timer_delete(timer_t timerid)
+{
+    int r;
+
+    if ((r = sys_timer_delete(timerid)) < 0)
+        return r;
+    timer_handlers[timerid] = NULL;
+    return 0;
+}
+
+int timer_getoverrun(timer_t timerid)
+{
+    return sys_timer_getoverrun(timerid);
+}
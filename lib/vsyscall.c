@@ -1,5 +1,6 @@
 #include <inc/vsyscall.h>
 #include <inc/lib.h>
+#include <inc/x86.h>
 
 static inline int32_t
 vsyscall(int num)
@@ -21,9 +22,51 @@ vsys_clock_getres(clockid_t clock_id)
         return NULL;
     }
     if (clock_id != CLOCK_REALTIME) {
-        return (struct timespec*) vsys + VSYS_CLOCK_MONOTONIC;
+        return (struct timespec*) (vsys + VSYS_CLOCK_MONOTONIC);
     }
     else {
-        return (struct timespec*) vsys + VSYS_CLOCK_REALTIME;
+        return (struct timespec*) (vsys + VSYS_CLOCK_REALTIME);
     }
-}
\ No newline at end of file
+}
+
+// Split 'ns' into seconds and nanoseconds.  The quotient fits in 32 bits
+// for the next hundred years, so a single divl does.
+static void
+ns_to_timespec(uint64_t ns, struct timespec *tp)
+{
+	uint32_t sec, rem;
+
+	asm("divl %4"
+	    : "=a" (sec), "=d" (rem)
+	    : "a" ((uint32_t) ns), "d" ((uint32_t) (ns >> 32)),
+	      "rm" ((uint32_t) NANOSECONDS));
+	tp->tv_sec = sec;
+	tp->tv_nsec = rem;
+}
+
+// Read CLOCK_MONOTONIC or CLOCK_REALTIME from the clock data the kernel
+// publishes in the vsyscall page, without a system call.  Returns
+// -E_INVAL for other clocks, which need the kernel.
+int
+vsys_clock_gettime(clockid_t clock_id, struct timespec *tp)
+{
+	const volatile struct vsys_clock *vc =
+		(const volatile struct vsys_clock *) (vsys + VSYS_clock);
+	uint32_t seq;
+	uint64_t ns;
+
+	if ((clock_id != CLOCK_MONOTONIC && clock_id != CLOCK_REALTIME) ||
+	    !vc->vc_mult)
+		return -E_INVAL;
+
+	do {
+		seq = vc->vc_seq;
+		ns = vc->vc_mono_base +
+		     ((read_tsc() - vc->vc_tsc_base) * vc->vc_mult >> vc->vc_shift);
+		if (clock_id == CLOCK_REALTIME)
+			ns += vc->vc_real_offset;
+	} while ((seq & 1) || vc->vc_seq != seq);
+
+	ns_to_timespec(ns, tp);
+	return 0;
+}
@@ -0,0 +1,90 @@
+// age the file system with interleaved appends to many files and
+// random truncations, then report what block allocation cost and how
+// fragmented the files ended up
+
+#include <inc/lib.h>
+
+#define NFILES		32
+#define NROUNDS		8
+#define NAPPENDS	8
+#define MAXCHUNK	4		// blocks per append, at most
+#define MAXSIZE		(64 * BLKSIZE)
+
+static char buf[MAXCHUNK * BLKSIZE];
+static uint32_t seed = 1;
+
+static uint32_t
+rnd(uint32_t n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) % n;
+}
+
+void
+umain(int argc, char **argv)
+{
+	char path[MAXPATHLEN];
+	int fds[NFILES], r;
+	struct BcStat before, after;
+	int nblocks = 0, nextents = 0;
+	uint32_t allocated, scanned;
+	struct Stat st;
+	long long start;
+
+	memset(buf, 'a', sizeof(buf));
+	for (int i = 0; i < NFILES; i++) {
+		snprintf(path, sizeof(path), "/agebench.%d", i);
+		if ((fds[i] = open(path, O_RDWR | O_CREAT | O_TRUNC)) < 0)
+			panic("open %s: %i", path, fds[i]);
+	}
+	if ((r = bcstat(0, 0, &before)) < 0)
+		panic("bcstat: %i", r);
+
+	start = now();
+	for (int round = 0; round < NROUNDS; round++) {
+		// Appends of the files take turns, as with concurrent writers.
+		for (int n = 0; n < NAPPENDS; n++)
+			for (int i = 0; i < NFILES; i++) {
+				size_t len = (1 + rnd(MAXCHUNK)) * BLKSIZE;
+
+				if ((r = fstat(fds[i], &st)) < 0)
+					panic("fstat: %i", r);
+				if (st.st_size + len > MAXSIZE)
+					continue;
+				seek(fds[i], st.st_size);
+				if ((r = write(fds[i], buf, len)) != len)
+					panic("write: %i", r);
+			}
+		// Leave holes in the free space.
+		for (int i = 0; i < NFILES; i++)
+			if (rnd(3) == 0 && (r = ftruncate(fds[i], 0)) < 0)
+				panic("ftruncate: %i", r);
+	}
+	start = now() - start;
+	if ((r = bcstat(0, 0, &after)) < 0)
+		panic("bcstat: %i", r);
+
+	for (int i = 0; i < NFILES; i++) {
+		if ((r = fstat(fds[i], &st)) < 0)
+			panic("fstat: %i", r);
+		nblocks += st.st_size / BLKSIZE;
+		nextents += st.st_extents;
+	}
+
+	allocated = after.bc_alloc_blocks - before.bc_alloc_blocks;
+	scanned = after.bc_alloc_scanned - before.bc_alloc_scanned;
+	cprintf("aging:   %d ms, %d blocks allocated, %d.%02d bitmap words "
+		"examined per block\n", (int) (start / 1000000), allocated,
+		scanned / MAX(allocated, 1),
+		scanned * 100 / MAX(allocated, 1) % 100);
+	cprintf("layout:  %d blocks in %d extents, %d.%02d extents per file, "
+		"%d blocks per extent\n", nblocks, nextents,
+		nextents / NFILES, nextents * 100 / NFILES % 100,
+		nblocks / MAX(nextents, 1));
+
+	// There is no remove, give the blocks back at least.
+	for (int i = 0; i < NFILES; i++) {
+		ftruncate(fds[i], 0);
+		close(fds[i]);
+	}
+}
@@ -0,0 +1,64 @@
+#include <inc/lib.h>
+
+// Report the file server's block cache statistics, after changing its
+// budget to the number of blocks given as argument, its read-ahead
+// limit to the number given with -r and, with -d 0 or -d 1, whether
+// the disk transfers by PIO or DMA.
+
+void
+usage(void)
+{
+	printf("usage: bcstat [-r ra_max] [-d dma] [budget]\n");
+	exit();
+}
+
+void
+umain(int argc, char **argv)
+{
+	struct Argstate args;
+	struct BcStat st;
+	uint32_t ra_max = 0;
+	int dma = -1;
+	int r;
+
+	argstart(&argc, argv, &args);
+	while ((r = argnext(&args)) >= 0)
+		switch (r) {
+		case 'r':
+			ra_max = strtol(argvalue(&args), 0, 0);
+			break;
+		case 'd':
+			dma = strtol(argvalue(&args), 0, 0);
+			break;
+		default:
+			usage();
+		}
+	if (argc > 2)
+		usage();
+
+	if (dma >= 0 && (r = bcdma(dma)) < 0) {
+		printf("bcdma: %i\n", r);
+		exit();
+	}
+	if ((r = bcstat(argc == 2 ? strtol(argv[1], 0, 0) : 0, ra_max, &st)) < 0) {
+		printf("bcstat: %i\n", r);
+		exit();
+	}
+
+	printf("budget:     %d blocks\n", st.bc_budget);
+	printf("resident:   %d blocks, %d dirty\n", st.bc_resident, st.bc_dirty);
+	printf("hits:       %d\n", st.bc_hits);
+	printf("misses:     %d\n", st.bc_misses);
+	printf("evictions:  %d\n", st.bc_evictions);
+	printf("writebacks: %d\n", st.bc_writebacks);
+	printf("read-ahead: %d blocks, runs of up to %d\n",
+	       st.bc_readahead, st.bc_ra_max);
+	printf("write-back: %d blocks in %d disk writes\n",
+	       st.bc_wb_blocks, st.bc_wb_runs);
+	printf("names:      %d cached lookups, %d directory searches\n",
+	       st.bc_dc_hits, st.bc_dc_misses);
+	printf("allocator:  %d blocks, %d bitmap words examined\n",
+	       st.bc_alloc_blocks, st.bc_alloc_scanned);
+	printf("disk:       %s, %s\n", st.bc_virtio ? "virtio-blk" : "IDE",
+	       st.bc_dma ? "DMA" : "PIO");
+}
@@ -0,0 +1,68 @@
+// benchmark clock_gettime: CLOCK_MONOTONIC and CLOCK_REALTIME read in
+// user mode from the vsyscall page against sys_clock_gettime, and how
+// far the two disagree; and sys_gettime, whose cost used to be that of
+// reading the RTC, as every clock tick and sched_yield did
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define ROUNDS		10000
+
+static const struct {
+	clockid_t id;
+	const char *name;
+} clocks[] = {
+	{ CLOCK_MONOTONIC, "monotonic" },
+	{ CLOCK_REALTIME, "realtime" },
+};
+
+static int64_t
+ns(const struct timespec *tp)
+{
+	return (int64_t) tp->tv_sec * NANOSECONDS + tp->tv_nsec;
+}
+
+void
+umain(int argc, char **argv)
+{
+	struct timespec ts, before, after;
+
+	cprintf("clock_gettime cycles per call:\n");
+	cprintf("                  vsys  syscall  skew (ns)\n");
+	for (int i = 0; i < (int) (sizeof(clocks) / sizeof(clocks[0])); i++) {
+		uint32_t vcycles, scycles;
+		uint64_t start;
+		int r;
+
+		if ((r = vsys_clock_gettime(clocks[i].id, &ts)) < 0)
+			panic("vsys_clock_gettime: %i", r);
+
+		start = read_tsc();
+		for (int j = 0; j < ROUNDS; j++)
+			vsys_clock_gettime(clocks[i].id, &ts);
+		vcycles = (uint32_t) ((read_tsc() - start) / ROUNDS);
+
+		start = read_tsc();
+		for (int j = 0; j < ROUNDS; j++)
+			sys_clock_gettime(clocks[i].id, &ts);
+		scycles = (uint32_t) ((read_tsc() - start) / ROUNDS);
+
+		// The kernel's reading must fall between two user-mode ones.
+		vsys_clock_gettime(clocks[i].id, &before);
+		sys_clock_gettime(clocks[i].id, &ts);
+		vsys_clock_gettime(clocks[i].id, &after);
+		if (ns(&ts) < ns(&before) || ns(&ts) > ns(&after))
+			panic("%s: syscall %lld not within [%lld, %lld]",
+			      clocks[i].name, ns(&ts), ns(&before), ns(&after));
+
+		cprintf("  %-12s %7u  %7u  %9lld\n", clocks[i].name,
+			vcycles, scycles, ns(&after) - ns(&before));
+	}
+
+	uint64_t start = read_tsc();
+
+	for (int j = 0; j < ROUNDS; j++)
+		sys_gettime();
+	cprintf("sys_gettime cycles per call: %u\n",
+		(uint32_t) ((read_tsc() - start) / ROUNDS));
+}
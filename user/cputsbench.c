@@ -0,0 +1,33 @@
+// benchmark the user memory access of a system call: sys_cputs on large
+// buffers.  The buffers hold only NUL bytes, so nothing is printed and
+// the time goes into checking and copying the user memory.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define MAXLEN		(1024 * 1024)
+#define ROUNDS		16
+
+static char buf[MAXLEN];
+
+void
+umain(int argc, char **argv)
+{
+	static const size_t lens[] = { 64, PGSIZE, 64 * 1024, MAXLEN };
+
+	// Fault the buffer in first.
+	for (size_t off = 0; off < MAXLEN; off += PGSIZE)
+		buf[off] = 0;
+
+	cprintf("sys_cputs cycles per call:\n");
+	for (int i = 0; i < (int) (sizeof(lens) / sizeof(lens[0])); i++) {
+		uint64_t start = read_tsc();
+		uint32_t cycles;
+
+		for (int j = 0; j < ROUNDS; j++)
+			sys_cputs(buf, lens[i]);
+		cycles = (uint32_t) (read_tsc() - start) / ROUNDS;
+		cprintf("  %7u bytes  %9u  (%u per KB)\n", lens[i], cycles,
+			cycles / MAX(lens[i] / 1024, 1));
+	}
+}
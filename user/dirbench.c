@@ -0,0 +1,60 @@
+// measure creating and then opening many files in one directory, and
+// how many blocks the file server reads to look them up
+
+#include <inc/lib.h>
+
+#define NFILES		10000
+
+static void
+report(const char *what, int ops, long long ns, struct BcStat *before)
+{
+	struct BcStat after;
+	int r;
+
+	ns = now() - ns;
+	if ((r = bcstat(0, 0, &after)) < 0)
+		panic("bcstat: %i", r);
+	cprintf("%-7s %5d ops/s, %5d blocks read, %6d cache hits\n", what,
+		(int) ((long long) ops * NANOSECONDS / ns),
+		after.bc_misses - before->bc_misses,
+		after.bc_hits - before->bc_hits);
+	*before = after;
+}
+
+void
+umain(int argc, char **argv)
+{
+	char path[MAXPATHLEN];
+	int nfiles = NFILES;
+	struct BcStat st;
+	long long start;
+	int fd, r;
+
+	if (argc > 1)
+		nfiles = strtol(argv[1], 0, 0);
+
+	// Files are never removed, a second run opens the same ones.
+	if ((fd = open("/dirbench", O_RDONLY | O_CREAT | O_MKDIR)) < 0)
+		panic("mkdir /dirbench: %i", fd);
+	close(fd);
+	if ((r = bcstat(0, 0, &st)) < 0)
+		panic("bcstat: %i", r);
+
+	start = now();
+	for (int i = 0; i < nfiles; i++) {
+		snprintf(path, sizeof(path), "/dirbench/f%d", i);
+		if ((fd = open(path, O_WRONLY | O_CREAT)) < 0)
+			panic("create %s: %i", path, fd);
+		close(fd);
+	}
+	report("create", nfiles, start, &st);
+
+	start = now();
+	for (int i = 0; i < nfiles; i++) {
+		snprintf(path, sizeof(path), "/dirbench/f%d", i);
+		if ((fd = open(path, O_RDONLY)) < 0)
+			panic("open %s: %i", path, fd);
+		close(fd);
+	}
+	report("open", nfiles, start, &st);
+}
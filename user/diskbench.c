@@ -0,0 +1,84 @@
+// measure sequential and random read throughput and sequential write
+// throughput of the file server's disk from a cold block cache; run it
+// once with each disk (make FSDISK=ide or FSDISK=virtio) to compare
+
+#include <inc/lib.h>
+
+#define FILE_MB		4
+#define CHUNK		8192
+#define NRANDOM		512
+
+static char buf[CHUNK];
+
+// Shrink the cache to drop the file's blocks, then restore it.
+static void
+drop_cache(void)
+{
+	struct BcStat st, tmp;
+	int r;
+
+	if ((r = bcstat(0, 0, &st)) < 0 ||
+	    (r = bcstat(32, 0, &tmp)) < 0 ||
+	    (r = bcstat(st.bc_budget, 0, &tmp)) < 0)
+		panic("bcstat: %i", r);
+}
+
+static void
+report(const char *what, long long bytes, long long start)
+{
+	cprintf("%-12s %5lld KB/s\n", what,
+		bytes * NANOSECONDS / 1024 / (now() - start));
+}
+
+void
+umain(int argc, char **argv)
+{
+	uint32_t seed = 1;
+	struct BcStat st;
+	long long start;
+	int fd, n, r, total;
+
+	if ((r = bcstat(0, 0, &st)) < 0)
+		panic("bcstat: %i", r);
+	cprintf("disk: %s, %s\n", st.bc_virtio ? "virtio-blk" : "IDE",
+		st.bc_dma ? "DMA" : "PIO");
+
+	start = now();
+	if ((fd = open("/diskbench", O_WRONLY | O_CREAT | O_TRUNC)) < 0)
+		panic("open: %i", fd);
+	for (int i = 0; i < (FILE_MB << 20) / CHUNK; i++) {
+		memset(buf, i, sizeof(buf));
+		if ((r = write(fd, buf, sizeof(buf))) != sizeof(buf))
+			panic("write: %i", r);
+	}
+	close(fd);
+	if ((r = sync()) < 0)
+		panic("sync: %i", r);
+	report("seq write", FILE_MB << 20, start);
+
+	drop_cache();
+	if ((fd = open("/diskbench", O_RDONLY)) < 0)
+		panic("open: %i", fd);
+	start = now();
+	for (total = 0; (n = read(fd, buf, sizeof(buf))) > 0; total += n)
+		/* do nothing */;
+	if (n < 0)
+		panic("read: %i", n);
+	report("seq read", total, start);
+
+	// Blocks at random offsets: every fault reads a single block.
+	drop_cache();
+	start = now();
+	for (int i = 0; i < NRANDOM; i++) {
+		seed = seed * 1103515245 + 12345;
+		seek(fd, (seed >> 8) % ((FILE_MB << 20) / BLKSIZE) * BLKSIZE);
+		if ((r = readn(fd, buf, BLKSIZE)) != BLKSIZE)
+			panic("read: %i", r);
+	}
+	report("random read", (long long) NRANDOM * BLKSIZE, start);
+	close(fd);
+
+	// There is no remove, give the blocks back at least.
+	if ((fd = open("/diskbench", O_WRONLY | O_TRUNC)) >= 0)
+		close(fd);
+}
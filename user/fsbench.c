@@ -0,0 +1,71 @@
+// measure small-file create and append throughput, and how many IDE
+// writes the file server's write-back spends on them
+
+#include <inc/lib.h>
+
+#define NFILES		64
+#define FILESIZE	1024
+#define NAPPENDS	512
+#define APPENDSIZE	128
+
+static char buf[FILESIZE];
+
+static void
+report(const char *what, int ops, long long ns, struct BcStat *before)
+{
+	struct BcStat after;
+	int r;
+
+	// Include the write-back of what was dirtied.
+	if ((r = sync()) < 0)
+		panic("sync: %i", r);
+	ns = now() - ns;
+	if ((r = bcstat(0, 0, &after)) < 0)
+		panic("bcstat: %i", r);
+	cprintf("%-7s %5d ops/s, %4d blocks in %4d IDE writes\n", what,
+		(int) ((long long) ops * NANOSECONDS / ns),
+		after.bc_wb_blocks - before->bc_wb_blocks,
+		after.bc_wb_runs - before->bc_wb_runs);
+	*before = after;
+}
+
+void
+umain(int argc, char **argv)
+{
+	char path[MAXPATHLEN];
+	struct BcStat st;
+	long long start;
+	int fd, r;
+
+	memset(buf, 'x', sizeof(buf));
+	if ((r = sync()) < 0 || (r = bcstat(0, 0, &st)) < 0)
+		panic("sync: %i", r);
+
+	start = now();
+	for (int i = 0; i < NFILES; i++) {
+		snprintf(path, sizeof(path), "/fsbench.%d", i);
+		if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC)) < 0)
+			panic("open %s: %i", path, fd);
+		if ((r = write(fd, buf, FILESIZE)) != FILESIZE)
+			panic("write %s: %i", path, r);
+		close(fd);
+	}
+	report("create", NFILES, start, &st);
+
+	start = now();
+	if ((fd = open("/fsbench.0", O_WRONLY)) < 0)
+		panic("open: %i", fd);
+	seek(fd, FILESIZE);
+	for (int i = 0; i < NAPPENDS; i++)
+		if ((r = write(fd, buf, APPENDSIZE)) != APPENDSIZE)
+			panic("append: %i", r);
+	close(fd);
+	report("append", NAPPENDS, start, &st);
+
+	// There is no remove, give the blocks back at least.
+	for (int i = 0; i < NFILES; i++) {
+		snprintf(path, sizeof(path), "/fsbench.%d", i);
+		if ((fd = open(path, O_WRONLY | O_TRUNC)) >= 0)
+			close(fd);
+	}
+}
@@ -0,0 +1,130 @@
+// measure how much CPU a compute-bound environment keeps while another
+// one reads a file from a cold block cache, the read throughput, and
+// the CPU time the file server spends per MB, with PIO and with DMA
+
+#include <inc/lib.h>
+
+#define FILE_MB		2
+#define CHUNK		8192
+#define RUN_MS		2000
+
+// Shared with the compute child.
+#define COUNT_VA	((volatile uint32_t *) 0xA0000000)
+
+static char buf[CHUNK];
+
+// Shrink the cache to drop the file's blocks, then restore it.
+static void
+drop_cache(void)
+{
+	struct BcStat st, tmp;
+	int r;
+
+	if ((r = bcstat(0, 0, &st)) < 0 ||
+	    (r = bcstat(32, 0, &tmp)) < 0 ||
+	    (r = bcstat(st.bc_budget, 0, &tmp)) < 0)
+		panic("bcstat: %i", r);
+}
+
+// CPU time the file server has used so far.
+static long long
+fs_cpu(void)
+{
+	static envid_t fsenv;
+	const volatile struct Env *e;
+
+	if (!fsenv)
+		fsenv = ipc_find_env(ENV_TYPE_FS);
+	e = &envs[ENVX(fsenv)];
+	return (long long) e->env_time.tv_sec * NANOSECONDS + e->env_time.tv_nsec;
+}
+
+static int
+read_file(void)
+{
+	int fd, n, total = 0;
+
+	drop_cache();
+	if ((fd = open("/iobench", O_RDONLY)) < 0)
+		panic("open: %i", fd);
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		total += n;
+	if (n < 0)
+		panic("read: %i", n);
+	close(fd);
+	return total;
+}
+
+// Count in a child for RUN_MS, reading the file over and over
+// meanwhile if 'mode' is not NULL.  Returns the child's count.
+static uint32_t
+run(const char *mode)
+{
+	long long start = now(), stop = start + RUN_MS * 1000000LL;
+	long long bytes = 0, cpu = fs_cpu();
+	envid_t child;
+
+	*COUNT_VA = 0;
+	if ((child = fork()) < 0)
+		panic("fork: %i", child);
+	if (child == 0) {
+		volatile uint32_t count = 0;
+
+		while (now() < stop)
+			for (int i = 0; i < 1000; i++)
+				count++;
+		*COUNT_VA = count;
+		exit();
+	}
+
+	while (mode && now() < stop)
+		bytes += read_file();
+	if (mode)
+		cprintf("%s: read %4lld KB/s, file server %3lld us CPU per MB, ",
+			mode, bytes * NANOSECONDS / 1024 / (now() - start),
+			(fs_cpu() - cpu) / 1000 / MAX(bytes >> 20, 1));
+	wait(child);
+	return *COUNT_VA;
+}
+
+void
+umain(int argc, char **argv)
+{
+	uint32_t alone, shared;
+	struct BcStat st;
+	int fd, r;
+
+	if ((r = sys_page_alloc(0, (void *) COUNT_VA,
+				PTE_P | PTE_U | PTE_W | PTE_SHARE)) < 0)
+		panic("sys_page_alloc: %i", r);
+
+	if ((fd = open("/iobench", O_WRONLY | O_CREAT | O_TRUNC)) < 0)
+		panic("open: %i", fd);
+	for (int i = 0; i < (FILE_MB << 20) / CHUNK; i++) {
+		memset(buf, i, sizeof(buf));
+		if ((r = write(fd, buf, sizeof(buf))) != sizeof(buf))
+			panic("write: %i", r);
+	}
+	close(fd);
+	if ((r = sync()) < 0)
+		panic("sync: %i", r);
+
+	if ((r = bcstat(0, 0, &st)) < 0)
+		panic("bcstat: %i", r);
+	alone = run(NULL);
+	cprintf("compute alone: %u\n", alone);
+	for (int dma = 0; dma <= 1; dma++) {
+		if ((r = bcdma(dma)) < 0) {
+			cprintf("DMA: %i\n", r);
+			break;
+		}
+		shared = run(dma ? "DMA" : "PIO");
+		cprintf("compute %u%%\n",
+			(uint32_t) ((long long) shared * 100 / MAX(alone, 1)));
+	}
+	bcdma(st.bc_dma);
+
+	// There is no remove, give the blocks back at least.
+	if ((fd = open("/iobench", O_WRONLY | O_TRUNC)) >= 0)
+		close(fd);
+}
@@ -0,0 +1,74 @@
+// test interval timers: a periodic timer, overruns while asleep, and a
+// one-shot absolute timer
+
+#include <inc/lib.h>
+
+static volatile int ticks;
+static volatile int overruns;
+
+static void
+handler(timer_t id)
+{
+	int r;
+
+	if ((r = timer_getoverrun(id)) < 0)
+		panic("timer_getoverrun: %i", r);
+	overruns += r;
+	ticks++;
+}
+
+void
+umain(int argc, char **argv)
+{
+	struct itimerspec its = { { 0, 10000000 }, { 0, 10000000 } };
+	struct timespec rq = { 0, 100000000 };
+	long long start, elapsed;
+	timer_t t;
+	int r;
+
+	if ((r = timer_create(CLOCK_MONOTONIC, handler, &t)) < 0)
+		panic("timer_create: %i", r);
+
+	// 20 periods of 10ms
+	start = now();
+	if ((r = timer_settime(t, 0, &its, NULL)) < 0)
+		panic("timer_settime: %i", r);
+	while (ticks < 20)
+		sys_yield();
+	elapsed = now() - start;
+	if (elapsed < 200000000LL - 10000000)
+		panic("20 ticks in %lld us", elapsed / 1000);
+	cprintf("periodic: 20 ticks in %lld us, %d overruns\n",
+		elapsed / 1000, overruns);
+
+	// Expiries while the environment sleeps are batched into one upcall.
+	ticks = overruns = 0;
+	if ((r = clock_nanosleep(CLOCK_MONOTONIC, 0, &rq, NULL)) < 0)
+		panic("clock_nanosleep: %i", r);
+	if (ticks != 1 || overruns < 5)
+		panic("after sleeping: %d upcalls, %d overruns", ticks, overruns);
+	cprintf("asleep: 1 upcall, %d overruns\n", overruns);
+
+	// One-shot, absolute
+	ticks = 0;
+	memset(&its, 0, sizeof(its));
+	start = now() + 20000000;
+	its.it_value.tv_sec = start / NANOSECONDS;
+	its.it_value.tv_nsec = start % NANOSECONDS;
+	if ((r = timer_settime(t, TIMER_ABSTIME, &its, NULL)) < 0)
+		panic("timer_settime: %i", r);
+	while (ticks < 1)
+		sys_yield();
+	if (now() < start)
+		panic("one-shot timer fired early");
+	if ((r = clock_nanosleep(CLOCK_MONOTONIC, 0, &rq, NULL)) < 0)
+		panic("clock_nanosleep: %i", r);
+	if (ticks != 1)
+		panic("one-shot timer fired %d times", ticks);
+
+	if ((r = timer_delete(t)) < 0)
+		panic("timer_delete: %i", r);
+	if ((r = timer_delete(t)) != -E_INVAL)
+		panic("timer_delete twice: %i", r);
+	cprintf("itimer ok\n");
+}
@@ -30,8 +30,8 @@ memlayout(void)
 		for (j = 0; j < NPTENTRIES; j++) {
 			if (pgtab[j] == 0)
 				continue;
-			cprintf("[%p] %p -> %08x: %c %c %c |%s%s\n",
-					pgtab + j, PGADDR(i, j, 0), pgtab[j],
+			cprintf("[%p] %p -> %08llx: %c %c %c |%s%s\n",
+					pgtab + j, PGADDR(i, j, 0), (uint64_t) pgtab[j],
 					(pgtab[j] & PTE_P) ? total_p++, 'P' : '-',
 					(pgtab[j] & PTE_U) ? total_u++, 'U' : '-',
 					(pgtab[j] & PTE_W) ? total_w++, 'W' : '-',
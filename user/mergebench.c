@@ -0,0 +1,124 @@
+// benchmark same-page merging: spawn NCHILD copies of this program, each
+// holding the same TABLE_PAGES of data, let the kernel merge them and
+// report the pages saved and what the background scan costs a
+// CPU-bound environment
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define NCHILD		100
+#define TABLE_PAGES	16
+#define TABLE_WORDS	(TABLE_PAGES * PGSIZE / 4)
+#define WORK_ROUNDS	200
+
+static uint32_t table[TABLE_WORDS];
+
+static void
+fill(void)
+{
+	for (int i = 0; i < TABLE_WORDS; i++)
+		table[i] = i * 2654435761U;
+}
+
+static void
+verify(const char *when)
+{
+	for (int i = 0; i < TABLE_WORDS; i++)
+		if (table[i] != i * 2654435761U)
+			panic("table[%d] corrupted %s", i, when);
+}
+
+// Wait for the parent, then check that merging kept the data intact,
+// including across a write that gives the child its own copy again.
+static void
+child(void)
+{
+	envid_t who;
+
+	fill();
+	ipc_recv(&who, 0, 0);
+	verify("after merging");
+	table[0] = 1;
+	table[0] = 0;
+	verify("after copy-on-write");
+}
+
+// CPU-bound loop that yields often, so the scheduler (and with it the
+// merge scanner) runs between rounds.
+static uint32_t
+work(void)
+{
+	uint64_t start = read_tsc();
+	volatile uint32_t x = 0;
+
+	for (int i = 0; i < WORK_ROUNDS; i++) {
+		for (int j = 0; j < 100000; j++)
+			x += j;
+		sys_yield();
+	}
+	return (uint32_t) (read_tsc() - start);
+}
+
+static uint32_t
+children_rss(envid_t *kids)
+{
+	uint32_t rss = 0;
+
+	for (int i = 0; i < NCHILD; i++)
+		rss += envs[ENVX(kids[i])].env_memstat.ms_rss;
+	return rss;
+}
+
+void
+umain(int argc, char **argv)
+{
+	static envid_t kids[NCHILD];
+	struct MergeStat before, after;
+	uint32_t work_off, work_on, prev;
+	int i, r;
+
+	if (argc > 1 && strcmp(argv[1], "child") == 0) {
+		child();
+		return;
+	}
+
+	for (i = 0; i < NCHILD; i++)
+		if ((kids[i] = spawnl("mergebench", "mergebench", "child", 0)) < 0)
+			panic("spawn: %i", kids[i]);
+	for (i = 0; i < NCHILD; i++)
+		while (envs[ENVX(kids[i])].env_status != ENV_NOT_RUNNABLE)
+			sys_yield();
+
+	if ((r = sys_page_merge_stat(&before)) < 0)
+		panic("sys_page_merge_stat: %i", r);
+	work_off = work();
+
+	for (i = 0; i < NCHILD; i++)
+		if ((r = sys_env_set_mergeable(kids[i], 1)) < 0)
+			panic("sys_env_set_mergeable: %i", r);
+	work_on = work();
+
+	// Let the scanner finish before looking at the result.
+	sys_page_merge_stat(&after);
+	do {
+		prev = after.mg_merged;
+		work();
+		sys_page_merge_stat(&after);
+	} while (after.mg_merged != prev);
+
+	cprintf("%d children, %u resident pages\n", NCHILD, children_rss(kids));
+	cprintf("pages merged:  %u\n", after.mg_merged - before.mg_merged);
+	cprintf("pages saved:   %u (%u KB)\n", after.mg_saved,
+		after.mg_saved * (PGSIZE / 1024));
+	cprintf("pages hashed:  %u\n", after.mg_scanned - before.mg_scanned);
+	cprintf("scan cycles:   %u\n",
+		(uint32_t) (after.mg_cycles - before.mg_cycles));
+	cprintf("work cycles:   %u without merging, %u with\n",
+		work_off, work_on);
+
+	for (i = 0; i < NCHILD; i++)
+		ipc_send(kids[i], 0, 0, 0);
+	for (i = 0; i < NCHILD; i++)
+		wait(kids[i]);
+	cprintf("mergebench done\n");
+}
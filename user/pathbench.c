@@ -0,0 +1,90 @@
+// measure the latency of open() for the program path of repeated
+// spawns, for deep paths, and for names that do not exist
+
+#include <inc/lib.h>
+
+#define NSPAWNS		50
+#define NOPENS		1000
+#define DEPTH		8
+
+static void
+report(const char *what, int ops, long long ns, struct BcStat *before)
+{
+	struct BcStat after;
+	int r;
+
+	ns = now() - ns;
+	if ((r = bcstat(0, 0, &after)) < 0)
+		panic("bcstat: %i", r);
+	cprintf("%-8s %6d us/op, %6d names cached, %5d searched\n", what,
+		(int) (ns / ops / 1000),
+		after.bc_dc_hits - before->bc_dc_hits,
+		after.bc_dc_misses - before->bc_dc_misses);
+	*before = after;
+}
+
+// Open 'path' 'n' times; it must exist iff 'exists'.
+static void
+open_loop(const char *path, int n, bool exists)
+{
+	int fd;
+
+	for (int i = 0; i < n; i++) {
+		fd = open(path, O_RDONLY);
+		if (exists && fd < 0)
+			panic("open %s: %i", path, fd);
+		if (!exists && fd != -E_NOT_FOUND)
+			panic("open %s: %i, not -E_NOT_FOUND", path, fd);
+		if (fd >= 0)
+			close(fd);
+	}
+}
+
+void
+umain(int argc, char **argv)
+{
+	char path[MAXPATHLEN] = "/pathbench";
+	struct BcStat st;
+	long long start;
+	envid_t child;
+	int fd, r;
+
+	// The spawned copies only exit.
+	if (argc > 1)
+		return;
+
+	// Directories are never removed, a second run reuses them.
+	for (int i = 0; i <= DEPTH; i++) {
+		if ((fd = open(path, O_RDONLY | O_CREAT | O_MKDIR)) < 0)
+			panic("mkdir %s: %i", path, fd);
+		close(fd);
+		strcat(path, "/d");
+	}
+	strcat(path, "/file");
+	if ((fd = open(path, O_WRONLY | O_CREAT)) < 0)
+		panic("create %s: %i", path, fd);
+	close(fd);
+	if ((r = bcstat(0, 0, &st)) < 0)
+		panic("bcstat: %i", r);
+
+	start = now();
+	for (int i = 0; i < NSPAWNS; i++) {
+		if ((child = spawnl("/pathbench", "pathbench", "-c", 0)) < 0)
+			panic("spawn: %i", child);
+		wait(child);
+	}
+	report("spawn", NSPAWNS, start, &st);
+
+	start = now();
+	open_loop("/pathbench", NOPENS, true);
+	report("shallow", NOPENS, start, &st);
+
+	start = now();
+	open_loop(path, NOPENS, true);
+	report("deep", NOPENS, start, &st);
+
+	strcat(path, ".none");
+	start = now();
+	open_loop(path, NOPENS, false);
+	report("missing", NOPENS, start, &st);
+}
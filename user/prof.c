@@ -0,0 +1,241 @@
+// prof: sample where CPU time goes and print a flat and a call-graph
+// profile.  All environments but prof itself are sampled; given a
+// command, prof spawns it and stops when it exits.
+
+#include <inc/lib.h>
+
+#define NFUNC		256
+#define NEDGE		512
+#define NCACHE		512
+#define NBUF		64
+#define NTOP		25
+
+struct Func {
+	char name[sizeof(((struct ProfSymbol *) 0)->psym_name)];
+	bool kernel;
+	uint32_t self;		// Samples with the function on top
+	uint32_t total;		// Samples with the function anywhere
+	uint32_t mark;		// Last sample counted in 'total'
+};
+
+struct Edge {
+	int caller, callee;
+	uint32_t count;
+};
+
+// Symbols of recently seen (environment, pc) pairs.
+struct Cache {
+	envid_t env;
+	uintptr_t pc;
+	int func;
+};
+
+static struct Func funcs[NFUNC];
+static struct Edge edges[NEDGE];
+static struct Cache cache[NCACHE];
+static int nfuncs, nedges;
+static uint32_t nsamples, nidle;
+
+static int
+func_find(const char *name, bool kernel)
+{
+	int i;
+
+	for (i = 0; i < nfuncs; i++)
+		if (funcs[i].kernel == kernel && strcmp(funcs[i].name, name) == 0)
+			return i;
+	if (nfuncs == NFUNC)
+		return -1;
+	strcpy(funcs[i].name, name);
+	funcs[i].kernel = kernel;
+	return nfuncs++;
+}
+
+static int
+symbolize(envid_t env, uintptr_t pc)
+{
+	struct Cache *c = &cache[(pc ^ env) % NCACHE];
+	struct ProfSymbol sym;
+
+	if (c->env == env && c->pc == pc)
+		return c->func;
+	if (sys_prof_symbol(env, pc, &sym) < 0)
+		strcpy(sym.psym_name, "<exited>");
+	c->env = env;
+	c->pc = pc;
+	c->func = func_find(sym.psym_name, pc >= ULIM);
+	return c->func;
+}
+
+static void
+edge_add(int caller, int callee)
+{
+	for (int i = 0; i < nedges; i++)
+		if (edges[i].caller == caller && edges[i].callee == callee) {
+			edges[i].count++;
+			return;
+		}
+	if (nedges < NEDGE)
+		edges[nedges++] = (struct Edge) { caller, callee, 1 };
+}
+
+static void
+account(const struct ProfSample *ps)
+{
+	int fn[PROF_DEPTH];
+
+	nsamples++;
+	if (!ps->ps_env)
+		nidle++;
+	for (uint32_t d = 0; d < ps->ps_depth; d++) {
+		if ((fn[d] = symbolize(ps->ps_env, ps->ps_pc[d])) < 0)
+			return;
+		if (d == 0)
+			funcs[fn[d]].self++;
+		else
+			edge_add(fn[d], fn[d - 1]);
+		// Count recursive functions once per sample.
+		if (funcs[fn[d]].mark != nsamples) {
+			funcs[fn[d]].mark = nsamples;
+			funcs[fn[d]].total++;
+		}
+	}
+}
+
+static void
+drain(void)
+{
+	static struct ProfSample buf[NBUF];
+	int n;
+
+	while ((n = sys_prof_read(buf, NBUF)) > 0)
+		for (int i = 0; i < n; i++)
+			if (buf[i].ps_env != thisenv->env_id)
+				account(&buf[i]);
+}
+
+// Print 'n' of nsamples as a percentage with one decimal.
+static void
+percent(uint32_t n)
+{
+	uint32_t pm = nsamples ? n * 1000 / nsamples : 0;
+
+	printf(" %3d.%d%%", pm / 10, pm % 10);
+}
+
+static const char *
+func_name(int i)
+{
+	static char buf[sizeof(funcs[0].name) + 4];
+
+	snprintf(buf, sizeof(buf), "%s%s", funcs[i].kernel ? "[k] " : "",
+		 funcs[i].name);
+	return buf;
+}
+
+static void
+sort(int *order, bool by_total)
+{
+	for (int i = 0; i < nfuncs; i++)
+		order[i] = i;
+	for (int i = 1; i < nfuncs; i++)
+		for (int j = i; j > 0; j--) {
+			const struct Func *a = &funcs[order[j - 1]];
+			const struct Func *b = &funcs[order[j]];
+			int t;
+
+			if (by_total ? a->total >= b->total : a->self >= b->self)
+				break;
+			t = order[j];
+			order[j] = order[j - 1];
+			order[j - 1] = t;
+		}
+}
+
+static void
+report(unsigned hz)
+{
+	static int order[NFUNC];
+	int i;
+
+	printf("%d samples at %d Hz, %d idle\n\n", nsamples, hz, nidle);
+	if (!nsamples)
+		return;
+
+	printf("flat profile:\n");
+	printf("    self   total  function\n");
+	sort(order, false);
+	for (i = 0; i < nfuncs && i < NTOP && funcs[order[i]].self; i++) {
+		percent(funcs[order[i]].self);
+		percent(funcs[order[i]].total);
+		printf("  %s\n", func_name(order[i]));
+	}
+
+	printf("\ncall graph:\n");
+	sort(order, true);
+	for (i = 0; i < nfuncs && i < NTOP; i++) {
+		int f = order[i];
+
+		percent(funcs[f].total);
+		printf("  %s\n", func_name(f));
+		for (int j = 0; j < nedges; j++)
+			if (edges[j].callee == f)
+				printf("             %6d  called from %s\n",
+				       edges[j].count, func_name(edges[j].caller));
+		for (int j = 0; j < nedges; j++)
+			if (edges[j].caller == f)
+				printf("             %6d  calls %s\n",
+				       edges[j].count, func_name(edges[j].callee));
+	}
+}
+
+void
+usage(void)
+{
+	printf("usage: prof [-f hz] [-t ms] [command [arg...]]\n");
+	exit();
+}
+
+void
+umain(int argc, char **argv)
+{
+	struct timespec tick = { 0, 20000000 };
+	unsigned hz = 1000, ms = 2000;
+	envid_t child = 0;
+	struct Argstate args;
+	long long stop;
+	int i, r;
+
+	argstart(&argc, argv, &args);
+	while ((i = argnext(&args)) >= 0)
+		switch (i) {
+		case 'f':
+			hz = strtol(argvalue(&args), 0, 0);
+			break;
+		case 't':
+			ms = strtol(argvalue(&args), 0, 0);
+			break;
+		default:
+			usage();
+		}
+
+	if ((r = sys_prof_start(hz)) < 0)
+		panic("sys_prof_start: %i", r);
+	if (argc > 1 && (child = spawn(argv[1], (const char **) argv + 1)) < 0)
+		panic("spawn %s: %i", argv[1], child);
+
+	// Symbolize as we go, while the sampled environments still exist.
+	stop = now() + (long long) ms * 1000000;
+	while (now() < stop) {
+		sys_clock_nanosleep(CLOCK_MONOTONIC, 0, &tick, NULL);
+		drain();
+		if (child && (envs[ENVX(child)].env_id != child ||
+			      envs[ENVX(child)].env_status == ENV_FREE ||
+			      envs[ENVX(child)].env_status == ENV_DYING))
+			break;
+	}
+	sys_prof_start(0);
+	drain();
+
+	report(hz);
+}
@@ -0,0 +1,118 @@
+#include <inc/lib.h>
+
+// Report memory use of the environments, from the read-only 'envs'
+// array, or in detail for the envids given as arguments.
+
+int flag[256];
+
+static const char *status_names[] = {
+	[ENV_FREE] = "free",
+	[ENV_DYING] = "dying",
+	[ENV_RUNNABLE] = "runnable",
+	[ENV_RUNNING] = "running",
+	[ENV_NOT_RUNNABLE] = "blocked",
+};
+
+static const char *
+status_name(unsigned status)
+{
+	if (status < sizeof(status_names) / sizeof(status_names[0]) && status_names[status])
+		return status_names[status];
+	return "?";
+}
+
+static void
+ps(void)
+{
+	static int order[NENV];
+	int n = 0;
+
+	for (int i = 0; i < NENV; i++)
+		if (envs[i].env_status != ENV_FREE)
+			order[n++] = i;
+
+	// Largest resident set first, insertion sort is plenty for NENV.
+	if (flag['s'] || flag['t'])
+		for (int i = 1; i < n; i++)
+			for (int j = i; j > 0 &&
+			     envs[order[j]].env_memstat.ms_rss >
+			     envs[order[j - 1]].env_memstat.ms_rss; j--) {
+				int t = order[j];
+				order[j] = order[j - 1];
+				order[j - 1] = t;
+			}
+
+	printf("   ENVID   PARENT STATUS     RSS(K) SHARED    COW   SWAP PGTAB\n");
+	for (int i = 0; i < n; i++) {
+		const volatile struct Env *e = &envs[order[i]];
+		const volatile struct EnvMemStat *ms = &e->env_memstat;
+
+		printf("%08x %08x %-8s %8d %6d %6d %6d %5d\n",
+		       e->env_id, e->env_parent_id, status_name(e->env_status),
+		       ms->ms_rss * (PGSIZE / 1024), ms->ms_shared, ms->ms_cow,
+		       ms->ms_swapped, ms->ms_pgtables);
+	}
+}
+
+static void
+ps1(envid_t envid)
+{
+	struct EnvMemStat ms;
+	int r;
+
+	if ((r = sys_env_memstat(envid, &ms)) < 0) {
+		printf("%08x: %i\n", envid, r);
+		return;
+	}
+	printf("env %08x\n", envid);
+	printf("  resident:    %d pages\n", ms.ms_rss);
+	printf("  shared:      %d pages\n", ms.ms_shared);
+	printf("  cow:         %d pages\n", ms.ms_cow);
+	printf("  swapped:     %d pages\n", ms.ms_swapped);
+	printf("  page tables: %d pages\n", ms.ms_pgtables);
+	printf("  faults:      %d demand-zero, %d swap-in, %d upcall, "
+	       "%d copy-on-write\n",
+	       ms.ms_faults[FAULT_ZERO], ms.ms_faults[FAULT_SWAP],
+	       ms.ms_faults[FAULT_UPCALL], ms.ms_faults[FAULT_COW]);
+}
+
+void
+usage(void)
+{
+	printf("usage: ps [-st] [envid...]\n");
+	exit();
+}
+
+void
+umain(int argc, char **argv)
+{
+	struct timespec second = { .tv_sec = 1, .tv_nsec = 0 };
+	struct Argstate args;
+	int i;
+
+	argstart(&argc, argv, &args);
+	while ((i = argnext(&args)) >= 0)
+		switch (i) {
+		case 's':
+		case 't':
+			flag[i]++;
+			break;
+		default:
+			usage();
+		}
+
+	if (argc > 1) {
+		for (i = 1; i < argc; i++)
+			ps1(strtol(argv[i], 0, 16));
+		return;
+	}
+
+	// -t refreshes the list like top(1), for ten seconds.
+	for (i = 0; i < (flag['t'] ? 10 : 1); i++) {
+		if (i > 0) {
+			sys_clock_nanosleep(CLOCK_MONOTONIC, 0, &second, NULL);
+			printf("\n");
+		}
+		ps();
+	}
+}
@@ -0,0 +1,78 @@
+// measure sequential read throughput of a multi-MB file from a cold
+// block cache, without and with read-ahead
+
+#include <inc/lib.h>
+
+#define FILE_MB		3
+#define CHUNK		8192	// what user/cat reads at a time
+#define RA_MAX		32	// 256 sectors, the most one IDE command reads
+
+static char buf[CHUNK];
+
+// Shrink the cache to drop the file's blocks, then restore it.
+static void
+drop_cache(void)
+{
+	struct BcStat st, tmp;
+	int r;
+
+	if ((r = bcstat(0, 0, &st)) < 0 ||
+	    (r = bcstat(32, 0, &tmp)) < 0 ||
+	    (r = bcstat(st.bc_budget, 0, &tmp)) < 0)
+		panic("bcstat: %i", r);
+}
+
+static void
+run(uint32_t ra_max)
+{
+	struct BcStat before, after;
+	long long start, ns;
+	int fd, n, r, total = 0;
+
+	drop_cache();
+	if ((r = bcstat(0, ra_max, &before)) < 0)
+		panic("bcstat: %i", r);
+	if ((fd = open("/readbench", O_RDONLY)) < 0)
+		panic("open: %i", fd);
+
+	start = now();
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		total += n;
+	ns = now() - start;
+	if (n < 0)
+		panic("read: %i", n);
+	if (total != FILE_MB << 20)
+		panic("read %d bytes", total);
+	close(fd);
+
+	bcstat(0, 0, &after);
+	cprintf("read-ahead %2d: %4lld KB/s, %d faults\n", ra_max,
+		(long long) total * NANOSECONDS / 1024 / ns,
+		after.bc_misses - before.bc_misses);
+}
+
+void
+umain(int argc, char **argv)
+{
+	struct BcStat st;
+	int fd, r;
+
+	if ((fd = open("/readbench", O_WRONLY | O_CREAT | O_TRUNC)) < 0)
+		panic("open: %i", fd);
+	for (int i = 0; i < (FILE_MB << 20) / CHUNK; i++) {
+		memset(buf, i, sizeof(buf));
+		if ((r = write(fd, buf, sizeof(buf))) != sizeof(buf))
+			panic("write: %i", r);
+	}
+	close(fd);
+
+	if ((r = bcstat(0, 0, &st)) < 0)
+		panic("bcstat: %i", r);
+	run(1);
+	run(RA_MAX);
+	bcstat(0, st.bc_ra_max, &st);
+
+	// There is no remove, give the blocks back at least.
+	if ((fd = open("/readbench", O_WRONLY | O_TRUNC)) >= 0)
+		close(fd);
+}
@@ -0,0 +1,43 @@
+// measure how much clock_nanosleep(CLOCK_MONOTONIC) oversleeps, for
+// requests from 10us to 10ms
+
+#include <inc/lib.h>
+
+#define ROUNDS		32
+
+static const long long reqs[] = { 10000, 100000, 1000000, 10000000 };
+
+void
+umain(int argc, char **argv)
+{
+	long long over[ROUNDS];
+
+	cprintf("clock_nanosleep overshoot (us):\n");
+	cprintf("  request      min   median      p90      max\n");
+	for (int i = 0; i < (int) (sizeof(reqs) / sizeof(reqs[0])); i++) {
+		struct timespec rq = { 0, reqs[i] };
+
+		for (int j = 0; j < ROUNDS; j++) {
+			long long start = now();
+			int r;
+
+			if ((r = clock_nanosleep(CLOCK_MONOTONIC, 0, &rq, NULL)) < 0)
+				panic("clock_nanosleep: %i", r);
+			over[j] = now() - start - reqs[i];
+			if (over[j] < 0)
+				panic("woke %lld ns early", -over[j]);
+		}
+
+		// insertion sort, for the percentiles
+		for (int j = 1; j < ROUNDS; j++)
+			for (int k = j; k > 0 && over[k - 1] > over[k]; k--) {
+				long long t = over[k];
+				over[k] = over[k - 1];
+				over[k - 1] = t;
+			}
+
+		cprintf("  %7lld %8lld %8lld %8lld %8lld\n", reqs[i] / 1000,
+			over[0] / 1000, over[ROUNDS / 2] / 1000,
+			over[ROUNDS * 9 / 10] / 1000, over[ROUNDS - 1] / 1000);
+	}
+}
@@ -0,0 +1,59 @@
+// benchmark system call entry: sys_getenvid and sys_yield through
+// int $T_SYSCALL and through the library stubs, which use sysenter
+// where the CPU supports it
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define ROUNDS		10000
+
+static int32_t
+int_syscall(int num)
+{
+	int32_t ret;
+
+	asm volatile("int %1\n"
+		: "=a" (ret)
+		: "i" (T_SYSCALL),
+		  "a" (num)
+		: "cc", "memory");
+	return ret;
+}
+
+static uint32_t
+bench_int(int num)
+{
+	uint64_t start = read_tsc();
+
+	for (int i = 0; i < ROUNDS; i++)
+		int_syscall(num);
+	return (uint32_t) ((read_tsc() - start) / ROUNDS);
+}
+
+static uint32_t
+bench_lib(void (*fn)(void))
+{
+	uint64_t start = read_tsc();
+
+	for (int i = 0; i < ROUNDS; i++)
+		fn();
+	return (uint32_t) ((read_tsc() - start) / ROUNDS);
+}
+
+static void
+getenvid(void)
+{
+	sys_getenvid();
+}
+
+void
+umain(int argc, char **argv)
+{
+	cprintf("system call cycles per call (%s):\n",
+		vsys[VSYS_sysenter] ? "sysenter" : "no sysenter");
+	cprintf("               int  stub\n");
+	cprintf("  getenvid  %6u %6u\n",
+		bench_int(SYS_getenvid), bench_lib(getenvid));
+	cprintf("  yield     %6u %6u\n",
+		bench_int(SYS_yield), bench_lib(sys_yield));
+}
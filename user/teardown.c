@@ -0,0 +1,67 @@
+// benchmark env_destroy on a large address space: a child maps NPAGES
+// pages, NALIAS times each, then the parent destroys it and reports how
+// long it took until it could run again and until the kernel had freed
+// the child's memory
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define NPAGES		2560
+#define NALIAS		4
+#define BASE		((char *) 0x10000000)
+#define ALIASBASE	((char *) 0x20000000)
+
+static void
+child(void)
+{
+	envid_t who;
+	char *va;
+	int r;
+
+	for (int i = 0; i < NPAGES; i++) {
+		va = BASE + i * PGSIZE;
+		if ((r = sys_page_alloc(0, va, PTE_P | PTE_U | PTE_W)) < 0)
+			panic("sys_page_alloc: %i", r);
+		for (int j = 1; j < NALIAS; j++) {
+			char *alias = ALIASBASE + (j * NPAGES + i) * PGSIZE;
+
+			if ((r = sys_page_map(0, va, 0, alias, PTE_P | PTE_U)) < 0)
+				panic("sys_page_map: %i", r);
+		}
+	}
+	ipc_send(thisenv->env_parent_id, 0, 0, 0);
+	ipc_recv(&who, 0, 0);
+}
+
+void
+umain(int argc, char **argv)
+{
+	uint32_t rss, cycles, reaped;
+	uint64_t start;
+	envid_t who;
+	int r;
+
+	if ((r = fork()) < 0)
+		panic("fork: %i", r);
+	if (r == 0) {
+		child();
+		return;
+	}
+
+	ipc_recv(&who, 0, 0);
+	rss = envs[ENVX(who)].env_memstat.ms_rss;
+
+	start = read_tsc();
+	if ((r = sys_env_destroy(who)) < 0)
+		panic("sys_env_destroy: %i", r);
+	cycles = (uint32_t) (read_tsc() - start);
+
+	// the slot is recycled once the teardown has finished
+	while (envs[ENVX(who)].env_status != ENV_FREE)
+		sys_yield();
+	reaped = (uint32_t) (read_tsc() - start);
+
+	cprintf("destroyed env with %u mapped pages: %u cycles, %u per page\n",
+		rss, cycles, cycles / rss);
+	cprintf("memory reclaimed after %u cycles\n", reaped);
+}
@@ -0,0 +1,56 @@
+// check that the file server keeps its I/O privilege, and can still
+// reach the disk, after blocking in ipc_recv
+
+#include <inc/lib.h>
+
+static char buf[2][4096];
+
+static int
+readfile(const char *path, char *dst)
+{
+	int fd, n;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		panic("open %s: %i", path, fd);
+	if ((n = readn(fd, dst, sizeof(buf[0]))) < 0)
+		panic("read %s: %i", path, n);
+	close(fd);
+	return n;
+}
+
+void
+umain(int argc, char **argv)
+{
+	struct timespec tick = { 0, 50000000 };
+	envid_t fsenv = ipc_find_env(ENV_TYPE_FS);
+	const volatile struct Env *fs = &envs[ENVX(fsenv)];
+	struct BcStat st, tmp;
+	int fd, n, r;
+
+	n = readfile("/newmotd", buf[0]);
+
+	// The file server is back in ipc_recv, waiting for our next request.
+	sys_clock_nanosleep(CLOCK_MONOTONIC, 0, &tick, NULL);
+	if ((fs->env_tf.tf_eflags & FL_IOPL_MASK) != FL_IOPL_3)
+		panic("file server eflags %08x lost IOPL 3",
+		      fs->env_tf.tf_eflags);
+
+	// Shrink the block cache so that the blocks are read from disk again.
+	if ((r = bcstat(0, 0, &st)) < 0 || (r = bcstat(32, 0, &tmp)) < 0)
+		panic("bcstat: %i", r);
+	if (readfile("/newmotd", buf[1]) != n || memcmp(buf[0], buf[1], n))
+		panic("/newmotd reads back different");
+	if ((fd = open("/testfsiopl", O_WRONLY | O_CREAT | O_TRUNC)) < 0)
+		panic("open /testfsiopl: %i", fd);
+	if ((r = write(fd, buf[0], n)) != n)
+		panic("write /testfsiopl: %i", r);
+	close(fd);
+	if ((r = sync()) < 0)
+		panic("sync: %i", r);
+	if ((r = bcstat(st.bc_budget, 0, &tmp)) < 0)
+		panic("bcstat: %i", r);
+	if ((fs->env_tf.tf_eflags & FL_IOPL_MASK) != FL_IOPL_3)
+		panic("file server lost IOPL 3 after disk I/O");
+
+	cprintf("file server IOPL is good\n");
+}
@@ -0,0 +1,95 @@
+// check that pages above 4G are usable: allocate pages until some lie
+// there, check their contents across a fork with copy-on-write, and
+// write them to a file and read them back.  Needs a kernel built with
+// CONFIG_PAE=y, run with more than 4G of memory (QEMUEXTRA='-m 6G').
+
+#include <inc/lib.h>
+
+#define NPAGES		256
+#define NFILEPAGES	16
+#define BASE		0x10000000
+#define PATTERN		0x9E3779B9
+
+static bool
+page_above4g(uintptr_t va)
+{
+	return ((uint64_t) PTE_ADDR(uvpt[PGNUM(va)]) >> 32) != 0;
+}
+
+static void
+fill(int i, uint32_t salt)
+{
+	uint32_t *p = (uint32_t *) (BASE + i * PGSIZE);
+
+	for (int j = 0; j < PGSIZE / 4; j++)
+		p[j] = (i * PGSIZE + j) ^ salt;
+}
+
+static void
+verify(const char *who, int i, uint32_t salt)
+{
+	uint32_t *p = (uint32_t *) (BASE + i * PGSIZE);
+
+	for (int j = 0; j < PGSIZE / 4; j++)
+		if (p[j] != ((i * PGSIZE + j) ^ salt))
+			panic("%s: page %d word %d reads %08x", who, i, j, p[j]);
+}
+
+void
+umain(int argc, char **argv)
+{
+	static char buf[NFILEPAGES * PGSIZE];
+	struct BcStat st, tmp;
+	int i, r, fd, nhigh = 0;
+	envid_t child;
+
+	for (i = 0; i < NPAGES; i++) {
+		if ((r = sys_page_alloc(0, (void *) (BASE + i * PGSIZE),
+					PTE_P | PTE_U | PTE_W)) < 0)
+			panic("sys_page_alloc: %i", r);
+		fill(i, PATTERN);
+		nhigh += page_above4g(BASE + i * PGSIZE);
+	}
+	if (!nhigh) {
+		cprintf("no pages above 4G, nothing to check\n");
+		return;
+	}
+	cprintf("%d of %d pages above 4G\n", nhigh, NPAGES);
+
+	// The child's writes copy the pages, the parent's stay as they are.
+	if ((child = fork()) < 0)
+		panic("fork: %i", child);
+	if (child == 0) {
+		for (i = 0; i < NPAGES; i++) {
+			verify("child", i, PATTERN);
+			fill(i, ~PATTERN);
+			verify("child", i, ~PATTERN);
+		}
+		return;
+	}
+	wait(child);
+	for (i = 0; i < NPAGES; i++)
+		verify("parent", i, PATTERN);
+
+	// The block cache and the disk driver see the pages as well.
+	if ((fd = open("/testpae", O_RDWR | O_CREAT | O_TRUNC)) < 0)
+		panic("open /testpae: %i", fd);
+	if ((r = write(fd, (void *) BASE, sizeof(buf))) != sizeof(buf))
+		panic("write /testpae: %i", r);
+	if ((r = sync()) < 0)
+		panic("sync: %i", r);
+	// Shrink the block cache so that the blocks are read from disk again.
+	if ((r = bcstat(0, 0, &st)) < 0 || (r = bcstat(32, 0, &tmp)) < 0)
+		panic("bcstat: %i", r);
+	seek(fd, 0);
+	if ((r = readn(fd, buf, sizeof(buf))) != sizeof(buf))
+		panic("read /testpae: %i", r);
+	if (memcmp(buf, (void *) BASE, sizeof(buf)))
+		panic("/testpae reads back different");
+	if ((r = bcstat(st.bc_budget, 0, &tmp)) < 0)
+		panic("bcstat: %i", r);
+	ftruncate(fd, 0);
+	close(fd);
+
+	cprintf("pae is good\n");
+}
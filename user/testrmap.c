@@ -0,0 +1,72 @@
+// check that widely shared pages can still be mapped: let the kernel
+// merge identical pages into one, map that page many times over, and
+// fork children that inherit every mapping, more in all than the
+// reverse mapping entries allocated at boot
+
+#include <inc/lib.h>
+
+#define TABLE_PAGES	32
+#define NCHILD		8
+#define NMAP		12288		// Mappings of one page per environment
+#define MAPVA		0xC0000000
+#define PATTERN		0x5A5A5A5A
+
+static uint32_t table[TABLE_PAGES][PGSIZE / 4] __attribute__((aligned(PGSIZE)));
+
+static void
+verify(const char *who)
+{
+	for (int i = 0; i < NMAP; i += 97)
+		if (*(volatile uint32_t *) (MAPVA + i * PGSIZE) != PATTERN)
+			panic("%s: mapping %d reads wrong", who, i);
+	for (int p = 0; p < TABLE_PAGES; p++)
+		if (table[p][PGSIZE / 4 - 1] != PATTERN)
+			panic("%s: table page %d reads wrong", who, p);
+}
+
+void
+umain(int argc, char **argv)
+{
+	struct MergeStat before, after;
+	envid_t kids[NCHILD];
+	int i, r;
+
+	for (int p = 0; p < TABLE_PAGES; p++)
+		for (i = 0; i < PGSIZE / 4; i++)
+			table[p][i] = PATTERN;
+
+	// Give the scanner a while to merge the table into one page.
+	sys_page_merge_stat(&before);
+	if ((r = sys_env_set_mergeable(0, 1)) < 0)
+		panic("sys_env_set_mergeable: %i", r);
+	for (i = 0; i < 1000; i++) {
+		sys_page_merge_stat(&after);
+		if (after.mg_merged - before.mg_merged >= TABLE_PAGES - 1)
+			break;
+		sys_yield();
+	}
+	cprintf("%d table pages merged\n", after.mg_merged - before.mg_merged);
+
+	for (i = 0; i < NMAP; i++)
+		if ((r = sys_page_map(0, table[0], 0,
+				      (void *) (MAPVA + i * PGSIZE),
+				      PTE_P | PTE_U)) < 0)
+			panic("sys_page_map %d: %i", i, r);
+
+	for (i = 0; i < NCHILD; i++) {
+		if ((kids[i] = fork()) < 0)
+			panic("fork: %i", kids[i]);
+		if (kids[i] == 0) {
+			verify("child");
+			// Copy-on-write must still work on the merged page.
+			table[1][0] = 0;
+			if (table[0][0] != PATTERN || table[2][0] != PATTERN)
+				panic("child: write leaked to other pages");
+			return;
+		}
+	}
+	for (i = 0; i < NCHILD; i++)
+		wait(kids[i]);
+	verify("parent");
+	cprintf("rmap is good\n");
+}
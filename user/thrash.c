@@ -0,0 +1,36 @@
+// touch more memory than the machine has, twice, and check that every
+// page kept its contents: the kernel must swap instead of failing
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define BASE		((char *) 0x20000000)
+#define DEFPAGES	18432		// 72MB
+
+void
+umain(int argc, char **argv)
+{
+	uint32_t npages = DEFPAGES;
+	uint64_t start;
+	int r;
+
+	if (argc > 1)
+		npages = strtol(argv[1], 0, 0);
+
+	if ((r = sys_vm_reserve(BASE, npages * PGSIZE, PTE_W)) < 0)
+		panic("sys_vm_reserve: %i", r);
+
+	for (int pass = 0; pass < 2; pass++) {
+		start = read_tsc();
+		for (uint32_t i = 0; i < npages; i++) {
+			uint32_t *p = (uint32_t *) (BASE + i * PGSIZE);
+
+			if (pass > 0 && *p != i)
+				panic("page %u lost its contents: %08x", i, *p);
+			*p = i;
+		}
+		cprintf("pass %d: %u pages, %u Mcycles\n", pass, npages,
+			(uint32_t) ((read_tsc() - start) >> 20));
+	}
+	cprintf("thrash: ok\n");
+}
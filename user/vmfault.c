@@ -0,0 +1,81 @@
+// benchmark first-touch page faults: demand-zero regions handled in the
+// kernel (sys_vm_reserve) against the user-level upcall path and against
+// eager sys_page_alloc
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define NPAGES		512
+
+#define RESERVE_VA	((char *) 0x20000000)
+#define UPCALL_VA	((char *) 0x21000000)
+#define EAGER_VA	((char *) 0x22000000)
+#define KERNEL_VA	((char *) 0x23000000)
+
+static void
+handler(struct UTrapframe *utf)
+{
+	void *addr = ROUNDDOWN((void *) utf->utf_fault_va, PGSIZE);
+	int r;
+
+	if ((r = sys_page_alloc(0, addr, PTE_P | PTE_U | PTE_W)) < 0)
+		panic("allocating at %p in page fault handler: %i", addr, r);
+}
+
+static uint32_t
+touch(char *base)
+{
+	uint64_t start = read_tsc();
+
+	for (int i = 0; i < NPAGES; i++)
+		base[i * PGSIZE] = 1;
+
+	return (uint32_t) (read_tsc() - start);
+}
+
+void
+umain(int argc, char **argv)
+{
+	uint32_t reserve, upcall, eager;
+	struct timespec *tp;
+	uint64_t start;
+	int r;
+
+	// Demand-zero pages read back as zero and become writable.
+	if ((r = sys_vm_reserve(RESERVE_VA, NPAGES * PGSIZE, PTE_W)) < 0)
+		panic("sys_vm_reserve: %i", r);
+	for (int i = 0; i < NPAGES; i += 37)
+		assert(RESERVE_VA[i * PGSIZE + 5] == 0);
+	assert(sys_vm_reserve(RESERVE_VA + PGSIZE, PGSIZE, PTE_W) == -E_INVAL);
+	assert(sys_vm_reserve(0, 0, 0) == -E_NOT_FOUND);
+	assert(sys_vm_reserve(RESERVE_VA, 0, 0) == 0);
+	for (int i = 0; i < NPAGES; i++)
+		sys_page_unmap(0, RESERVE_VA + i * PGSIZE);
+
+	// The kernel writing to an untouched reserved page faults it in.
+	if ((r = sys_vm_reserve(KERNEL_VA, PGSIZE, PTE_W)) < 0)
+		panic("sys_vm_reserve: %i", r);
+	tp = (struct timespec *) KERNEL_VA;
+	if ((r = sys_clock_gettime(CLOCK_MONOTONIC, tp)) < 0)
+		panic("sys_clock_gettime: %i", r);
+	cprintf("kernel fault on reserved page: ok\n");
+
+	if ((r = sys_vm_reserve(RESERVE_VA, NPAGES * PGSIZE, PTE_W)) < 0)
+		panic("sys_vm_reserve: %i", r);
+	reserve = touch(RESERVE_VA);
+
+	set_pgfault_handler(handler);
+	upcall = touch(UPCALL_VA);
+
+	start = read_tsc();
+	for (int i = 0; i < NPAGES; i++)
+		if ((r = sys_page_alloc(0, EAGER_VA + i * PGSIZE,
+					PTE_P | PTE_U | PTE_W)) < 0)
+			panic("sys_page_alloc: %i", r);
+	eager = touch(EAGER_VA) + (uint32_t) (read_tsc() - start);
+
+	cprintf("cycles per page (%d pages):\n", NPAGES);
+	cprintf("  demand-zero  %u\n", reserve / NPAGES);
+	cprintf("  upcall       %u\n", upcall / NPAGES);
+	cprintf("  page_alloc   %u\n", eager / NPAGES);
+}